@@ -1,27 +1,39 @@
 //#define KY_OUTPUT_HDR // default output .bmp image, whether need to output .hdr image
 //#define KY_LOG_VAST
+//#define KY_ACCEL_STATS // count traversal steps of accelerators, slow down traversal a bit
+//#define KY_ACCEL_CACHE // store built accelerators in the working directory, later runs map them instead of building
 
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
-#include <ctime>
+#include <cstring>
+#include <chrono>
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <concepts>
 #include <exception>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <numbers>
+#include <numeric>
 #include <optional>
+#include <queue>
 #include <random>
 #include <source_location>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
 using namespace std::literals::string_literals;
@@ -50,6 +62,31 @@ using namespace std::literals::string_literals;
     #define KY_MACOS
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define KY_SSE
+#endif
+
+#if defined(__AVX__)
+    #define KY_AVX
+#endif
+
+#if defined(KY_SSE) || defined(KY_AVX)
+    #include <immintrin.h>
+#endif
+
+// file mapping of `mapped_file_t`
+#if defined(KY_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #define NOGDI
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 
 
 template <typename... Ts>
@@ -151,13 +188,228 @@ private:
 
 float timing_seconds(std::invocable auto function)
 {
-    clock_t start = clock();
+    // wall time, `clock()` sums up cpu time of all threads
+    auto start = std::chrono::steady_clock::now();
 
     function();
 
-    return (float_t)(clock() - start) / CLOCKS_PER_SEC;
+    return std::chrono::duration<float_t>(std::chrono::steady_clock::now() - start).count();
+}
+
+// FNV-1a, `hash` chains calls
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+    return hash;
 }
 
+// a whole file mapped read-only, processes mapping the same file share its pages
+class mapped_file_t : public nocopyable_t
+{
+public:
+    // `is_open()` tells whether it's mapped
+    explicit mapped_file_t(const std::string& filename)
+    {
+#ifdef KY_WINDOWS
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size{};
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            if (HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+            {
+                data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                size_ = data_ ? (size_t)size.QuadPart : 0;
+                CloseHandle(mapping); // the view keeps it
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = open(filename.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+
+        struct stat status{};
+        if (fstat(file, &status) == 0 && status.st_size > 0)
+        {
+            void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+            if (data != MAP_FAILED)
+            {
+                data_ = data;
+                size_ = (size_t)status.st_size;
+            }
+        }
+        close(file); // the mapping keeps it
+#endif // KY_WINDOWS
+    }
+
+    ~mapped_file_t()
+    {
+        if (!data_)
+            return;
+
+#ifdef KY_WINDOWS
+        UnmapViewOfFile(data_);
+#else
+        munmap(data_, size_);
+#endif // KY_WINDOWS
+    }
+
+    bool is_open() const { return data_ != nullptr; }
+    const uint8_t* data() const { return (const uint8_t*)data_; }
+    size_t size() const { return size_; }
+
+private:
+    void* data_{};
+    size_t size_{};
+};
+
+using mapped_file_sptr_t = std::shared_ptr<const mapped_file_t>;
+
+// 32-bit reference to an object in a `pool_t`, the concrete type in the top bits, the index in its array below
+using handle_t = uint32_t;
+inline constexpr handle_t k_null_handle = ~handle_t{};
+
+/*
+   single owner of objects of `base_t`, each concrete type of `types_t...` in its own contiguous array,
+   objects refer to each other by `handle_t` rather than by a shared pointer per object;
+   arrays only move while growing, so add all objects of a pool before taking pointers to them,
+   moving the pool keeps them in place
+*/
+template <typename base_t, typename... types_t>
+class pool_t : public nocopyable_t
+{
+public:
+    static constexpr int k_type_num = sizeof...(types_t);
+    static constexpr int k_index_bits = 28;
+    static constexpr handle_t k_index_mask = (handle_t{ 1 } << k_index_bits) - 1;
+    static_assert(k_type_num <= (1 << (32 - k_index_bits)));
+
+public:
+    pool_t() = default;
+
+    template <typename type_t>
+    handle_t add(type_t object)
+    {
+        std::vector<type_t>& array = std::get<std::vector<type_t>>(arrays_);
+        CHECK(array.size() < k_index_mask, "pool is full");
+
+        array.push_back(std::move(object));
+        handles_.push_back(((handle_t)type_index<type_t>() << k_index_bits) | (handle_t)(array.size() - 1));
+        return handles_.back();
+    }
+
+    // index of the concrete type of `handle` in `types_t...`
+    static int type(handle_t handle) { return (int)(handle >> k_index_bits); }
+
+    template <typename type_t>
+    type_t& get(handle_t handle)
+    {
+        CHECK_DEBUG(type(handle) == type_index<type_t>());
+        return std::get<std::vector<type_t>>(arrays_)[handle & k_index_mask];
+    }
+    template <typename type_t>
+    const type_t& get(handle_t handle) const { return const_cast<pool_t*>(this)->get<type_t>(handle); }
+
+    base_t* get(handle_t handle)
+    {
+        CHECK_DEBUG(handle != k_null_handle);
+        return get(handle, std::index_sequence_for<types_t...>{});
+    }
+    const base_t* get(handle_t handle) const { return const_cast<pool_t*>(this)->get(handle); }
+
+    // objects in the order they were added
+    int size() const { return (int)handles_.size(); }
+    base_t* operator[](int index) { return get(handles_[index]); }
+    const base_t* operator[](int index) const { return get(handles_[index]); }
+
+private:
+    template <typename type_t>
+    static constexpr int type_index()
+    {
+        constexpr bool is_types[] = { std::is_same_v<type_t, types_t>... };
+        for (int i = 0; i < k_type_num; ++i)
+        {
+            if (is_types[i])
+                return i;
+        }
+
+        return -1;
+    }
+
+    template <size_t... type_indexs>
+    base_t* get(handle_t handle, std::index_sequence<type_indexs...>)
+    {
+        base_t* object = nullptr;
+        ((type(handle) == (int)type_indexs ? (void)(object = &std::get<type_indexs>(arrays_)[handle & k_index_mask]) : (void)0), ...);
+        return object;
+    }
+
+private:
+    std::tuple<std::vector<types_t>...> arrays_;
+    std::vector<handle_t> handles_;
+};
+
+/*
+   a `std::vector<T>`, or an array in a `mapped_file_t` used in place,
+   which is copied into the vector the first time it's modified
+*/
+template <typename T>
+class mapped_vector_t
+{
+public:
+    mapped_vector_t() = default;
+    mapped_vector_t(mapped_file_sptr_t file, const T* data, size_t size) :
+        file_{ std::move(file) },
+        mapped_{ data },
+        mapped_size_{ size }
+    {
+    }
+
+    bool is_mapped() const { return mapped_ != nullptr; }
+
+    const T* data() const { return mapped_ ? mapped_ : vector_.data(); }
+    size_t size() const { return mapped_ ? mapped_size_ : vector_.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+
+    const T& operator[](size_t i) const { return data()[i]; }
+    T& operator[](size_t i) { return vector()[i]; }
+
+    // to be modified, copied from the mapping if needed
+    std::vector<T>& vector()
+    {
+        if (mapped_)
+        {
+            vector_.assign(mapped_, mapped_ + mapped_size_);
+            mapped_ = nullptr;
+            mapped_size_ = 0;
+            file_.reset();
+        }
+
+        return vector_;
+    }
+
+    void clear() { *this = {}; }
+    void reserve(size_t size) { vector().reserve(size); }
+    void push_back(const T& value) { vector().push_back(value); }
+    T& emplace_back() { return vector().emplace_back(); }
+
+private:
+    std::vector<T> vector_{};
+    mapped_file_sptr_t file_{};
+    const T* mapped_{};
+    size_t mapped_size_{};
+};
+
 #pragma endregion
 
 
@@ -188,6 +440,14 @@ constexpr degree_t degrees(radian_t radian) { return (180.f / k_pi) * radian; }
 
 constexpr float_t lerp(float_t a, float_t b, float_t t) { return a + t * (b - a); }
 
+// conservative bound of rounding error after `n` floating-point operations
+// https://www.pbr-book.org/3ed-2018/Shapes/Managing_Rounding_Error#x1-ErrorPropagation
+constexpr float_t error_gamma(int n)
+{
+    constexpr float_t machine_epsilon = k_epsilon * 0.5f;
+    return (n * machine_epsilon) / (1 - n * machine_epsilon);
+}
+
 inline bool is_infinity(std::floating_point auto x) { return std::isinf(x); }
 inline bool is_nan(std::floating_point auto x) { return std::isnan(x); }
 
@@ -215,8 +475,188 @@ constexpr bool is_equal(T x, T y, T epsilon = equal_epsilon<T>::absolute_epsilon
         return x == y;
 }
 
+// interleave the low 10 bits of x, y and z into a 30-bit Morton code, nearby cells get nearby codes
+// https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies#LinearBoundingVolumeHierarchies
+constexpr uint32_t morton_code3(uint32_t x, uint32_t y, uint32_t z)
+{
+    auto left_shift3 = [](uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v <<  8)) & 0x0300f00f;
+        v = (v | (v <<  4)) & 0x030c30c3;
+        v = (v | (v <<  2)) & 0x09249249;
+        return v;
+    };
+
+    return (left_shift3(z) << 2) | (left_shift3(y) << 1) | left_shift3(x);
+}
+
+#pragma endregion
+
+#pragma region simd
+
+// `N` floats in one register, `simd_float_t<4>` with SSE, `simd_float_t<8>` with AVX(or two SSE registers),
+// plain loops otherwise
+// min()/max() return the second operand if either is NaN, like `_mm_min_ps()`/`_mm_max_ps()`
+template <int N>
+struct simd_float_t
+{
+    std::array<float, N> v;
+
+    static simd_float_t load(const float* p) { simd_float_t r; std::copy(p, p + N, r.v.begin()); return r; }
+    static simd_float_t load(const uint8_t* p) { simd_float_t r; std::copy(p, p + N, r.v.begin()); return r; }
+    static simd_float_t broadcast(float f) { simd_float_t r; r.v.fill(f); return r; }
+    void store(float* p) const { std::copy(v.begin(), v.end(), p); }
+
+    friend simd_float_t operator+(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] += b.v[i]; return a; }
+    friend simd_float_t operator-(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] -= b.v[i]; return a; }
+    friend simd_float_t operator*(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] *= b.v[i]; return a; }
+    friend simd_float_t operator/(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] /= b.v[i]; return a; }
+    friend simd_float_t sqrt(simd_float_t a) { for (int i = 0; i < N; ++i) a.v[i] = std::sqrt(a.v[i]); return a; }
+
+    friend simd_float_t min(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+    friend simd_float_t max(simd_float_t a, simd_float_t b) { for (int i = 0; i < N; ++i) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+
+    // bit i is set if `a[i] <= b[i]`
+    friend int less_equal_mask(simd_float_t a, simd_float_t b)
+    {
+        int mask = 0;
+        for (int i = 0; i < N; ++i)
+            mask |= (a.v[i] <= b.v[i]) << i;
+        return mask;
+    }
+    // bit i is set if `a[i] < b[i]`
+    friend int less_mask(simd_float_t a, simd_float_t b)
+    {
+        int mask = 0;
+        for (int i = 0; i < N; ++i)
+            mask |= (a.v[i] < b.v[i]) << i;
+        return mask;
+    }
+};
+
+#ifdef KY_SSE
+template <>
+struct simd_float_t<4>
+{
+    __m128 v;
+
+    static simd_float_t load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static simd_float_t load(const uint8_t* p)
+    {
+        int32_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+
+        __m128i zero = _mm_setzero_si128();
+        __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)) };
+    }
+    static simd_float_t broadcast(float f) { return { _mm_set1_ps(f) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend simd_float_t operator+(simd_float_t a, simd_float_t b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend simd_float_t operator-(simd_float_t a, simd_float_t b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend simd_float_t operator*(simd_float_t a, simd_float_t b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend simd_float_t operator/(simd_float_t a, simd_float_t b) { return { _mm_div_ps(a.v, b.v) }; }
+    friend simd_float_t sqrt(simd_float_t a) { return { _mm_sqrt_ps(a.v) }; }
+
+    friend simd_float_t min(simd_float_t a, simd_float_t b) { return { _mm_min_ps(a.v, b.v) }; }
+    friend simd_float_t max(simd_float_t a, simd_float_t b) { return { _mm_max_ps(a.v, b.v) }; }
+
+    friend int less_equal_mask(simd_float_t a, simd_float_t b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+    friend int less_mask(simd_float_t a, simd_float_t b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+};
+#endif // KY_SSE
+
+#ifdef KY_AVX
+template <>
+struct simd_float_t<8>
+{
+    __m256 v;
+
+    static simd_float_t load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static simd_float_t load(const uint8_t* p)
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+        __m128i low = _mm_unpacklo_epi16(words, zero);
+        __m128i high = _mm_unpackhi_epi16(words, zero);
+        return { _mm256_cvtepi32_ps(_mm256_set_m128i(high, low)) };
+    }
+    static simd_float_t broadcast(float f) { return { _mm256_set1_ps(f) }; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend simd_float_t operator+(simd_float_t a, simd_float_t b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend simd_float_t operator-(simd_float_t a, simd_float_t b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend simd_float_t operator*(simd_float_t a, simd_float_t b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend simd_float_t operator/(simd_float_t a, simd_float_t b) { return { _mm256_div_ps(a.v, b.v) }; }
+    friend simd_float_t sqrt(simd_float_t a) { return { _mm256_sqrt_ps(a.v) }; }
+
+    friend simd_float_t min(simd_float_t a, simd_float_t b) { return { _mm256_min_ps(a.v, b.v) }; }
+    friend simd_float_t max(simd_float_t a, simd_float_t b) { return { _mm256_max_ps(a.v, b.v) }; }
+
+    friend int less_equal_mask(simd_float_t a, simd_float_t b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+    friend int less_mask(simd_float_t a, simd_float_t b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+};
+#elif defined(KY_SSE)
+// two SSE halves, so the 8-wide BVH keeps SIMD slab tests without AVX
+template <>
+struct simd_float_t<8>
+{
+    __m128 lo, hi;
+
+    static simd_float_t load(const float* p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+    static simd_float_t load(const uint8_t* p)
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+        return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)) };
+    }
+    static simd_float_t broadcast(float f) { return { _mm_set1_ps(f), _mm_set1_ps(f) }; }
+    void store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+
+    friend simd_float_t operator+(simd_float_t a, simd_float_t b) { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+    friend simd_float_t operator-(simd_float_t a, simd_float_t b) { return { _mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi) }; }
+    friend simd_float_t operator*(simd_float_t a, simd_float_t b) { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+    friend simd_float_t operator/(simd_float_t a, simd_float_t b) { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+    friend simd_float_t sqrt(simd_float_t a) { return { _mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi) }; }
+
+    friend simd_float_t min(simd_float_t a, simd_float_t b) { return { _mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi) }; }
+    friend simd_float_t max(simd_float_t a, simd_float_t b) { return { _mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi) }; }
+
+    friend int less_equal_mask(simd_float_t a, simd_float_t b)
+    {
+        return _mm_movemask_ps(_mm_cmple_ps(a.lo, b.lo)) | (_mm_movemask_ps(_mm_cmple_ps(a.hi, b.hi)) << 4);
+    }
+    friend int less_mask(simd_float_t a, simd_float_t b)
+    {
+        return _mm_movemask_ps(_mm_cmplt_ps(a.lo, b.lo)) | (_mm_movemask_ps(_mm_cmplt_ps(a.hi, b.hi)) << 4);
+    }
+};
+#endif // KY_AVX
+
+// lanes of the widest register
+#ifdef KY_AVX
+constexpr int k_simd_width = 8;
+#else
+constexpr int k_simd_width = 4;
+#endif // KY_AVX
+
+// start loading `size` bytes from `p` into the cache, a hint only
+inline void prefetch(const void* p, size_t size = 1)
+{
+#ifdef KY_SSE
+    for (size_t offset = 0; offset < size; offset += 64)
+        _mm_prefetch((const char*)p + offset, _MM_HINT_T0);
+    _mm_prefetch((const char*)p + size - 1, _MM_HINT_T0); // the last line when `p` isn't aligned
+#endif // KY_SSE
+}
+
 #pragma endregion
 
+
+
 #pragma region geometry
 
 struct color_t
@@ -478,18 +918,80 @@ public:
 
 public:
     // union, merge
+    // don't go through `bounds3_t(p1, p2)`, it would turn the union of two empty bounds into an infinite one
     bounds3_t join(point3_t p) const
     {
-        return bounds3_t(min(min_, p), max(max_, p));
+        bounds3_t result;
+        result.min_ = min(min_, p);
+        result.max_ = max(max_, p);
+        return result;
     }
     bounds3_t join(const bounds3_t& b) const
     {
-        return bounds3_t(min(min_, b.min_), max(max_, b.max_));
+        bounds3_t result;
+        result.min_ = min(min_, b.min_);
+        result.max_ = max(max_, b.max_);
+        return result;
     }
 
     friend bounds3_t join(const bounds3_t& b, point3_t p) { return b.join(p); }
     friend bounds3_t join(const bounds3_t& b1, const bounds3_t& b2) { return b1.join(b2); }
 
+    // overlap, empty if they don't overlap
+    bounds3_t intersect(const bounds3_t& b) const
+    {
+        bounds3_t result;
+        result.min_ = max(min_, b.min_);
+        result.max_ = min(max_, b.max_);
+        return result;
+    }
+
+    // part of the box within [min, max] alone `axis`
+    bounds3_t slab(int axis, float_t min, float_t max) const
+    {
+        bounds3_t result = *this;
+        (&result.min_.x)[axis] = std::max(min_[axis], min);
+        (&result.max_.x)[axis] = std::min(max_[axis], max);
+        return result;
+    }
+
+    bool is_empty() const { return min_.x > max_.x || min_.y > max_.y || min_.z > max_.z; }
+
+public:
+    // 0 for min point, 1 for max point
+    point3_t operator[](int i) const { CHECK_DEBUG(i == 0 || i == 1); return i == 0 ? min_ : max_; }
+
+    vec3_t diagonal() const { return max_ - min_; }
+    point3_t centroid() const { return lerp(min_, max_, (float_t)0.5); }
+
+    float_t surface_area() const
+    {
+        vec3_t d = diagonal();
+        return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+    }
+
+    // index of the longest axis
+    int max_extent() const
+    {
+        vec3_t d = diagonal();
+        if (d.x > d.y && d.x > d.z)
+            return 0;
+        else if (d.y > d.z)
+            return 1;
+        else
+            return 2;
+    }
+
+    // position of `p` relative to the box, (0, 0, 0) at min point and (1, 1, 1) at max point
+    vec3_t offset(point3_t p) const
+    {
+        vec3_t o = p - min_;
+        if (max_.x > min_.x) o.x /= max_.x - min_.x;
+        if (max_.y > min_.y) o.y /= max_.y - min_.y;
+        if (max_.z > min_.z) o.z /= max_.z - min_.z;
+        return o;
+    }
+
 public:
     bool contain(point3_t p) const
     {
@@ -499,6 +1001,63 @@ public:
             p.z >= min_.z && p.z <= max_.z;
     }
 
+    // slab test, `inv_direction` and `dir_is_neg` are precomputed per ray
+    // https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies#BVHTraversal
+    bool intersect_p(point3_t origin, vec3_t inv_direction, const int dir_is_neg[3], float_t ray_distance) const
+    {
+        const bounds3_t& bounds = *this;
+
+        float_t t_min  = (bounds[    dir_is_neg[0]].x - origin.x) * inv_direction.x;
+        float_t t_max  = (bounds[1 - dir_is_neg[0]].x - origin.x) * inv_direction.x;
+        float_t ty_min = (bounds[    dir_is_neg[1]].y - origin.y) * inv_direction.y;
+        float_t ty_max = (bounds[1 - dir_is_neg[1]].y - origin.y) * inv_direction.y;
+
+        // ensure conservative intersection
+        t_max  *= 1 + 2 * error_gamma(3);
+        ty_max *= 1 + 2 * error_gamma(3);
+
+        if (t_min > ty_max || ty_min > t_max)
+            return false;
+        if (ty_min > t_min) t_min = ty_min;
+        if (ty_max < t_max) t_max = ty_max;
+
+        float_t tz_min = (bounds[    dir_is_neg[2]].z - origin.z) * inv_direction.z;
+        float_t tz_max = (bounds[1 - dir_is_neg[2]].z - origin.z) * inv_direction.z;
+        tz_max *= 1 + 2 * error_gamma(3);
+
+        if (t_min > tz_max || tz_min > t_max)
+            return false;
+        if (tz_min > t_min) t_min = tz_min;
+        if (tz_max < t_max) t_max = tz_max;
+
+        return (t_min < ray_distance) && (t_max > 0);
+    }
+
+    // slab test returning the range [t0, t1] of the ray within the box, clipped to [0, ray_distance]
+    // https://www.pbr-book.org/3ed-2018/Shapes/Basic_Shape_Interface#RayndashBoundsIntersections
+    bool intersect_p(point3_t origin, vec3_t inv_direction, float_t ray_distance, float_t* out_t0, float_t* out_t1) const
+    {
+        float_t t0 = 0, t1 = ray_distance;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float_t t_near = (min_[axis] - origin[axis]) * inv_direction[axis];
+            float_t t_far  = (max_[axis] - origin[axis]) * inv_direction[axis];
+            if (t_near > t_far)
+                std::swap(t_near, t_far);
+
+            // ensure conservative intersection, a NaN(0 * infinity) keeps the range
+            t_far *= 1 + 2 * error_gamma(3);
+            t0 = t_near > t0 ? t_near : t0;
+            t1 = t_far  < t1 ? t_far  : t1;
+            if (t0 > t1)
+                return false;
+        }
+
+        *out_t0 = t0;
+        *out_t1 = t1;
+        return true;
+    }
+
 public:
     // return a sphere that hold this bounding box
     void bounding_sphere(point3_t* center, float_t* radius_) const
@@ -512,179 +1071,328 @@ private:
 };
 
 
+// row major, column vector: p' = m * p
 struct mat4_t
 {
-};
+    float_t m[4][4]{
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 } };
 
-
-
-// https://github.com/SmallVCM/SmallVCM/blob/master/src/frame.hxx
-class frame_t
-{
 public:
-    frame_t() = default;
-    frame_t(vec3_t s, vec3_t t, normal_t n) :
-        s_{ s.normalize() },
-        t_{ t.normalize() },
-        n_{ n.normalize() }
+    static mat4_t translate(vec3_t delta)
     {
+        mat4_t r;
+        r.m[0][3] = delta.x;
+        r.m[1][3] = delta.y;
+        r.m[2][3] = delta.z;
+        return r;
     }
 
-    frame_t(normal_t n) :
-        n_{ n.normalize()}
+    static mat4_t scale(vec3_t factor)
     {
-        set_from_z();
+        mat4_t r;
+        r.m[0][0] = factor.x;
+        r.m[1][1] = factor.y;
+        r.m[2][2] = factor.z;
+        return r;
     }
 
-public:
-    // think if {s, t, n} is (1, 0, 0), (0, 1, 0), (0, 0, 1)
-    vec3_t to_local(vec3_t world_vec3) const
+    // rotate around `axis` counterclockwise, when looking from the tip of `axis` to the origin
+    // https://www.pbr-book.org/3ed-2018/Geometry_and_Transformations/Transformations#RotationaroundanArbitraryAxis
+    static mat4_t rotate(degree_t degree, vec3_t axis)
     {
-        return vec3_t(
-            dot(s_, world_vec3),
-            dot(t_, world_vec3),
-            dot(n_, world_vec3));
+        vec3_t a = axis.normalize();
+        float_t sin_theta = std::sin(radians(degree));
+        float_t cos_theta = std::cos(radians(degree));
+
+        mat4_t r;
+        r.m[0][0] = a.x * a.x + (1 - a.x * a.x) * cos_theta;
+        r.m[0][1] = a.x * a.y * (1 - cos_theta) - a.z * sin_theta;
+        r.m[0][2] = a.x * a.z * (1 - cos_theta) + a.y * sin_theta;
+
+        r.m[1][0] = a.x * a.y * (1 - cos_theta) + a.z * sin_theta;
+        r.m[1][1] = a.y * a.y + (1 - a.y * a.y) * cos_theta;
+        r.m[1][2] = a.y * a.z * (1 - cos_theta) - a.x * sin_theta;
+
+        r.m[2][0] = a.x * a.z * (1 - cos_theta) - a.y * sin_theta;
+        r.m[2][1] = a.y * a.z * (1 - cos_theta) + a.x * sin_theta;
+        r.m[2][2] = a.z * a.z + (1 - a.z * a.z) * cos_theta;
+        return r;
     }
 
-    vec3_t to_world(vec3_t local_vec3) const
+public:
+    mat4_t operator*(const mat4_t& b) const
     {
-        return 
-            s_ * local_vec3.x + 
-            t_ * local_vec3.y + 
-            n_ * local_vec3.z;
+        mat4_t r;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + m[i][3] * b.m[3][j];
+        return r;
     }
 
-    vec3_t binormal() const { return s_; }
-    vec3_t tangent() const { return t_; }
-    vec3_t normal() const { return n_; }
-
-private:
-    void set_from_z()
+    mat4_t transpose() const
     {
-        vec3_t tmp_s = (std::abs(n_.x) > 0.99f) ? vec3_t(0, 1, 0) : vec3_t(1, 0, 0);
-        t_ = normalize(cross(n_, tmp_s));
-        s_ = normalize(cross(t_, n_));
+        mat4_t r;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                r.m[i][j] = m[j][i];
+        return r;
     }
 
-private:
-    // world frame basic vector
-    vec3_t   s_{ 1, 0, 0 }; // x
-    vec3_t   t_{ 0, 1, 0 }; // y
-    normal_t n_{ 0, 0, 1 }; // z
-};
+    // Gauss-Jordan elimination with full pivoting
+    // https://github.com/mmp/pbrt-v3/blob/master/src/core/transform.cpp
+    mat4_t inverse() const
+    {
+        int indxc[4], indxr[4];
+        int ipiv[4] = { 0, 0, 0, 0 };
+        float_t minv[4][4];
+        std::memcpy(minv, m, sizeof(minv));
 
+        for (int i = 0; i < 4; i++)
+        {
+            int irow = 0, icol = 0;
+            float_t big = 0;
 
+            // choose pivot
+            for (int j = 0; j < 4; j++)
+            {
+                if (ipiv[j] != 1)
+                {
+                    for (int k = 0; k < 4; k++)
+                    {
+                        if (ipiv[k] == 0)
+                        {
+                            if (std::abs(minv[j][k]) >= big)
+                            {
+                                big = std::abs(minv[j][k]);
+                                irow = j;
+                                icol = k;
+                            }
+                        }
+                        else if (ipiv[k] > 1)
+                        {
+                            LOG_ERROR("singular matrix in mat4_t::inverse()\n");
+                        }
+                    }
+                }
+            }
+            ++ipiv[icol];
 
-class ray_t
-{
-public:
-    ray_t(point3_t origin, unit_vec3_t direction, const float_t distance = k_infinity) :
-        origin_{ origin },
-        direction_{ direction },
-        distance_{ distance }
-    {
-        // TODO: move to unit_vec3_t
-        // CHECK_DEBUG(direction_.is_unit(), "ray.direction {} magnitude {:.6f} not a unit vector", 
-        //     direction_.to_string(), direction_.magnitude());
+            // swap rows `irow` and `icol` for pivot
+            if (irow != icol)
+            {
+                for (int k = 0; k < 4; ++k)
+                    std::swap(minv[irow][k], minv[icol][k]);
+            }
+
+            indxr[i] = irow;
+            indxc[i] = icol;
+            if (minv[icol][icol] == 0)
+                LOG_ERROR("singular matrix in mat4_t::inverse()\n");
+
+            // set m[icol][icol] to one by scaling row `icol` appropriately
+            float_t pivinv = 1 / minv[icol][icol];
+            minv[icol][icol] = 1;
+            for (int j = 0; j < 4; j++)
+                minv[icol][j] *= pivinv;
+
+            // subtract this row from others to zero out their columns
+            for (int j = 0; j < 4; j++)
+            {
+                if (j != icol)
+                {
+                    float_t save = minv[j][icol];
+                    minv[j][icol] = 0;
+                    for (int k = 0; k < 4; k++)
+                        minv[j][k] -= minv[icol][k] * save;
+                }
+            }
+        }
+
+        // swap columns to reflect permutation
+        for (int j = 3; j >= 0; j--)
+        {
+            if (indxr[j] != indxc[j])
+            {
+                for (int k = 0; k < 4; k++)
+                    std::swap(minv[k][indxr[j]], minv[k][indxc[j]]);
+            }
+        }
+
+        mat4_t r;
+        std::memcpy(r.m, minv, sizeof(minv));
+        return r;
     }
 
-    point3_t origin() const { return origin_; }
-    unit_vec3_t direction() const { return direction_; }
-    float_t distance() const { return distance_; }
+    point3_t transform_point(point3_t p) const
+    {
+        point3_t r(
+            m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+            m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+            m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+        float_t w = m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3];
 
-    void set_distance(float_t distance) const { distance_ = distance; }
+        return w == 1 ? r : r / w;
+    }
 
-    point3_t operator()(float_t t) const
+    vec3_t transform_vector(vec3_t v) const
     {
-        CHECK_DEBUG(t >= 0);
-        return origin_ + t * direction_;
+        return vec3_t(
+            m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+            m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+            m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
     }
 
-private:
-    point3_t origin_;
-    unit_vec3_t direction_; // confirm it is a unit vector
-    mutable float_t distance_; // distance from ray to intersection
+    bool is_identity() const
+    {
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                if (m[i][j] != (i == j ? 1 : 0))
+                    return false;
+        return true;
+    }
 };
 
 
 
-class bsdf_t;
-class material_t;
-class area_light_t;
-class surface_t;
-using bsdf_uptr_t = std::unique_ptr<bsdf_t>;
-
-// avoid self intersection
-point3_t offset_ray_origin(point3_t position, normal_t normal, unit_vec3_t direction)
+// a matrix and its inverse, normals are transformed by the transposed inverse
+class transform_t
 {
-    vec3_t offset = normal * 1e-2; // TODO: 1e-2
-    if (dot(normal, direction) < 0)
-        offset = -offset;
-    return position + offset;
-}
+public:
+    transform_t() = default;
+    transform_t(const mat4_t& m) : m_{ m }, m_inv_{ m.inverse() } {}
+    transform_t(const mat4_t& m, const mat4_t& m_inv) : m_{ m }, m_inv_{ m_inv } {}
 
-/*
-  prev   n   light
-  ----   ^   -----
-    ^    |    ^
-     \   | θ /
-   wo \  |  / wi is unknown, sampling from bsdf or light
-       \ | / 
-        \|/
-      -------
-       isect
-*/
+public:
+    transform_t operator*(const transform_t& t) const { return transform_t(m_ * t.m_, t.m_inv_ * m_inv_); }
+    transform_t inverse() const { return transform_t(m_inv_, m_); }
+
+    const mat4_t& matrix() const { return m_; }
+    const mat4_t& inverse_matrix() const { return m_inv_; }
 
-// surface intersection
-class isect_t : public nocopyable_t
-{
 public:
-    isect_t() = default;
-    isect_t(point3_t position, normal_t normal, unit_vec3_t wo) :
-        position{ position },
-        normal{ normal },
-        wo{ wo }
+    point3_t transform_point(point3_t p) const { return m_.transform_point(p); }
+    vec3_t transform_vector(vec3_t v) const { return m_.transform_vector(v); }
+
+    // not normalized
+    normal_t transform_normal(normal_t n) const
     {
+        const auto& m_inv = m_inv_.m;
+        return normal_t(
+            m_inv[0][0] * n.x + m_inv[1][0] * n.y + m_inv[2][0] * n.z,
+            m_inv[0][1] * n.x + m_inv[1][1] * n.y + m_inv[2][1] * n.z,
+            m_inv[0][2] * n.x + m_inv[1][2] * n.y + m_inv[2][2] * n.z);
     }
 
-public:
-    //void scattering();
+    // bound of the 8 transformed corners
+    bounds3_t transform_bounds(const bounds3_t& b) const
+    {
+        bounds3_t r;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            r = r.join(transform_point(point3_t(
+                b[corner & 1].x, b[(corner >> 1) & 1].y, b[(corner >> 2) & 1].z)));
+        }
 
-    const surface_t* surface() const { return surface_; }
+        return r;
+    }
+
+private:
+    mat4_t m_{};
+    mat4_t m_inv_{};
+};
 
-    const bsdf_t* bsdf() const { return bsdf_.get(); }
 
-    // prev <- isect, against ray's direction
-    color_t Le() const { return emission_; }
 
+// https://github.com/SmallVCM/SmallVCM/blob/master/src/frame.hxx
+class frame_t
+{
 public:
-    ray_t spawn_ray(unit_vec3_t direction) const
+    frame_t() = default;
+    frame_t(vec3_t s, vec3_t t, normal_t n) :
+        s_{ s.normalize() },
+        t_{ t.normalize() },
+        n_{ n.normalize() }
     {
-        return ray_t{ offset_ray_origin(position, normal, direction), direction };
     }
 
-    ray_t spawn_ray_to(point3_t target) const
+    frame_t(normal_t n) :
+        n_{ n.normalize()}
     {
-        return spawn_ray(normalize(target - position));
+        set_from_z();
     }
-    ray_t spawn_ray_to(const isect_t& isect) const
+
+public:
+    // think if {s, t, n} is (1, 0, 0), (0, 1, 0), (0, 0, 1)
+    vec3_t to_local(vec3_t world_vec3) const
     {
-        return spawn_ray(normalize(isect.position - position));
+        return vec3_t(
+            dot(s_, world_vec3),
+            dot(t_, world_vec3),
+            dot(n_, world_vec3));
     }
 
-public:
-    point3_t position{}; // world position of intersection
-    normal_t normal{};
-    unit_vec3_t wo{};
+    vec3_t to_world(vec3_t local_vec3) const
+    {
+        return 
+            s_ * local_vec3.x + 
+            t_ * local_vec3.y + 
+            n_ * local_vec3.z;
+    }
+
+    vec3_t binormal() const { return s_; }
+    vec3_t tangent() const { return t_; }
+    vec3_t normal() const { return n_; }
 
 private:
-    const surface_t* surface_{};
-    bsdf_uptr_t bsdf_{};
-    color_t emission_{};
+    void set_from_z()
+    {
+        vec3_t tmp_s = (std::abs(n_.x) > 0.99f) ? vec3_t(0, 1, 0) : vec3_t(1, 0, 0);
+        t_ = normalize(cross(n_, tmp_s));
+        s_ = normalize(cross(t_, n_));
+    }
 
-    friend surface_t;
+private:
+    // world frame basic vector
+    vec3_t   s_{ 1, 0, 0 }; // x
+    vec3_t   t_{ 0, 1, 0 }; // y
+    normal_t n_{ 0, 0, 1 }; // z
+};
+
+
+
+class ray_t
+{
+public:
+    ray_t(point3_t origin, unit_vec3_t direction, const float_t distance = k_infinity) :
+        origin_{ origin },
+        direction_{ direction },
+        distance_{ distance }
+    {
+        // TODO: move to unit_vec3_t
+        // CHECK_DEBUG(direction_.is_unit(), "ray.direction {} magnitude {:.6f} not a unit vector", 
+        //     direction_.to_string(), direction_.magnitude());
+    }
+
+    point3_t origin() const { return origin_; }
+    unit_vec3_t direction() const { return direction_; }
+    float_t distance() const { return distance_; }
+
+    void set_distance(float_t distance) const { distance_ = distance; }
+
+    point3_t operator()(float_t t) const
+    {
+        CHECK_DEBUG(t >= 0);
+        return origin_ + t * direction_;
+    }
+
+private:
+    point3_t origin_;
+    unit_vec3_t direction_; // confirm it is a unit vector
+    mutable float_t distance_; // distance from ray to intersection
 };
-using light_isect_t = isect_t;
 
 #pragma endregion
 
@@ -816,2233 +1524,6216 @@ inline float_t power_heuristic(int f_num, float_t f_pdf, int g_num, float_t g_pd
 
 #pragma endregion
 
-#pragma region sampler
-
-// random number generator
-// https://github.com/SmallVCM/SmallVCM/blob/master/src/rng.hxx
-class rng_t
-{
-public:
-    // TODO
-    rng_t(int seed = 1234) : rng_engine_(seed)
-    {
-    }
 
-    // [0, int_max]
-    int uniform_int()
-    {
-        return int_dist_(rng_engine_);
-    }
 
-    // [0, uint_max]
-    uint32_t uniform_uint()
-    {
-        return uint_dist_(rng_engine_);
-    }
+#pragma region bsdf_utility
 
-    // [0, 1)
-    float_t uniform_float()
-    {
-        return float_dist_(rng_engine_);
-    }
+// the functions below are based on local shading coordinate
 
-    // [0, 1), [0, 1)
-    vec2_t uniform_float2()
-    {
-        return vec2_t(uniform_float(), uniform_float());
-    }
+inline float_t cos_theta(vec3_t w) { return w.z; }
+inline float_t abs_cos_theta(vec3_t w) { return std::abs(w.z); }
 
-private:
-    std::mt19937_64 rng_engine_;
+inline bool same_hemisphere(vec3_t w, vec3_t wp) { return w.z * wp.z > 0; }
 
-    std::uniform_int_distribution<int> int_dist_;
-    std::uniform_int_distribution<uint32_t> uint_dist_;
-    std::uniform_real_distribution<float_t> float_dist_{ (float_t)0, (float_t)1 };
-};
+inline vec3_t reflect(vec3_t wo, normal_t normal)
+{
+    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularReflection
 
+    return -wo + 2 * dot(wo, normal) * normal;
+}
 
-struct camera_sample_t
+// eta = eta_i/eta_t
+inline bool refract(vec3_t wi, normal_t normal, float_t eta, vec3_t* out_wt)
 {
-    point2_t p_film{}; // sample point on film
-    // point2_t p_lens{};
-};
+    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularTransmission
+    // https://github.com/mmp/pbrt-v3/blob/master/src/core/reflection.h#L97-L109
+
+    // compute $\cos \theta_\mathrm{t}$ using Snell's law
+    float_t cos_theta_i = dot(normal, wi);
+    float_t sin_theta_i_sq = std::max(float_t(0), float_t(1 - cos_theta_i * cos_theta_i));
+    float_t sin_theta_t_sq = eta * eta * sin_theta_i_sq;
 
+    if (sin_theta_t_sq >= 1)
+        return false; // handle total internal reflection for transmission
 
-class sampler_t
+    float_t cos_theta_t = std::sqrt(1 - sin_theta_t_sq);
+    *out_wt = eta * -wi + (eta * cos_theta_i - cos_theta_t) * vec3_t(normal);
+
+    CHECK_DEBUG(out_wt->is_valid() && !out_wt->is_zero());
+    return true;
+}
+
+#pragma endregion
+
+#pragma region fresnel
+
+float_t fresnel_dielectric(
+    float_t cos_theta_i, 
+    float_t eta_i, float_t eta_t)
 {
-public:
-    virtual ~sampler_t() {}
+    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#FresnelReflectance
+    // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L66-L90
 
-    sampler_t(int samples_per_pixel) :
-        samples_per_pixel_{ samples_per_pixel }
+    cos_theta_i = std::clamp(cos_theta_i, (float_t)-1, (float_t)1);
+
+    bool entering = cos_theta_i > 0.f;
+    if (!entering)
+    {
+        std::swap(eta_i, eta_t);
+        cos_theta_i = std::abs(cos_theta_i);
+    }
+
+
+    // compute $\cos \theta_\mathrm{t}$ using Snell's law
+    float_t sin_theta_i = std::sqrt(std::max((float_t)0, 1 - cos_theta_i * cos_theta_i));
+    float_t sin_theta_t = eta_i / eta_t * sin_theta_i;
+
+    // Handle total internal reflection
+    if (sin_theta_t >= 1)
+        return 1;
+
+    float_t cos_theta_t = std::sqrt(std::max((float_t)0, 1 - sin_theta_t * sin_theta_t));
+
+
+    float_t r_para = ((eta_t * cos_theta_i) - (eta_i * cos_theta_t)) /
+                   ((eta_t * cos_theta_i) + (eta_i * cos_theta_t));
+    float_t r_perp = ((eta_i * cos_theta_i) - (eta_t * cos_theta_t)) /
+                   ((eta_i * cos_theta_i) + (eta_t * cos_theta_t));
+    return (r_para * r_para + r_perp * r_perp) / 2;
+}
+
+#pragma region schlick approximation 1994
+
+float_t fresnel_dielectric_schlick(
+    float_t cos_theta_i, float_t cos_theta_t, 
+    float_t eta_i, float_t eta_t)
+{
+    /*
+    cos_theta_i = std::clamp(cos_theta_i, -1.0, 1.0);
+    cos_theta_t = std::clamp(cos_theta_t, -1.0, 1.0);
+
+    bool entering = cos_theta_i > 0.f;
+    if (!entering)
+    {
+        std::swap(eta_i, eta_t);
+        cos_theta_i = std::abs(cos_theta_i);
+        cos_theta_t = std::abs(cos_theta_t);
+    }
+    */
+
+    float_t F0 = (eta_t - eta_i) / (eta_t + eta_i);
+    F0 *= F0;
+
+    //float_t cos_i = eta_i < eta_t ? cos_theta_i : cos_theta_t;
+    float_t cos_i = cos_theta_i < 0 ? -cos_theta_i : cos_theta_t;
+
+    return lerp(F0, 1.0f, std::pow(1 - cos_i, 5.0f) );
+}
+
+float_t fresnel_dielectric_schlick(
+    float_t cos_theta_i,
+    float_t eta_i, float_t eta_t)
+{
+    float_t F0 = (eta_t - eta_i) / (eta_t + eta_i);
+    F0 *= F0;
+
+    return lerp(F0, 1.0f, std::pow(1 - cos_theta_i, 5.0f));
+}
+
+/*
+   given
+     * the cosine of the incidence angle `cos_theta_i`,
+     * the fresnel reflectance at normal incidence `F0`
+   compute reflectance
+*/
+float_t fresnel_dielectric_schlick(float_t cos_theta_i, float_t F0)
+{
+    return lerp(F0, 1.0f, std::pow((1.0f - cos_theta_i), 5.0f));
+}
+
+/*
+color_t fresnel_dielectric_schlick(float_t cos_theta_i, color_t F0)
+{
+    return lerp(F0, vec3_t(1.0f), std::pow((1.0f - cos_theta_i), 5.0f));
+}
+*/
+
+#pragma endregion
+
+/*
+class fresnel_t
+{
+public:
+    virtual ~fresnel_t() = default;
+
+    virtual float_t evaluate(float_t cosI) const = 0;
+};
+
+class fresnel_dielectric_t : public fresnel_t
+{
+public:
+    fresnel_dielectric_t()
+    {
+    }
+
+    float_t evaluate(float_t cosI) const override
+    {
+        return 0;
+    }
+};
+
+// class fresnel_dummy_t : public fresnel_t
+*/
+
+#pragma endregion
+
+#pragma region bsdf
+
+/*
+   reference:
+     * LuxCoreRender Materials https://wiki.luxcorerender.org/LuxCoreRender_Materials
+     * Shader — Blender Manual https://docs.blender.org/manual/en/latest/render/shader_nodes/shader/index.html
+     * BSDFs - Mitsuba 3 https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html
+*/
+
+enum class bsdf_enum_t
+{
+    none = 0,
+    reflection = 1,
+    transmission = 2,
+    scattering = reflection | transmission,
+
+    diffuse = 4,
+    glossy = 8,
+    specluar = 16,
+};
+KY_ENUM_OPERATORS(bsdf_enum_t)
+
+inline bool is_delta_bsdf(bsdf_enum_t bsdf_type)
+{
+    return enum_have(bsdf_type, bsdf_enum_t::specluar);
+}
+
+/* 
+  local shading frame:
+
+      z/n(0, 0, 1)
+       |
+       |
+       |
+       |
+       |_ _ _ _ _ _ x/s(1, 0, 0)
+      / p
+     /
+    /
+  y/t(0, 1, 0)
+
+  prev   n   light
+  ----   ^   -----
+    ^    |    ^
+     \   | θ /
+   wo \  |  / wi is unknown, sampling from bsdf or light
+       \ | /
+        \|/
+      -------
+       isect
+
+   https://www.pbr-book.org/3ed-2018/Reflection_Models#x0-GeometricSetting
+*/
+
+struct bsdf_sample_t
+{
+    color_t f{}; // scattering rate 
+    vec3_t wi{}; // world wi
+    float_t pdf{};
+    bsdf_enum_t bsdf_type{}; // flags
+};
+
+/*
+   bxdfs: the scattering models a `bsdf_t` is made of, they work in the local shading frame,
+   `eval()`, `pdf()` and `sample()` are plain member functions, picked by `bsdf_t` with a switch
+*/
+
+class lambertion_reflection_t
+{
+public:
+    lambertion_reflection_t(color_t albedo) :
+        albedo_{ albedo }
+    {
+    }
+
+    bool is_delta() const { return false; }
+
+    color_t eval(vec3_t wo, vec3_t wi) const
+    {
+        // TODO: confirm
+        if (!same_hemisphere(wo, wi))
+            return color_t{};
+
+        // lambertion surface's albedo divided by $\pi$ is surface bidirectional reflectance
+        return albedo_ * k_inv_pi;
+    }
+
+    float_t pdf(vec3_t wo, vec3_t wi) const
+    {
+        return same_hemisphere(wo, wi) ? cosine_hemisphere_pdf(abs_cos_theta(wi)) : 0;
+    }
+
+    bsdf_sample_t sample(vec3_t wo, float2_t random) const
+    {
+        bsdf_sample_t sample;
+
+        // cosine-sample the hemisphere, flipping the direction if necessary
+        sample.wi = cosine_hemisphere_sample(random);
+        if (wo.z < 0) 
+            sample.wi.z *= -1;
+
+        sample.f = eval(wo, sample.wi);
+        sample.pdf = pdf(wo, sample.wi);
+        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::diffuse;
+
+        CHECK_DEBUG(sample.f.is_valid());
+        return sample;
+    }
+
+private:
+    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Matte
+    // https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html#smooth-diffuse-material-diffuse
+    // surface directional-hemispherical reflectance, usually called `albedo`
+    // symbol: $\rho_{\mathrm{hd}}$
+    color_t albedo_{};
+};
+
+
+
+/*
+  ideal specular reflection, ignore fresnel effect,
+  only suitable for some metal materials
+
+  as a delta bsdf, it's `eval(...), pdf(...) sample(...)` functions requires special processing,
+  same to `fresnel_specular_t`
+*/
+class perfect_specular_reflection_t
+{
+public:
+    perfect_specular_reflection_t(color_t reflectance) :
+        reflectance_{ reflectance }
+    {
+    }
+
+    bool is_delta() const { return true; }
+
+    color_t eval(vec3_t wo, vec3_t wi) const { return color_t(); }
+    float_t pdf(vec3_t wo, vec3_t wi) const { return 0; }
+
+    bsdf_sample_t sample(vec3_t wo, float2_t random) const
+    {
+        // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularReflection
+        // https://github.com/infancy/pbrt-v3/blob/master/src/materials/mirror.cpp#L45-L57  mirror material use `FresnelNoOp`
+        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.h#L387-L408   class SpecularReflection;
+        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L181-L191 SpecularReflection::Sample_f(...)
+        
+        bsdf_sample_t sample; 
+        sample.wi = vec3_t(-wo.x, -wo.y, wo.z); // sample.wi = reflect(wo, vec3_t(0, 0, 1));
+        sample.f = reflectance_ / abs_cos_theta(sample.wi); // (f / cos_theta) * Li * cos_theta / pdf => f * Li
+        sample.pdf = 1;
+        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::specluar;
+
+        CHECK_DEBUG(sample.f.is_valid());
+        return sample;
+    }
+
+private:
+    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Mirror
+    color_t reflectance_{};
+};
+
+
+
+/*
+   https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular%20transmission%20projections.svg
+
+   ray            N
+    *             |             *
+       *     θ_i  |          *
+          *       |       *
+             *    |    *            outside ior: eta_i
+                * | *
+    - - - - - - - - - - - - - - - - interface
+                  |*
+                  | *               inside ior:  eta_t
+                  |  *
+                  |   *
+                  |    *
+                  | θ_t *
+*/
+class fresnel_specular_t
+{
+public:
+    fresnel_specular_t(float_t eta_i, float_t eta_t, color_t reflectance, color_t transmittance) :
+        eta_i_{ eta_i },
+        eta_t_{ eta_t },
+        reflectance_{ reflectance },
+        transmittance_{ transmittance }
+    {
+    }
+
+    bool is_delta() const { return true; }
+
+    color_t eval(vec3_t wo, vec3_t wi) const { return color_t(); }
+    float_t pdf(vec3_t wo, vec3_t wi) const { return 0; }
+
+    bsdf_sample_t sample(vec3_t wo, float2_t random) const
+    {
+        // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#FresnelReflectance
+        // 
+        // https://github.com/infancy/pbrt-v3/blob/master/src/materials/glass.cpp#L64-L69   full smooth glass
+        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.h#L440-L463   class FresnelSpecular;
+        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L627-L667 FresnelSpecular::Sample_f(...)
+
+
+        bsdf_sample_t sample;
+
+        // percentage of light's reflect and refract
+        float_t reflect_percent = fresnel_dielectric(cos_theta(wo), eta_i_, eta_t_);
+        float_t refract_percent = 1 - reflect_percent;
+
+        // and probability of single ray is reflect or refract
+        float_t Pr_reflect = reflect_percent, Pr_refract = refract_percent;
+
+        // Russian roulette
+        if (random[0] < Pr_reflect)
+        {
+            // specular reflection
+
+            sample.wi = vec3_t(-wo.x, -wo.y, wo.z);
+
+            sample.pdf = Pr_reflect;
+            sample.f = (reflectance_ * reflect_percent) / abs_cos_theta(sample.wi);
+            sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::specluar;
+
+            CHECK_DEBUG(sample.f.is_valid());
+        }
+        else
+        {
+            // specular refract/transmission
+
+            normal_t normal(0, 0, 1); // use `z` as normal
+            bool into = normal.dot(wo) > 0; // ray from outside going in?
+
+            normal_t wo_normal = into ? normal : normal * -1;
+            float_t eta = into ? eta_i_ / eta_t_ : eta_t_ / eta_i_;
+
+            if (refract(wo, wo_normal, eta, &sample.wi))
+            {
+                sample.pdf = Pr_refract;
+                sample.f = (transmittance_ * refract_percent) / abs_cos_theta(sample.wi);
+                sample.bsdf_type = bsdf_enum_t::transmission | bsdf_enum_t::specluar;
+
+                CHECK_DEBUG(sample.f.is_valid());
+            }
+            else
+            {
+                sample.f = color_t(); // total internal reflection
+            }
+        }
+
+        return sample;
+    }
+
+    /*
+    // smallpt version
+    color_t sample(vec3_t wo, float2_t random,
+        vec3_t* out_wi, float_t* out_pdf_direction, bsdf_enum_t* out_bsdf_type) const
+    {
+        normal_t normal(0, 0, 1);
+        bool into = normal.dot(wo) > 0; // ray from outside going in?
+
+        normal_t wo_normal = into ? normal : normal * -1;
+        float_t eta = into ? etaI_ / etaT_ : etaT_ / etaI_;
+
+        if (!refract(wo, wo_normal, eta, out_wi))
+        {
+            return color_t(); // total internal reflection
+        }
+
+        float_t cos_theta_a = wo.dot(wo_normal);
+        float_t cos_theta_b = (*out_wi).dot(normal);
+        float_t cos_theta_i = into ? cos_theta_a : cos_theta_b;
+
+        float_t Re = fresnel_dielectric_schlick(cos_theta_a, etaI_, etaT_);
+        float_t Tr = 1 - Re;
+
+        if (random[0] < Re)
+        {
+            // Compute specular reflection for _FresnelSpecular_
+
+            *out_wi = vec3_t(-wo.x, -wo.y, wo.z);
+            *out_pdf_direction = Re; // Russian roulette???
+
+            return (Re * R_) / abs_cos_theta(*out_wi);
+        }
+        else
+        {
+            // Compute specular transmission for _FresnelSpecular_
+
+            *out_pdf_direction = Tr;
+            return (T_ * Tr) / abs_cos_theta(*out_wi);
+        }
+    }
+    */
+
+private:
+    // outside and inside ior of interface
+    float_t eta_i_{}; // ior_i_
+    float_t eta_t_{}; // ior_t_
+
+    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Glass
+    // https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html#smooth-dielectric-material-dielectric
+    // optional factor that can be used to modulate the specular reflection/transmission component. 
+    color_t reflectance_{};
+    color_t transmittance_{};
+};
+
+
+
+// physically based(energy conservation) Phong specular reflection model
+// Lafortune and Willems, “Using the modified Phong reflectance model for physically based rendering”, Technical Report http://graphics.cs.kuleuven.be/publications/Phong/
+class phong_specular_reflection_t
+{
+public:
+    phong_specular_reflection_t(/*color_t Kd,*/ color_t Ks, float_t exponent) :
+        Ks_{ Ks },
+        exponent_{ exponent }
+    {
+    }
+
+    bool is_delta() const { return false; }
+
+    color_t eval(vec3_t wo, vec3_t wi) const
+    {
+        // TODO: confirm
+        if (!same_hemisphere(wo, wi))
+            return color_t{};
+
+        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
+        const float_t cos_alpha = dot(wr, wi);
+
+        const color_t rho = Ks_ * (exponent_ + 2.f) * k_inv_2pi;
+        return rho * std::pow(cos_alpha, exponent_);
+    }
+
+    float_t pdf(vec3_t wo, vec3_t wi) const
+    {
+        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
+        //const float_t cos_alpha = dot(wr, wi);
+
+        return cosine_hemisphere_pdf_phong(wr, wi);
+    }
+
+    bsdf_sample_t sample(vec3_t wo, float2_t random) const
+    {
+        bsdf_sample_t sample;
+
+        // TODO
+        sample.wi = cosine_hemisphere_sample_phong(random);
+
+        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
+        frame_t frame{ wr };
+        sample.wi = frame.to_world(sample.wi);
+
+        if (wo.z < 0)
+            sample.wi.z *= -1;
+
+        sample.f = eval(wo, sample.wi);
+        sample.pdf = pdf(wo, sample.wi);
+        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::glossy;
+        
+        return sample;
+    }
+
+private:
+    // cosine lobe hemisphere sampling
+    vec3_t cosine_hemisphere_sample_phong(vec2_t random) const
+    {
+        const float_t phi = 2.f * k_pi * random[0];
+        const float_t cos_theta = std::pow(random[1], 1.f / (exponent_ + 1.f));
+        const float_t sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+
+        return vec3_t(
+            std::cos(phi) * sin_theta,
+            std::sin(phi) * sin_theta,
+            cos_theta);
+    }
+
+    float_t cosine_hemisphere_pdf_phong(
+        vec3_t aNormal, vec3_t aDirection) const
+    {
+        const float_t cosTheta = std::max(0.f, dot(aNormal, aDirection));
+        return (exponent_ + 1.f) * std::pow(cosTheta, exponent_) * k_inv_2pi;
+    }
+
+private:
+    color_t Ks_{};
+    float_t exponent_{};
+};
+
+
+
+/*
+  diffuse base plus Phong specular coat, both lobes in one bxdf: `sample()` picks a lobe by `random[0]`,
+  then reuses it rescaled for the direction, `eval()` and `pdf()` cover both lobes, so whichever lobe gave
+  a direction, its value is the same, and MIS with light sampling sees the whole material
+*/
+class plastic_reflection_t
+{
+public:
+    plastic_reflection_t(color_t diffuse_color, color_t specular_color, float_t exponent, float_t specular_probability) :
+        diffuse_{ diffuse_color },
+        specular_{ specular_color, exponent },
+        specular_probability_{ specular_probability }
+    {
+    }
+
+    bool is_delta() const { return false; }
+
+    color_t eval(vec3_t wo, vec3_t wi) const
+    {
+        return diffuse_.eval(wo, wi) + specular_.eval(wo, wi);
+    }
+
+    float_t pdf(vec3_t wo, vec3_t wi) const
+    {
+        return (1 - specular_probability_) * diffuse_.pdf(wo, wi) + specular_probability_ * specular_.pdf(wo, wi);
+    }
+
+    bsdf_sample_t sample(vec3_t wo, float2_t random) const
+    {
+        bsdf_sample_t sample;
+
+        if (random.x < specular_probability_)
+        {
+            float_t u = std::min(random.x / specular_probability_, 1 - k_epsilon);
+            sample = specular_.sample(wo, float2_t(u, random.y));
+        }
+        else
+        {
+            float_t u = std::min((random.x - specular_probability_) / (1 - specular_probability_), 1 - k_epsilon);
+            sample = diffuse_.sample(wo, float2_t(u, random.y));
+        }
+
+        sample.f = eval(wo, sample.wi);
+        sample.pdf = pdf(wo, sample.wi);
+
+        CHECK_DEBUG(sample.f.is_valid());
+        return sample;
+    }
+
+private:
+    lambertion_reflection_t diffuse_;
+    phong_specular_reflection_t specular_;
+    float_t specular_probability_{}; // of sampling the specular lobe
+};
+
+
+
+/*
+  bsdf of a hit: one bxdf of the closed set above and the shading frame, held by value in `isect_t`,
+  built by `material_t::scattering()` without any allocation; calls go to the bxdf by a switch on its
+  index, so they're inlined
+*/
+class bsdf_t
+{
+public:
+    using bxdf_t = std::variant<
+        lambertion_reflection_t,
+        perfect_specular_reflection_t,
+        fresnel_specular_t,
+        phong_specular_reflection_t,
+        plastic_reflection_t>;
+
+    bsdf_t() = default;
+
+    template <typename bxdf_type_t>
+    bsdf_t(const frame_t& shading_frame, const bxdf_type_t& bxdf) :
+        shading_frame_{ shading_frame },
+        bxdf_{ bxdf }
+    {
+    }
+
+public:
+    bool is_delta() const
+    {
+        return visit([](const auto& bxdf) { return bxdf.is_delta(); });
+    }
+
+    // or called `f()`, `evaluate()`
+    color_t eval(vec3_t world_wo, vec3_t world_wi) const
+    {
+        vec3_t wo = to_local(world_wo), wi = to_local(world_wi);
+        return visit([&](const auto& bxdf) { return bxdf.eval(wo, wi); });
+    }
+
+    float_t pdf(vec3_t world_wo, vec3_t world_wi) const
+    {
+        vec3_t wo = to_local(world_wo), wi = to_local(world_wi);
+        return visit([&](const auto& bxdf) { return bxdf.pdf(wo, wi); });
+    }
+
+    // or called `sample_f()`, `sample_direction()`, `sample_solid_angle()`
+    bsdf_sample_t sample(vec3_t world_wo, float2_t random) const
+    {
+        vec3_t wo = to_local(world_wo);
+        bsdf_sample_t sample = visit([&](const auto& bxdf) { return bxdf.sample(wo, random); });
+        sample.wi = to_world(sample.wi); // <--- ATTENTION!!!
+
+        return sample;
+    }
+
+    std::tuple<color_t, float_t> eval_and_pdf(vec3_t world_wo, vec3_t world_wi) const
+    {
+        vec3_t wo = to_local(world_wo), wi = to_local(world_wi);
+
+        return visit([&](const auto& bxdf) { return std::tuple<color_t, float_t>{ bxdf.eval(wo, wi), bxdf.pdf(wo, wi) }; });
+    }
+
+private:
+    template <typename function_t>
+    std::invoke_result_t<const function_t&, const lambertion_reflection_t&> visit(const function_t& function) const
+    {
+        static_assert(std::variant_size_v<bxdf_t> == 5, "a case for each bxdf");
+
+        switch (bxdf_.index())
+        {
+            case 0: return function(*std::get_if<0>(&bxdf_));
+            case 1: return function(*std::get_if<1>(&bxdf_));
+            case 2: return function(*std::get_if<2>(&bxdf_));
+            case 3: return function(*std::get_if<3>(&bxdf_));
+            default: return function(*std::get_if<4>(&bxdf_));
+        }
+    }
+
+    vec3_t to_local(vec3_t world_vec3) const
+    {
+        return shading_frame_.to_local(world_vec3);
+    }
+
+    vec3_t to_world(vec3_t local_vec3) const
+    {
+        return shading_frame_.to_world(local_vec3);
+    }
+
+private:
+    frame_t shading_frame_{};
+    bxdf_t bxdf_{ lambertion_reflection_t{ color_t{} } }; // black until `isect_t::scattering()`
+};
+
+#pragma endregion
+
+
+
+#pragma region intersection
+
+class material_t;
+class area_light_t;
+class surface_t;
+struct scene_pool_t;
+
+// avoid self intersection
+point3_t offset_ray_origin(point3_t position, normal_t normal, unit_vec3_t direction)
+{
+    vec3_t offset = normal * 1e-2; // TODO: 1e-2
+    if (dot(normal, direction) < 0)
+        offset = -offset;
+    return position + offset;
+}
+
+/*
+  prev   n   light
+  ----   ^   -----
+    ^    |    ^
+     \   | θ /
+   wo \  |  / wi is unknown, sampling from bsdf or light
+       \ | / 
+        \|/
+      -------
+       isect
+*/
+
+// surface intersection
+class isect_t : public nocopyable_t
+{
+public:
+    isect_t() = default;
+    isect_t(point3_t position, normal_t normal, unit_vec3_t wo) :
+        position{ position },
+        normal{ normal },
+        wo{ wo }
+    {
+    }
+
+public:
+    // build bsdf and emission of the hit surface from the material and light in `pool`,
+    // only called once for the closest hit
+    void scattering(const scene_pool_t& pool);
+
+    // `scattering()` of a hit known to be on a `material_type_t`, no virtual call
+    template <typename material_type_t>
+    void scattering(const scene_pool_t& pool);
+
+    const surface_t* surface() const { return surface_; }
+
+    const bsdf_t* bsdf() const { return &bsdf_; }
+
+    // prev <- isect, against ray's direction
+    color_t Le() const { return emission_; }
+
+public:
+    ray_t spawn_ray(unit_vec3_t direction) const
+    {
+        return ray_t{ offset_ray_origin(position, normal, direction), direction };
+    }
+
+    ray_t spawn_ray_to(point3_t target) const
+    {
+        return spawn_ray(normalize(target - position));
+    }
+    ray_t spawn_ray_to(const isect_t& isect) const
+    {
+        return spawn_ray(normalize(isect.position - position));
+    }
+
+public:
+    point3_t position{}; // world position of intersection
+    normal_t normal{};
+    unit_vec3_t wo{};
+
+private:
+    const surface_t* surface_{};
+    bsdf_t bsdf_{};
+    color_t emission_{};
+
+    friend surface_t;
+};
+using light_isect_t = isect_t;
+
+class instance_t;
+
+/*
+   what traversal keeps of a hit, 32 bytes against the much larger `isect_t`, which is built from the closest
+   hit of a ray only once, see `surface_t::get_isect()`; closer hits overwrite it as they're found
+*/
+struct hit_t
+{
+    const surface_t* surface{};
+    const instance_t* instance{}; // `surface` is in the object space of it, if any
+    float_t distance{}; // along the ray in the space of `surface`
+    float_t u{}, v{}; // barycentric coordinates of p1 and p2 on triangles
+};
+
+#pragma endregion
+
+#pragma region sampler
+
+// random number generator
+// https://github.com/SmallVCM/SmallVCM/blob/master/src/rng.hxx
+class rng_t
+{
+public:
+    // TODO
+    rng_t(int seed = 1234) : rng_engine_(seed)
+    {
+    }
+
+    // [0, int_max]
+    int uniform_int()
+    {
+        return int_dist_(rng_engine_);
+    }
+
+    // [0, uint_max]
+    uint32_t uniform_uint()
+    {
+        return uint_dist_(rng_engine_);
+    }
+
+    // [0, 1)
+    float_t uniform_float()
+    {
+        return float_dist_(rng_engine_);
+    }
+
+    // [0, 1), [0, 1)
+    vec2_t uniform_float2()
+    {
+        return vec2_t(uniform_float(), uniform_float());
+    }
+
+private:
+    std::mt19937_64 rng_engine_;
+
+    std::uniform_int_distribution<int> int_dist_;
+    std::uniform_int_distribution<uint32_t> uint_dist_;
+    std::uniform_real_distribution<float_t> float_dist_{ (float_t)0, (float_t)1 };
+};
+
+
+struct camera_sample_t
+{
+    point2_t p_film{}; // sample point on film
+    // point2_t p_lens{};
+};
+
+
+class sampler_t
+{
+public:
+    virtual ~sampler_t() {}
+
+    sampler_t(int samples_per_pixel) :
+        samples_per_pixel_{ samples_per_pixel }
     {
     }
 
     virtual std::unique_ptr<sampler_t> clone() = 0;
 
+    // a random stream of its own, for work split across threads in a fixed way
+    void set_seed(int seed) { rng_ = rng_t(seed); }
+
+public:
+    virtual int ge_samples_per_pixel()
+    {
+        return samples_per_pixel_;
+    }
+    virtual void set_samples_per_pixel(int samples_per_pixel)
+    {
+        samples_per_pixel_ = samples_per_pixel;
+    }
+
+public:
+    virtual void start_pixel()
+    {
+        current_sample_index_ = 0;
+    }
+    virtual bool next_sample()
+    {
+        current_sample_index_ += 1;
+        return current_sample_index_ < samples_per_pixel_;
+    }
+
+public:
+    virtual float_t get_float() = 0;
+    virtual vec2_t get_float2() = 0;
+    virtual camera_sample_t get_camera_sample(point2_t p_film) = 0;
+
+protected:
+    rng_t rng_{};
+
+    int samples_per_pixel_{};
+    int current_sample_index_{};
+};
+
+class debug_sampler_t : public sampler_t
+{
+public:
+    using sampler_t::sampler_t;
+
+    std::unique_ptr<sampler_t> clone() override
+    {
+        return std::make_unique<debug_sampler_t>(samples_per_pixel_);
+    }
+
+public:
+    float_t get_float() override
+    {
+        return 0.5f;
+    }
+
+    vec2_t get_float2() override
+    {
+        return { 0.5f, 0.5f };
+    }
+
+    camera_sample_t get_camera_sample(point2_t p_film) override
+    {
+        return { p_film + vec2_t{0.5f, 0.5f} };
+    }
+};
+
+class random_sampler_t : public sampler_t
+{
+public:
+    using sampler_t::sampler_t;
+
+    std::unique_ptr<sampler_t> clone() override
+    {
+        return std::make_unique<random_sampler_t>(samples_per_pixel_);
+    }
+
+public:
+    float_t get_float() override
+    {
+        return rng_.uniform_float();
+    }
+
+    vec2_t get_float2() override
+    {
+        return rng_.uniform_float2();
+    }
+
+    // TODO: coroutine
+    camera_sample_t get_camera_sample(point2_t p_film) override
+    {
+        return { p_film + rng_.uniform_float2() };
+    }
+};
+
+// TODO
+class stratified_sampler_t : public sampler_t
+{
+public:
+    camera_sample_t get_camera_sample(point2_t p_film) override
+    {
+        return { p_film + rng_.uniform_float2() };
+    }
+};
+
+#pragma endregion
+
+
+
+#pragma region shape
+
+/*
+     z(0, 0, 1)
+          |
+          | theta/
+          |    /
+          |  /
+          |/_ _ _ _ _ _ x(1, 0, 0)
+         / \
+        / phi\
+       /       \
+      /          \
+ y(0, 1, 0)
+
+   https://www.pbr-book.org/3ed-2018/Shapes/Spheres
+*/
+
+enum class shape_enum_t
+{
+    sphere,
+    disk,
+    triangle,
+    mesh_triangle,
+    rectangle,
+};
+
+class shape_t
+{
+public:
+    virtual ~shape_t() = default;
+
+    // concrete type, lets `surface_soa_t` copy the geometry of same-type shapes out
+    virtual shape_enum_t shape_enum() const = 0;
+
+    // hit before `ray.distance()`, which is shortened to it, `surface` of the hit is left to the caller
+    virtual bool intersect(const ray_t& ray, hit_t* out_hit) const = 0;
+    // only test whether there is a hit before `ray.distance()`, without building hit_t
+    virtual bool intersect_p(const ray_t& ray) const = 0;
+
+    // geometry of a hit found by `intersect()`
+    virtual isect_t get_isect(const ray_t& ray, const hit_t& hit) const = 0;
+
+    virtual bounds3_t world_bound() const = 0;
+    virtual float_t area() const = 0;
+
+    // bound of the part of the shape inside `clip`, for spatial splits of `bvh_accel_t`,
+    // clip the bound by default, which is loose for shapes lying diagonally in it
+    virtual bounds3_t clip_bound(const bounds3_t& clip) const { return world_bound().intersect(clip); }
+
+    // move the shape in world space by a rigid transform(rotation and translation),
+    // accelerators holding it need `accel_t::update()` afterwards
+    virtual void transform(const transform_t&)
+    {
+        LOG_ERROR("the shape can't be moved");
+    }
+
+public:
+    // these methods below only used for `area_light_t`
+
+    // TODO: return position_sample_t
+    virtual light_isect_t sample_position(float2_t random, float_t* out_pdf_position) const = 0;
+
+
+    // TODO: return direction_sample_t
+    // default compute `*_direction` by `*_position` 
+    virtual light_isect_t sample_direction(const isect_t& isect, float2_t random, float_t* out_pdf_direction) const
+    {
+        isect_t light_isect = sample_position(random, out_pdf_direction);
+        vec3_t wi = light_isect.position - isect.position;
+
+        if (wi.magnitude_squared() == 0)
+        {
+            *out_pdf_direction = 0;
+        }
+        else
+        {
+            wi = normalize(wi);
+            // look comments in `pdf_direction()` below
+            *out_pdf_direction *= distance_squared(light_isect.position, isect.position) / abs_dot(light_isect.normal, -wi);
+
+            if (std::isinf(*out_pdf_direction))
+                *out_pdf_direction = 0.f;
+        }
+
+        return light_isect;
+    }
+    virtual float_t pdf_direction(const isect_t& isect, unit_vec3_t world_wi) const
+    {
+        ray_t ray = isect.spawn_ray(world_wi);
+        hit_t hit;
+
+        if (!intersect(ray, &hit))
+            return 0;
+
+        isect_t light_isect = get_isect(ray, hit);
+
+        /*
+          convert light sample point to solid angle:
+
+              $$\mathrm{d} \omega = \fact{\mathrm{d} A^{\perp} }{l^{2}} $$
+
+          because:
+              unit_solid_angle = 1 / distance_squared(...)
+              projected_light_area = abs_dot(...) * area()
+              projected_solid_angle = projected_light_area / distance_squared
+
+              pdf = distance_squared(...) / (abs_dot(...) * area()) = inverse_projected_solid_angle
+              1 / pdf 
+                      = (abs_dot(...) * area()) / distance_squared(...) = projected_solid_angle
+                      = (1 / distance_squared(...)) * (abs_dot(...) * area()) = unit_solid_angle * projected_light_area
+
+          so:
+              (f * Li * cos_theta) / pdf = f * (Li * cos_theta * projected_solid_angle)
+
+          or:
+              (f * Li * cos_theta) / pdf = f * (Li * cos_theta * unit_solid_angle * projected_light_area)
+        */
+        float_t pdf = distance_squared(isect.position, light_isect.position) / (abs_dot(light_isect.normal, -world_wi) * area());
+        if (std::isinf(pdf))
+            pdf = 0.f;
+
+        return pdf;
+    }
+
+public:
+    static constexpr float_t epsilon = 1e-3;// TODO
+};
+
+// bound of the convex polygon `vertices` clipped by `clip`, by Sutherland-Hodgman against the 6 planes
+inline bounds3_t clip_polygon_bound(const point3_t* vertices, int vertex_num, const bounds3_t& clip)
+{
+    constexpr int k_max_vertex_num = 4 + 6; // each plane adds a vertex at most
+    CHECK_DEBUG(vertex_num <= 4);
+
+    point3_t polygons[2][k_max_vertex_num];
+    std::copy(vertices, vertices + vertex_num, polygons[0]);
+    int current = 0;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            const point3_t* in = polygons[current];
+            point3_t* out = polygons[1 - current];
+            int out_num = 0;
+
+            // positive inside the plane
+            float_t plane = clip[side][axis];
+            auto inside = [=](point3_t p) { return side == 0 ? p[axis] - plane : plane - p[axis]; };
+
+            for (int i = 0; i < vertex_num; ++i)
+            {
+                point3_t a = in[i];
+                point3_t b = in[(i + 1) % vertex_num];
+                float_t da = inside(a);
+                float_t db = inside(b);
+
+                if (da >= 0)
+                    out[out_num++] = a;
+                if ((da >= 0) != (db >= 0))
+                    out[out_num++] = lerp(a, b, da / (da - db));
+            }
+
+            vertex_num = out_num;
+            current = 1 - current;
+            if (vertex_num == 0)
+                return bounds3_t{};
+        }
+    }
+
+    bounds3_t bound;
+    for (int i = 0; i < vertex_num; ++i)
+        bound = bound.join(polygons[current][i]);
+
+    // intersection points may round a little out of the planes
+    return bound.intersect(clip);
+}
+
+
+
+class disk_t : public shape_t
+{
+public:
+    disk_t(point3_t position, normal_t normal, float_t radius):
+        position_{ position },
+        normal_{ normalize(normal) },
+        radius_{ radius }
+
+    {
+    }
+
+    shape_enum_t shape_enum() const override { return shape_enum_t::disk; }
+
+    bool intersect(const ray_t& ray, hit_t* out_hit) const override
+    {
+        float_t distance{};
+        if (!hit_distance(ray, &distance))
+            return false;
+
+        ray.set_distance(distance);
+        out_hit->distance = distance;
+
+        return true;
+    }
+
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const override
+    {
+        return isect_t(ray(hit.distance), normal_, -ray.direction());
+    }
+
+    bool intersect_p(const ray_t& ray) const override
+    {
+        float_t distance{};
+        return hit_distance(ray, &distance);
+    }
+
+    bounds3_t world_bound() const override
+    {
+        // extent of a disk alone axis `i` is `radius * sin(angle between normal and axis)`
+        vec3_t offset(
+            radius_ * std::sqrt(std::max((float_t)0, 1 - normal_.x * normal_.x)),
+            radius_ * std::sqrt(std::max((float_t)0, 1 - normal_.y * normal_.y)),
+            radius_ * std::sqrt(std::max((float_t)0, 1 - normal_.z * normal_.z)));
+        return bounds3_t(position_ - offset, position_ + offset);
+    }
+
+    float_t area() const override { return k_pi * radius_ * radius_; }
+
+    void transform(const transform_t& rigid) override
+    {
+        position_ = rigid.transform_point(position_);
+        normal_ = normalize(rigid.transform_normal(normal_));
+    }
+
+public:
+    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    {
+        isect_t light_isect;
+
+        frame_t frame{ normal_ };
+        point2_t sample_point = concentric_disk_sample(random);
+        light_isect.position = position_ + radius_ * (frame.binormal() * sample_point.x + frame.tangent() * sample_point.y);
+
+        light_isect.normal = normalize(normal_);
+
+        *pdf = 1 / area();
+        return light_isect;
+    }
+
+private:
+    bool hit_distance(const ray_t& ray, float_t* out_distance) const
+    {
+        if (is_equal(dot(ray.direction(), normal_), (float_t)0))
+            return false;
+ 
+        const vec3_t op = position_ - ray.origin();
+        const float_t distance = dot(normal_, op) / dot(normal_, ray.direction());
+
+        if ((distance > epsilon) && (distance < ray.distance()))
+        {
+            point3_t hit_point = ray(distance);
+            if (::distance(position_, hit_point) <= radius_)
+            {
+                *out_distance = distance;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+public:
+    point3_t position_;
+    normal_t normal_;
+    float_t radius_;
+};
+
+// `normal` of the triangle plane, not necessarily normalized
+// `out_barycentric` weights p0, p1, p2 of the hit point
+inline bool triangle_hit_distance(point3_t p0, point3_t p1, point3_t p2, normal_t normal,
+    const ray_t& ray, float_t* out_distance, vec3_t* out_barycentric = nullptr)
+{
+    // https://github.com/SmallVCM/SmallVCM/blob/master/src/geometry.hxx#L125-L156
+
+    const vec3_t oa = p0 - ray.origin();
+    const vec3_t ob = p1 - ray.origin();
+    const vec3_t oc = p2 - ray.origin();
+
+    const vec3_t v0 = cross(oc, ob);
+    const vec3_t v1 = cross(ob, oa);
+    const vec3_t v2 = cross(oa, oc);
+
+    const float_t v0d = dot(v0, ray.direction());
+    const float_t v1d = dot(v1, ray.direction());
+    const float_t v2d = dot(v2, ray.direction());
+
+    if (((v0d <  0.f) && (v1d <  0.f) && (v2d <  0.f)) ||
+        ((v0d >= 0.f) && (v1d >= 0.f) && (v2d >= 0.f)))
+    {
+        // 1. first calculate the vertical distance from ray.origin to the plane,
+        //    by `dot(normal, op)` (or `bo`, `co`)
+        // 2. then calculate the distance from ray.origin to the plane alone ray.direction, 
+        //    by `distance * dot(normal, ray.direction()) = vertical_distance`
+        const float_t distance = dot(normal, oa) / dot(normal, ray.direction());
+
+        if ((distance > shape_t::epsilon) && (distance < ray.distance()))
+        {
+            *out_distance = distance;
+
+            // each volume is spanned by the ray and the edge opposite to a vertex
+            if (out_barycentric)
+            {
+                float_t sum = v0d + v1d + v2d;
+                *out_barycentric = sum != 0 ? vec3_t(v0d, v2d, v1d) / sum : vec3_t(1, 0, 0);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+class triangle_t : public shape_t
+{
+public:
+    triangle_t(point3_t p0, point3_t p1, point3_t p2, bool flip_normal = false)
+    {
+        p0_ = p0;
+        p1_ = p1;
+        p2_ = p2;
+
+        normal_ = normalize(cross(p1_ - p0_, p2_ - p0_));
+        if (flip_normal)
+            normal_ = -normal_;
+    }
+
+    shape_enum_t shape_enum() const override { return shape_enum_t::triangle; }
+
+    bool intersect(const ray_t& ray, hit_t* out_hit) const override
+    {
+        float_t distance{};
+        if (!hit_distance(ray, &distance))
+            return false;
+
+        ray.set_distance(distance);
+        out_hit->distance = distance;
+
+        return true;
+    }
+
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const override
+    {
+        return isect_t(ray(hit.distance), normal_, -ray.direction());
+    }
+
+    bool intersect_p(const ray_t& ray) const override
+    {
+        float_t distance{};
+        return hit_distance(ray, &distance);
+    }
+
+    bounds3_t world_bound() const override
+    {
+        return bounds3_t(p0_, p1_).join(p2_);
+    }
+
+    float_t area() const override { return 0.5 * cross(p1_ - p0_, p2_ - p0_).magnitude(); }
+
+    bounds3_t clip_bound(const bounds3_t& clip) const override
+    {
+        point3_t vertices[3] = { p0_, p1_, p2_ };
+        return clip_polygon_bound(vertices, 3, clip);
+    }
+
+    void transform(const transform_t& rigid) override
+    {
+        p0_ = rigid.transform_point(p0_);
+        p1_ = rigid.transform_point(p1_);
+        p2_ = rigid.transform_point(p2_);
+        normal_ = normalize(rigid.transform_normal(normal_));
+    }
+
+public:
+    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    {
+        point2_t b = uniform_triangle_sample(random);
+
+        isect_t light_isect;
+        light_isect.position = b.x * p0_ + b.y * p1_ + (1 - b.x - b.y) * p2_;
+        light_isect.normal = normal_;
+
+        *pdf = 1 / area();
+        return light_isect;
+    }
+
+private:
+    bool hit_distance(const ray_t& ray, float_t* out_distance) const
+    {
+        return triangle_hit_distance(p0_, p1_, p2_, normal_, ray, out_distance);
+    }
+
+public:
+    point3_t p0_;
+    point3_t p1_;
+    point3_t p2_;
+    normal_t normal_;
+};
+
+
+
+class triangle_mesh_t;
+
+// a triangle of `triangle_mesh_t`, only keeps its index, vertices live in the mesh buffers
+class mesh_triangle_t : public shape_t
+{
+public:
+    mesh_triangle_t(const triangle_mesh_t* mesh, int index) : mesh_{ mesh }, index_{ index } {}
+
+    shape_enum_t shape_enum() const override { return shape_enum_t::mesh_triangle; }
+
+    bool intersect(const ray_t& ray, hit_t* out_hit) const override;
+    bool intersect_p(const ray_t& ray) const override;
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const override;
+
+    bounds3_t world_bound() const override;
+    float_t area() const override;
+    bounds3_t clip_bound(const bounds3_t& clip) const override;
+
+    void positions(point3_t* p0, point3_t* p1, point3_t* p2) const;
+
+public:
+    light_isect_t sample_position(float2_t random, float_t* pdf) const override;
+
+private:
+    const triangle_mesh_t* mesh_;
+    int index_; // `index * 3` is the first vertex index
+};
+
+/*
+   contiguous position, normal and index buffers shared by all triangles of the mesh,
+   the triangles point back to the mesh, so it can't be copied or moved, hold it by `triangle_mesh_uptr_t`
+*/
+class triangle_mesh_t
+{
+public:
+    // `normals` are per vertex and optional, the face normal(counterclockwise order) is used without them
+    triangle_mesh_t(std::vector<point3_t> positions, std::vector<int> indices,
+        std::vector<normal_t> normals = {}, bool flip_normal = false) :
+        positions_{ std::move(positions) },
+        normals_{ std::move(normals) },
+        indices_{ std::move(indices) },
+        flip_normal_{ flip_normal }
+    {
+        CHECK(indices_.size() % 3 == 0, "triangle mesh needs 3 indices per triangle");
+        CHECK(normals_.empty() || normals_.size() == positions_.size(), "triangle mesh needs 1 normal per vertex");
+        for (int index : indices_)
+            CHECK(index >= 0 && index < (int)positions_.size(), "triangle mesh index {} out of range", index);
+
+        int triangle_num = (int)indices_.size() / 3;
+        triangles_.reserve(triangle_num);
+        for (int i = 0; i < triangle_num; ++i)
+            triangles_.emplace_back(this, i);
+    }
+
+    triangle_mesh_t(const triangle_mesh_t&) = delete;
+    triangle_mesh_t& operator=(const triangle_mesh_t&) = delete;
+
+public:
+    // the vertices are shared, so a mesh moves as a whole rather than by its triangles, see `shape_t::transform()`
+    void transform(const transform_t& rigid)
+    {
+        for (point3_t& position : positions_)
+            position = rigid.transform_point(position);
+        for (normal_t& normal : normals_)
+            normal = normalize(rigid.transform_normal(normal));
+    }
+
+    int triangle_num() const { return (int)triangles_.size(); }
+    const shape_t* triangle(int index) const { return &triangles_[index]; }
+
+    // vertices of triangle `index`
+    void positions(int index, point3_t* p0, point3_t* p1, point3_t* p2) const
+    {
+        const int* v = &indices_[index * 3];
+        *p0 = positions_[v[0]];
+        *p1 = positions_[v[1]];
+        *p2 = positions_[v[2]];
+    }
+
+    // `barycentric` weights p0, p1, p2
+    normal_t normal(int index, vec3_t barycentric) const
+    {
+        normal_t normal;
+        if (normals_.empty())
+        {
+            point3_t p0, p1, p2;
+            positions(index, &p0, &p1, &p2);
+            normal = cross(p1 - p0, p2 - p0);
+        }
+        else
+        {
+            const int* v = &indices_[index * 3];
+            normal = barycentric.x * normals_[v[0]] + barycentric.y * normals_[v[1]] + barycentric.z * normals_[v[2]];
+        }
+
+        normal = normalize(normal);
+        return flip_normal_ ? -normal : normal;
+    }
+
+private:
+    std::vector<point3_t> positions_;
+    std::vector<normal_t> normals_;
+    std::vector<int> indices_;
+    bool flip_normal_;
+
+    std::vector<mesh_triangle_t> triangles_;
+};
+
+using triangle_mesh_uptr_t = std::unique_ptr<triangle_mesh_t>;
+using triangle_mesh_list_t = std::vector<triangle_mesh_uptr_t>;
+
+inline bool mesh_triangle_t::intersect(const ray_t& ray, hit_t* out_hit) const
+{
+    point3_t p0, p1, p2;
+    mesh_->positions(index_, &p0, &p1, &p2);
+
+    float_t distance{};
+    vec3_t barycentric{};
+    if (!triangle_hit_distance(p0, p1, p2, cross(p1 - p0, p2 - p0), ray, &distance, &barycentric))
+        return false;
+
+    ray.set_distance(distance);
+    out_hit->distance = distance;
+    out_hit->u = barycentric.y;
+    out_hit->v = barycentric.z;
+
+    return true;
+}
+
+inline isect_t mesh_triangle_t::get_isect(const ray_t& ray, const hit_t& hit) const
+{
+    vec3_t barycentric(1 - hit.u - hit.v, hit.u, hit.v);
+    return isect_t(ray(hit.distance), mesh_->normal(index_, barycentric), -ray.direction());
+}
+
+inline bool mesh_triangle_t::intersect_p(const ray_t& ray) const
+{
+    point3_t p0, p1, p2;
+    mesh_->positions(index_, &p0, &p1, &p2);
+
+    float_t distance{};
+    return triangle_hit_distance(p0, p1, p2, cross(p1 - p0, p2 - p0), ray, &distance);
+}
+
+inline void mesh_triangle_t::positions(point3_t* p0, point3_t* p1, point3_t* p2) const
+{
+    mesh_->positions(index_, p0, p1, p2);
+}
+
+inline bounds3_t mesh_triangle_t::world_bound() const
+{
+    point3_t p0, p1, p2;
+    mesh_->positions(index_, &p0, &p1, &p2);
+
+    return bounds3_t(p0, p1).join(p2);
+}
+
+inline bounds3_t mesh_triangle_t::clip_bound(const bounds3_t& clip) const
+{
+    point3_t vertices[3];
+    mesh_->positions(index_, &vertices[0], &vertices[1], &vertices[2]);
+
+    return clip_polygon_bound(vertices, 3, clip);
+}
+
+inline float_t mesh_triangle_t::area() const
+{
+    point3_t p0, p1, p2;
+    mesh_->positions(index_, &p0, &p1, &p2);
+
+    return 0.5 * cross(p1 - p0, p2 - p0).magnitude();
+}
+
+inline light_isect_t mesh_triangle_t::sample_position(float2_t random, float_t* pdf) const
+{
+    point3_t p0, p1, p2;
+    mesh_->positions(index_, &p0, &p1, &p2);
+
+    point2_t b = uniform_triangle_sample(random);
+    vec3_t barycentric(b.x, b.y, 1 - b.x - b.y);
+
+    isect_t light_isect;
+    light_isect.position = barycentric.x * p0 + barycentric.y * p1 + barycentric.z * p2;
+    light_isect.normal = mesh_->normal(index_, barycentric);
+
+    *pdf = 1 / area();
+    return light_isect;
+}
+
+class rectangle_t : public shape_t
+{
+public:
+    rectangle_t(point3_t p0, point3_t p1, point3_t p2, point3_t p3, bool flip_normal = false)
+    {
+        p0_ = p0;
+        p1_ = p1;
+        p2_ = p2;
+        p3_ = p3;
+        // TODO: CHECK_DEBUG
+
+        normal_ = normalize(cross(p1_ - p0_, p2_ - p0_));
+        if (flip_normal)
+            normal_ = -normal_;
+    }
+
+    shape_enum_t shape_enum() const override { return shape_enum_t::rectangle; }
+
+    bool intersect(const ray_t& ray, hit_t* out_hit) const override
+    {
+        float_t distance{};
+        if (!hit_distance(ray, &distance))
+            return false;
+
+        ray.set_distance(distance);
+        out_hit->distance = distance;
+
+        return true;
+    }
+
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const override
+    {
+        normal_t normal = dot(normal_, ray.direction()) <= 0 ? normal_ : -normal_;
+        return isect_t(ray(hit.distance), normal, -ray.direction());
+    }
+
+    bool intersect_p(const ray_t& ray) const override
+    {
+        float_t distance{};
+        return hit_distance(ray, &distance);
+    }
+
+    bounds3_t world_bound() const override
+    {
+        return bounds3_t(p0_, p1_).join(p2_).join(p3_);
+    }
+
+    float_t area() const override { return cross(p0_ - p1_, p2_ - p1_).magnitude(); }
+
+    bounds3_t clip_bound(const bounds3_t& clip) const override
+    {
+        point3_t vertices[4] = { p0_, p1_, p2_, p3_ };
+        return clip_polygon_bound(vertices, 4, clip);
+    }
+
+    void transform(const transform_t& rigid) override
+    {
+        p0_ = rigid.transform_point(p0_);
+        p1_ = rigid.transform_point(p1_);
+        p2_ = rigid.transform_point(p2_);
+        p3_ = rigid.transform_point(p3_);
+        normal_ = normalize(rigid.transform_normal(normal_));
+    }
+
+public:
+    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    {
+        isect_t light_isect;
+        light_isect.position = p1_ + (p0_ - p1_) * random[0] + (p2_ - p1_) * random[1];
+        light_isect.normal = normalize(normal_);
+
+        *pdf = 1 / area();
+        return light_isect;
+    }
+
+private:
+    bool hit_distance(const ray_t& ray, float_t* out_distance) const
+    {
+        // https://github.com/SmallVCM/SmallVCM/blob/master/src/geometry.hxx#L125-L156
+
+        const vec3_t oa = p0_ - ray.origin();
+        const vec3_t ob = p1_ - ray.origin();
+        const vec3_t oc = p2_ - ray.origin();
+        const vec3_t od = p3_ - ray.origin();
+
+        const vec3_t v0 = cross(oc, ob);
+        const vec3_t v1 = cross(ob, oa);
+        const vec3_t v2 = cross(oa, od);
+        const vec3_t v3 = cross(od, oc);
+
+        const float_t v0d = dot(v0, ray.direction());
+        const float_t v1d = dot(v1, ray.direction());
+        const float_t v2d = dot(v2, ray.direction());
+        const float_t v3d = dot(v3, ray.direction());
+
+        if (((v0d <  0.f) && (v1d <  0.f) && (v2d <  0.f) && (v3d <  0.f)) ||
+            ((v0d >= 0.f) && (v1d >= 0.f) && (v2d >= 0.f) && (v3d >= 0.f)))
+        {
+            const float_t distance = dot(normal_, oa) / dot(normal_, ray.direction());
+
+            if ((distance > epsilon) && (distance < ray.distance()))
+            {
+                *out_distance = distance;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+public:
+    point3_t p0_;
+    point3_t p1_;
+    point3_t p2_;
+    point3_t p3_;
+    normal_t normal_;
+};
+
+class sphere_t : public shape_t
+{
+public:
+    sphere_t(vec3_t center, float_t radius) :
+        center_(center),
+        radius_(radius),
+        radius_sq_(radius * radius)
+    {
+    }
+
+    shape_enum_t shape_enum() const override { return shape_enum_t::sphere; }
+
+    vec3_t center() const { return center_; }
+    float_t radius_sq() const { return radius_sq_; }
+
+    bool intersect(const ray_t& ray, hit_t* out_hit) const override
+    {
+        float_t distance{};
+        if (!hit_distance(ray, &distance))
+            return false;
+
+        ray.set_distance(distance);
+        out_hit->distance = distance;
+
+        return true;
+    }
+
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const override
+    {
+        point3_t hit_point = ray(hit.distance);
+        return isect_t(hit_point, (hit_point - center_).normalize(), -ray.direction());
+    }
+
+    bool intersect_p(const ray_t& ray) const override
+    {
+        float_t distance{};
+        return hit_distance(ray, &distance);
+    }
+
+    bounds3_t world_bound() const override
+    {
+        vec3_t half(radius_, radius_, radius_);
+        return bounds3_t(center_ + half, center_ - half);
+    }
+
+    float_t area() const override { return 4 * k_pi * radius_sq_; }
+
+    // a rigid transform keeps the radius
+    void transform(const transform_t& rigid) override
+    {
+        center_ = rigid.transform_point(center_);
+    }
+
+public:
+    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    {
+        unit_vec3_t direction = uniform_sphere_sample(random);
+        point3_t position = center_ + radius_ * direction;
+
+        isect_t light_isect;
+        light_isect.position = position;
+        light_isect.normal = normalize(direction);
+
+        *pdf = 1 / area();
+
+        return light_isect;
+    }
+
+    // TODO: confirm
+    light_isect_t sample_direction(const isect_t& isect, float2_t random, float_t* pdf) const override
+    {
+        if (distance_squared(isect.position, center_) <= radius_ * radius_)
+        {
+            isect_t light_isect = sample_position(random, pdf);
+            vec3_t wi = light_isect.position - isect.position;
+
+            if (wi.magnitude_squared() == 0)
+                *pdf = 0;
+            else
+            {
+                // convert from area measure returned by Sample() call above to solid angle measure.
+                wi = normalize(wi);
+                *pdf *= distance_squared(light_isect.position, isect.position) / abs_dot(isect.normal, -wi);
+            }
+
+            if (std::isinf(*pdf))
+                *pdf = 0.f;
+
+            return light_isect;
+        }
+
+        // sample sphere uniformly inside subtended cone
+
+        /*
+                /         _
+               /        / O \
+              /         O O O (a sphere)
+             /       .  \ O /
+            /    .
+           / .     theta
+          . _ _ _ _ _ _ _ _
+
+        */
+
+        float_t dist = distance(isect.position, center_);
+        float_t inv_dist = 1 / dist;
+
+        // compute $\theta$ and $\phi$ values for sample in cone
+        float_t sin_theta_max = radius_ * inv_dist;
+        float_t sin_theta_max_sq = sin_theta_max * sin_theta_max;
+        float_t inv_sin_theta_max = 1 / sin_theta_max;
+        float_t cos_theta_max = std::sqrt(std::max((float_t)0.f, 1 - sin_theta_max_sq));
+
+        float_t cos_theta = (cos_theta_max - 1) * random[0] + 1;
+        float_t sin_theta_sq = 1 - cos_theta * cos_theta;
+
+        if (sin_theta_max_sq < 0.00068523f /* sin^2(1.5 deg) */)
+        {
+            /* fall back to a Taylor series expansion for small angles, where
+               the standard approach suffers from severe cancellation errors */
+            sin_theta_sq = sin_theta_max_sq * random[0];
+            cos_theta = std::sqrt(1 - sin_theta_sq);
+        }
+
+        // compute angle $\alpha$ from center of sphere to sampled point on surface
+        float_t cos_alpha = sin_theta_sq * inv_sin_theta_max +
+            cos_theta * std::sqrt(std::max((float_t)0.f, 1.f - sin_theta_sq * inv_sin_theta_max * inv_sin_theta_max));
+        float_t sin_alpha = std::sqrt(std::max((float_t)0.f, 1.f - cos_alpha * cos_alpha));
+        float_t phi = random[1] * 2 * k_pi;
+
+        // compute coordinate system for sphere sampling
+        vec3_t normal = (center_ - isect.position) * inv_dist;
+        frame_t frame{ normal };
+
+        // compute surface normal and sampled point on sphere
+        vec3_t world_normal =
+            spherical_to_direction(sin_alpha, cos_alpha, phi, -frame.binormal(), -frame.tangent(), -frame.normal());
+        point3_t world_position = center_ + radius_ * point3_t(world_normal.x, world_normal.y, world_normal.z);
+
+        isect_t light_isect;
+        light_isect.position = world_position;
+        light_isect.normal = world_normal;
+
+        // uniform cone PDF.
+        *pdf = 1 / (2 * k_pi * (1 - cos_theta_max));
+
+        return light_isect;
+    }
+
+    float_t pdf_direction(const isect_t& isect, vec3_t world_wi) const override
+    {
+        // return uniform PDF if point is inside sphere
+        if (distance_squared(isect.position, center_) <= radius_ * radius_)
+            return shape_t::pdf_direction(isect, world_wi);
+
+        // compute general sphere PDF
+        float_t sin_theta_max_sq = radius_ * radius_ / distance_squared(isect.position, center_);
+        float_t cos_theta_max = std::sqrt(std::max((float_t)0, 1 - sin_theta_max_sq));
+        return uniform_cone_pdf(cos_theta_max);
+    }
+
+private:
+    bool hit_distance(const ray_t& ray, float_t* out_distance) const
+    {
+        /*
+          ray: p(t) = o + t*d,
+          sphere: ||p - c||^2 = r^2
+
+          if ray and sphere have a intersection p, then:
+             ||p(t) - c||^2 = r^2
+          => ||o + t*d - c||^2 = r^2
+          => (t*d + o - c).(t*d + o - c) = r^2
+          => d.d*t^2 + 2d.(o-c)*t + (o-c).(o-c)-r^2 = 0
+
+          compare with:
+             at^2 + bt + c = 0
+
+          there have:
+             co = o - c
+             a = dot(d, d) = 1;
+             b = 2 * dot(d, co), neg_b' = dot(d, oc);
+             c = dot(co, co) - r^2;
+
+          so:
+             t = (-b +/- sqrt(b^2 - 4ac)) / 2a
+               = (-b +/- sqrt(b^2 - 4c)) / 2
+               = ((-2 * dot(d, co) +/- sqrt(4 * dot(d, co)^2 - 4 * (dot(co, co) - r^2))) / 2
+               = -dot(d, co) +/- sqrt( dot(d, co)^2 - dot(co, co) + r^2 )
+               = neg_b' +/- sqrt(discr)
+        */
+
+        vec3_t oc = center_ - ray.origin();
+        float_t neg_b = dot(oc, ray.direction());
+        float_t discr = neg_b * neg_b - dot(oc, oc) + radius_sq_;
+
+        float_t distance = 0;
+        bool hit = false;
+        if (discr >= 0)
+         {
+            float_t sqrt_discr = sqrt(discr);
+
+            if (distance = neg_b - sqrt_discr; distance > epsilon && distance < ray.distance())
+            {
+                hit = true;
+            }
+            else if (distance = neg_b + sqrt_discr; distance > epsilon && distance < ray.distance())
+            {
+                hit = true;
+            }
+        }
+
+        if (hit)
+            *out_distance = distance;
+
+        return hit;
+    }
+
+private:
+    vec3_t center_;
+    float_t radius_;
+    float_t radius_sq_;
+};
+
+// triangles of a mesh are owned by the `triangle_mesh_t`
+using shape_pool_t = pool_t<shape_t, disk_t, triangle_t, rectangle_t, sphere_t>;
+
+#pragma endregion
+
+
+
+#pragma region filter
+
+#pragma endregion
+
+#pragma region film
+
+enum class image_enum_t
+{
+    ppm,
+    bmp,
+    hdr
+};
+
+// film_option_t
+struct film_desc_t
+{
+    int width;
+    int height;
+};
+
+constexpr float_t clamp01(float_t x) { return std::clamp(x, (float_t)0, (float_t)1); }
+inline color_t clamp01(color_t c) { return color_t(clamp01(c.r), clamp01(c.g), clamp01(c.b)); }
+
+inline uint8_t gamma_encoding(float_t x) { return pow(clamp01(x), 1 / 2.2) * 255 + .5; }
+
+/*
+   pixels [x, x + width) * [y, y + height) of a film, where a thread accumulates its samples without touching
+   the shared film, then merges them by `film_t::add_tile()` once the tile is done;
+   the weight and sample count of each pixel are kept for reconstruction filters and progressive rendering
+*/
+class film_tile_t
+{
+public:
+    struct pixel_t
+    {
+        color_t L{}; // weighted sum of samples
+        float_t weight{};
+        int sample_num{};
+    };
+
+public:
+    film_tile_t() = default;
+    film_tile_t(int x, int y, int width, int height)
+    {
+        reset(x, y, width, height);
+    }
+
+    // cover another part of the film, cleared, the memory is kept
+    void reset(int x, int y, int width, int height)
+    {
+        x_ = x;
+        y_ = y;
+        width_ = width;
+        height_ = height;
+        pixels_.assign(width * height, pixel_t{});
+    }
+
+public:
+    int x() const { return x_; }
+    int y() const { return y_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // `x`, `y` of the film
+    pixel_t& pixel(int x, int y) { return pixels_[index(x, y)]; }
+    const pixel_t& pixel(int x, int y) const { return pixels_[index(x, y)]; }
+
+    void add_sample(int x, int y, color_t L, float_t weight = 1)
+    {
+        pixel_t& pixel = this->pixel(x, y);
+        pixel.L += L * weight;
+        pixel.weight += weight;
+        ++pixel.sample_num;
+    }
+
+    // weighted average of the samples
+    color_t color(int x, int y) const
+    {
+        const pixel_t& pixel = this->pixel(x, y);
+        return pixel.weight > 0 ? pixel.L / pixel.weight : color_t{};
+    }
+
+private:
+    int index(int x, int y) const
+    {
+        CHECK_DEBUG(x >= x_ && x < x_ + width_ && y >= y_ && y < y_ + height_,
+            "out of tile: {}, {}", x, y);
+        return (y - y_) * width_ + (x - x_);
+    }
+
+private:
+    int x_{};
+    int y_{};
+    int width_{};
+    int height_{};
+    std::vector<pixel_t> pixels_;
+};
+
+// warpper of `color_t pixels[]`
+class film_t : public nocopyable_t
+{
+public:
+    film_t(int width, int height) :
+        width_{ width },
+        height_{ height },
+        pixels_{ std::make_unique<color_t[]>(get_pixel_num()) }
+    {
+    }
+
+public:
+    int get_width() const { return width_; }
+    int get_height() const { return height_; }
+    int get_pixel_num() const { return width_ * height_; }
+    int get_channels() const { return 3; }
+    
+    virtual vec2_t get_resolution() const { return { (float_t)width_, (float_t)height_ }; }
+    virtual color_t& operator()(int x, int y)
+    {
+        CHECK_DEBUG(x >= 0 && x < width_ && y >= 0 && y < height_, 
+            "out of bound: {}, {}", x, y);
+        return *(pixels_.get() + get_width() * y + x);
+    }
+
+    void set_color(int x, int y, color_t color)
+    {
+        operator()(x, y) = color;
+    }
+    void clear_color(int x, int y)
+    {
+        set_color(x, y, color_t{});
+    }
+
+    void add_color(int x, int y, color_t delta)
+    {
+        color_t& color = operator()(x, y);
+        color = color + delta;
+    }
+
+    // add the pixels of `tile` clamped to [0, 1], a row of a tile is contiguous in the film,
+    // so `operator()` is only called once a row
+    void add_tile(const film_tile_t& tile)
+    {
+        for (int y = tile.y(); y < tile.y() + tile.height(); ++y)
+        {
+            color_t* row = &operator()(tile.x(), y);
+            for (int x = 0; x < tile.width(); ++x)
+                row[x] = row[x] + clamp01(tile.color(tile.x() + x, y));
+        }
+    }
+
+    void clear(color_t color)
+    {
+        for (int i = 0; i < get_pixel_num(); ++i)
+        {
+            pixels_[i] = color;
+        }
+    }
+
+public:
+
+#pragma region store
+
+    // TODO
+    //add another virtual bool store_image();
+    virtual bool store_image(std::string filename /*bool with_alpha = false*/) const
+    {
+        CHECK_DEBUG(get_channels() == 3, "Now only support RGB format");
+
+        std::string command{};
+#ifdef KY_OUTPUT_HDR
+        store_hdr_impl(filename += ".hdr", get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
+        // https://github.com/Tom94/tev
+        command = "tev " + filename;
+#else
+        store_bmp_impl(filename += ".bmp", get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
+        command = "mspaint " + filename;
+#endif
+
+#ifdef KY_WINDOWS
+        system(command.c_str());
+        /*
+        std::thread([]()
+        {
+            system("mspaint single.bmp");
+        })
+        .detach();
+        */
+#endif
+
+        return true;
+
+        /*
+        switch (image_type)
+        {
+        case image_enum_t::ppm:
+            return store_ppm_impl(filename, get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
+        case image_enum_t::bmp:
+            return store_bmp_impl(filename, get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
+        default:
+            break;
+        }
+        */
+    }
+
+    static bool store_ppm_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+    {
+        std::fstream img_file(filename, std::ios::binary | std::ios::out);
+
+        img_file << std::format("P3\n{} {}\n{}\n", width, height, 255);
+
+        int float_num = width * height * channel;
+        for (int index = 0; index < float_num; ++index)
+        {
+            img_file << std::format("{} ", gamma_encoding(floats[index]));
+        }
+
+        return true;
+    }
+   
+    static bool store_bmp_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+    {
+        // https://github.com/SmallVCM/SmallVCM/blob/master/src/framebuffer.hxx#L149-L215
+        // https://github.com/skywind3000/RenderHelp/blob/master/RenderHelp.h#L937-L1018
+
+        std::fstream img_file(filename, std::ios::binary | std::ios::out);
+
+
+        // 1.write file header & 2.write info header
+
+        uint32_t padding_line_bytes = (width * channel + 3) & (~3);
+        uint32_t padding_image_bytes = padding_line_bytes * height;
+
+        const uint32_t FILE_HEADER_SIZE = 14;
+        const uint32_t INFO_HEADER_SIZE = 40;
+
+        struct BITMAP_FILE_HEADER_INFO_HEADER
+        {
+            // file header
+            //char8_t type[2]{ 'B', 'M' };
+            uint32_t file_size{};
+            uint32_t reserved{ 0 };
+            uint32_t databody_offset{ FILE_HEADER_SIZE + INFO_HEADER_SIZE };
+
+            // info header
+            uint32_t	info_header_size{ INFO_HEADER_SIZE };
+
+            int32_t     width{};
+            int32_t		height{};
+            int16_t	    color_planes{ 1 };
+            int16_t	    per_pixel_bits{};
+            uint32_t	compression{ 0 };
+            uint32_t	image_bytes{ 0 };
+
+            uint32_t	x_pixels_per_meter{ 0 };
+            uint32_t	y_pixels_per_meter{ 0 };
+            uint32_t	color_used{ 0 };
+            uint32_t	color_important{ 0 };
+        }
+        bmp_header
+        {
+            .file_size{ FILE_HEADER_SIZE + INFO_HEADER_SIZE + padding_image_bytes },
+            .width{ width },
+            .height{ height },
+            .per_pixel_bits{ (int16_t)(channel * 8) },
+            //.image_bytes{ padding_image_bytes }
+        };
+
+        img_file
+            .write("BM", 2)
+            .write((char*)&bmp_header, sizeof(bmp_header));
+
+
+        // 3.without color table
+
+
+        // 4.write data body 
+
+        // gamma encoding
+        int byte_num = width * height * channel;
+        auto bytes = std::make_unique<uint8_t[]>(byte_num);
+        for (int i = 0; i < byte_num; i += 3)
+        {
+            // BGR
+            bytes[i]     = gamma_encoding(floats[i + 2]);
+            bytes[i + 1] = gamma_encoding(floats[i + 1]);
+            bytes[i + 2] = gamma_encoding(floats[i]);
+        }
+
+        int line_num = width * channel;
+        // bmp is stored from bottom to up
+        for (int y = height - 1; y >= 0; --y)
+            img_file.write((const char*)(bytes.get() + y * line_num), line_num);
+
+
+        return true;
+    }
+
+    static bool store_hdr_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+    {
+        // https://github.com/SmallVCM/SmallVCM/blob/master/src/framebuffer.hxx#L218-L251
+
+        std::ofstream img_file(filename, std::ios::binary | std::ios::out);
+
+        img_file << std::format(
+            "#?RADIANCE\n"
+            "FORMAT=32-bit_rle_rgbe\n\n"
+            "-Y {} +X {}\n", height, width);
+
+        color_t* pixels = (color_t*)floats;
+        int pixel_num = width * height;
+        for (int index = 0; index < pixel_num; index++)
+        {
+            uint8_t rgbe[4]{};
+
+            color_t color = pixels[index];
+            float v = std::max({ color.r, color.g, color.b });
+
+            if (v >= 1e-32f)
+            {
+                /*
+                   write:
+                        v = m * 2 ^ e ( 0 < m < 1)
+                        r = R * m * 256.0/v
+                   read:
+                        R = r * 2^(e – 128 - 8);
+                */
+
+                int e;
+                float m = float_t(frexp(v, &e) * 256.f / v);
+
+                rgbe[0] = uint8_t(color.r * m);
+                rgbe[1] = uint8_t(color.g * m);
+                rgbe[2] = uint8_t(color.b * m);
+                rgbe[3] = uint8_t(e + 128);
+            }
+
+            img_file.write((const char*)&rgbe[0], 4);
+        }
+
+        return true;
+    }
+
+#pragma endregion
+
+private:
+    int32_t width_{};
+    int32_t height_{};
+
+    std::unique_ptr<color_t[]> pixels_{};
+};
+
+/*
+   put multi sub-film together in one film, for export multi images at once
+   A_mn = 
+       a_11, a_12 ... a_1n
+       a_21, a_22 ... a_2n
+       ...     ...     ...
+       a_m1, a_m2 ... a_mn
+   where a_ij is a sub-film, m/n is specified by row/column
+*/
+class film_grid_t : public film_t
+{
+public:
+    film_grid_t(int row, int column, int sub_width, int sub_height) :
+        film_t(column * sub_width, row * sub_height),
+        row_{ row },
+        column_{ column },
+        sub_width_{ sub_width },
+        sub_height_{ sub_height }
+    {
+    }
+
+public:
+    vec2_t get_resolution() const override { return { (float_t)sub_width_, (float_t)sub_height_ }; }
+
+    color_t& operator()(int x, int y) override
+    {
+        int col_index = subfilm_index % column_;
+        int row_index = subfilm_index / column_;
+        return film_t::operator()(x + col_index * sub_width_ , y + row_index * sub_height_);
+    }
+
+    void next_subfilm()
+    {
+        ++subfilm_index;
+    }
+
+private:
+    int row_{};
+    int column_{};
+    int subfilm_index{};
+
+    int sub_width_{};
+    int sub_height_{};
+};
+
+#pragma endregion
+
+#pragma region camera
+
+/*
+  camera space:
+
+  y (0, 1, 0)         z(0, 0, 1)
+        |            /
+        |          /
+        |        /
+        |      /
+        |    /
+        |  /
+        |/_ _ _ _ _ _ x(1, 0, 0)
+        o
+
+  features:
+    generate ray
+*/
+
+class camera_t
+{
 public:
-    virtual int ge_samples_per_pixel()
-    {
-        return samples_per_pixel_;
-    }
-    virtual void set_samples_per_pixel(int samples_per_pixel)
+    virtual ~camera_t() {}
+
+    camera_t(
+        vec3_t position, vec3_t front, vec3_t up,
+        degree_t fov, vec2_t resolution):
+        position_{ position },
+        front_{ front.normalize() },
+        up_{ up.normalize()},
+        resolution_{ resolution }
     {
-        samples_per_pixel_ = samples_per_pixel;
+        // TODO
+        // https://github.com/infancy/pbrt-v3/blob/master/src/core/transform.cpp#L394-L397
+ 
+        float_t tan_fov = std::tan(radians(fov) / 2);
+
+        // left hand, clockwise
+        right_ = up_.cross(front_).normalize() * tan_fov * get_aspect();
+        up_ = front_.cross(right_).normalize() * tan_fov;
     }
 
 public:
-    virtual void start_pixel()
-    {
-        current_sample_index_ = 0;
-    }
-    virtual bool next_sample()
+    // generate primary ray from camera
+    virtual ray_t generate_ray(const camera_sample_t& sample) const
     {
-        current_sample_index_ += 1;
-        return current_sample_index_ < samples_per_pixel_;
+        vec3_t direction =
+            front_ +
+            right_ * (sample.p_film.x / resolution_.x - 0.5) +
+               up_ * (0.5 - sample.p_film.y / resolution_.y);
+
+        return ray_t{ position_, direction.normalize() };
     }
 
-public:
-    virtual float_t get_float() = 0;
-    virtual vec2_t get_float2() = 0;
-    virtual camera_sample_t get_camera_sample(point2_t p_film) = 0;
+    // sample_ray(...)
 
-protected:
-    rng_t rng_{};
+private:
+    float_t get_aspect() { return resolution_.x / resolution_.y; }
 
-    int samples_per_pixel_{};
-    int current_sample_index_{};
+private:
+    vec3_t position_;
+    unit_vec3_t front_;
+    unit_vec3_t right_;
+    unit_vec3_t up_;
+
+    vec2_t resolution_;
 };
 
-class debug_sampler_t : public sampler_t
+using const_camera_sptr_t = std::shared_ptr<const camera_t>;
+
+#pragma endregion
+
+
+
+#pragma region texture
+
+// TODO
+// class texture_t
+
+#pragma endregion
+
+#pragma region material
+
+enum class material_enum_t
+{
+    matte,
+    mirror,
+    glass,
+    plastic,
+
+    count
+};
+
+class material_t
 {
 public:
-    using sampler_t::sampler_t;
+    virtual ~material_t() = default;
 
-    std::unique_ptr<sampler_t> clone() override
+    // a textured material gives a different bsdf for each hit, hits of it are shaded apart from other materials
+    // of the same type, see `shading_queue_t`
+    material_t(material_enum_t type, bool is_textured = false) :
+        type_{ type },
+        is_textured_{ is_textured }
     {
-        return std::make_unique<debug_sampler_t>(samples_per_pixel_);
     }
 
 public:
-    float_t get_float() override
-    {
-        return 0.5f;
-    }
+    virtual bsdf_t scattering(const isect_t& isect) const = 0;
 
-    vec2_t get_float2() override
-    {
-        return { 0.5f, 0.5f };
-    }
+    // the concrete class, materials are `final` so a call through it isn't virtual
+    material_enum_t type() const { return type_; }
+    bool is_textured() const { return is_textured_; }
 
-    camera_sample_t get_camera_sample(point2_t p_film) override
-    {
-        return { p_film + vec2_t{0.5f, 0.5f} };
-    }
+private:
+    material_enum_t type_;
+    bool is_textured_;
 };
 
-class random_sampler_t : public sampler_t
+class matte_material_t final : public material_t
 {
 public:
-    using sampler_t::sampler_t;
-
-    std::unique_ptr<sampler_t> clone() override
+    matte_material_t(color_t diffuse_color) :
+        material_t(material_enum_t::matte),
+        diffuse_color_{ diffuse_color }
     {
-        return std::make_unique<random_sampler_t>(samples_per_pixel_);
     }
 
-public:
-    float_t get_float() override
+    bsdf_t scattering(const isect_t& isect) const override
     {
-        return rng_.uniform_float();
+        return bsdf_t(frame_t(isect.normal), lambertion_reflection_t(diffuse_color_));
     }
 
-    vec2_t get_float2() override
+private:
+    color_t diffuse_color_{}; // or named `Kd`, `C_diff`
+};
+
+class mirror_material_t final : public material_t
+{
+public:
+    mirror_material_t(color_t specular_color) :
+        material_t(material_enum_t::mirror),
+        specular_color_{ specular_color }
     {
-        return rng_.uniform_float2();
     }
 
-    // TODO: coroutine
-    camera_sample_t get_camera_sample(point2_t p_film) override
+    bsdf_t scattering(const isect_t& isect) const override
     {
-        return { p_film + rng_.uniform_float2() };
+        return bsdf_t(frame_t(isect.normal), perfect_specular_reflection_t(specular_color_));
     }
+
+private:
+    color_t specular_color_{}; // or named `Ks`, `C_spec`
 };
 
-// TODO
-class stratified_sampler_t : public sampler_t
+class glass_material_t final : public material_t
 {
 public:
-    camera_sample_t get_camera_sample(point2_t p_film) override
+    glass_material_t(
+    float_t eta, color_t reflection_color = color_t{ 1, 1, 1 }, color_t transmission_color = color_t{ 1, 1, 1 }) :
+        material_t(material_enum_t::glass),
+        eta_{ eta },
+        reflection_color_{ reflection_color },
+        transmission_color_{ transmission_color }
     {
-        return { p_film + rng_.uniform_float2() };
     }
-};
 
-#pragma endregion
-
-
-
-#pragma region shape
-
-/*
-     z(0, 0, 1)
-          |
-          | theta/
-          |    /
-          |  /
-          |/_ _ _ _ _ _ x(1, 0, 0)
-         / \
-        / phi\
-       /       \
-      /          \
- y(0, 1, 0)
+    bsdf_t scattering(const isect_t& isect) const override
+    {
+        return bsdf_t(frame_t(isect.normal), fresnel_specular_t(1, eta_, reflection_color_, transmission_color_));
+    }
 
-   https://www.pbr-book.org/3ed-2018/Shapes/Spheres
-*/
+private:
+    float_t eta_{};
+    color_t reflection_color_{}; // or named `Kr`
+    color_t transmission_color_{}; // or named `Kt`
+};
 
-class shape_t
+class plastic_material_t final : public material_t
 {
 public:
-    virtual ~shape_t() = default;
-
-    virtual bool intersect(const ray_t& ray, isect_t* out_isect) const = 0;
+    plastic_material_t(color_t diffuse_color, color_t specular_color, float_t shininess) :
+        material_t(material_enum_t::plastic),
+        diffuse_color_{ diffuse_color },
+        specular_color_{ specular_color },
+        exponent_{ shininess } // TODO
+    {
+        //CHECK_DEBUG((Kd_ + Ks_).small_than({ 1, 1, 1 }));
 
-    virtual bounds3_t world_bound() const = 0;
-    virtual float_t area() const = 0;
+        // lobes are sampled in proportion to their brightness
+        float_t diffuse = diffuse_color.luminance();
+        float_t specular = specular_color.luminance();
+        float_t luminance = diffuse + specular;
+        
+        specular_probility_ = specular / luminance;
+    }
 
-public:
-    // these methods below only used for `area_light_t`
+    bsdf_t scattering(const isect_t& isect) const override
+    {
+        return bsdf_t(frame_t(isect.normal), plastic_reflection_t(diffuse_color_, specular_color_, exponent_, specular_probility_));
+    }
 
-    // TODO: return position_sample_t
-    virtual light_isect_t sample_position(float2_t random, float_t* out_pdf_position) const = 0;
+private:
+    color_t diffuse_color_{};
+    color_t specular_color_{};
+    float_t exponent_{};
 
+    float_t specular_probility_{};
+};
 
-    // TODO: return direction_sample_t
-    // default compute `*_direction` by `*_position` 
-    virtual light_isect_t sample_direction(const isect_t& isect, float2_t random, float_t* out_pdf_direction) const
-    {
-        isect_t light_isect = sample_position(random, out_pdf_direction);
-        vec3_t wi = light_isect.position - isect.position;
+// in the order of `material_enum_t`, so the type of a handle is its material type, see `shading_queue_t`
+using material_pool_t = pool_t<material_t, matte_material_t, mirror_material_t, glass_material_t, plastic_material_t>;
+static_assert(material_pool_t::k_type_num == (int)material_enum_t::count);
 
-        if (wi.magnitude_squared() == 0)
-        {
-            *out_pdf_direction = 0;
-        }
-        else
-        {
-            wi = normalize(wi);
-            // look comments in `pdf_direction()` below
-            *out_pdf_direction *= distance_squared(light_isect.position, isect.position) / abs_dot(light_isect.normal, -wi);
+// TODO: Normalizing Bling-Phong BRDF
 
-            if (std::isinf(*out_pdf_direction))
-                *out_pdf_direction = 0.f;
-        }
+#pragma endregion
 
-        return light_isect;
-    }
-    virtual float_t pdf_direction(const isect_t& isect, unit_vec3_t world_wi) const
-    {
-        ray_t ray = isect.spawn_ray(world_wi);
-        isect_t light_isect;
 
-        if (!intersect(ray, &light_isect))
-            return 0;
 
-        /*
-          convert light sample point to solid angle:
+#pragma region light
 
-              $$\mathrm{d} \omega = \fact{\mathrm{d} A^{\perp} }{l^{2}} $$
+enum class light_flag_t
+{
+    delta_position = 1,
+    delta_direction = 2,
 
-          because:
-              unit_solid_angle = 1 / distance_squared(...)
-              projected_light_area = abs_dot(...) * area()
-              projected_solid_angle = projected_light_area / distance_squared
+    area = 4,
+    infinite = 8
+};
+KY_ENUM_OPERATORS(light_flag_t)
 
-              pdf = distance_squared(...) / (abs_dot(...) * area()) = inverse_projected_solid_angle
-              1 / pdf 
-                      = (abs_dot(...) * area()) / distance_squared(...) = projected_solid_angle
-                      = (1 / distance_squared(...)) * (abs_dot(...) * area()) = unit_solid_angle * projected_light_area
+inline bool is_delta_light(light_flag_t flags)
+{
+    return enum_have(flags, light_flag_t::delta_position) ||
+           enum_have(flags, light_flag_t::delta_direction);
+}
 
-          so:
-              (f * Li * cos_theta) / pdf = f * (Li * cos_theta * projected_solid_angle)
 
-          or:
-              (f * Li * cos_theta) / pdf = f * (Li * cos_theta * unit_solid_angle * projected_light_area)
-        */
-        float_t pdf = distance_squared(isect.position, light_isect.position) / (abs_dot(light_isect.normal, -world_wi) * area());
-        if (std::isinf(pdf))
-            pdf = 0.f;
+/*
+// called `LightLeSample` in pbrt-v4, `PositionSample` in mitsuba3
+// mainly used for light.sample_Le()
+struct position_sample_t
+{
+    bool is_delta;
+    point3_t position; // maybe zero
+    normal_t normal; // maybe zero
+    ray_t ray;
+    float_t pdf_position = 0;
+    float_t pdf_direction = 0;
+    color_t Le; // for light
 
-        return pdf;
+    position_sample_t() = default;
+    position_sample_t(
+    point3_t position, normal_t normal, const ray_t& ray,
+    float_t pdf_position, float_t pdf_direction,
+    color_t emission) :
+        position{ position },
+        normal{ normal },
+        ray(ray),
+        pdf_position(pdf_position),
+        pdf_direction(pdf_direction),
+        Le(emission)
+    {
     }
 
-public:
-    static constexpr float_t epsilon = 1e-3;// TODO
+    float_t abs_cos_theta(vec3_t w) const { return is_delta ? 1 : abs_dot(w, normal); }
 };
+*/
 
-using shape_sptr_t = std::shared_ptr<shape_t>; 
-using shape_list_t = std::vector<shape_sptr_t>;
+/*
+   called `LightLiSample` in pbrt-v4, `DirectionSample` in mitsuba3
+   mainly used for light.sample_Li()
+*/
+struct light_sample_t // : public position_sample_t
+{
+    point3_t position{};
+    vec3_t wi{}; // isect -> light, alone ray's direction
+    float_t pdf{}; // pdf of direction(convert from pdf of position)
+    color_t Li{}; // for light
 
+    light_sample_t() = default;
+    light_sample_t(const isect_t& isect, vec3_t wi, float_t pdf, color_t Li) :
+        position{ isect.position },
+        wi{ wi },
+        pdf{ pdf },
+        Li{ Li }
+    {
+    }
+};
 
+class scene_t;
 
-class disk_t : public shape_t
+class light_t
 {
 public:
-    disk_t(point3_t position, normal_t normal, float_t radius):
-        position_{ position },
-        normal_{ normalize(normal) },
-        radius_{ radius }
-
+    virtual ~light_t() = default;
+    light_t(/*light_flag_t flags,*/ point3_t world_position, int samples_num = 1):
+        world_position_{ world_position },
+        samples_num_{ samples_num }
     {
     }
 
-    bool intersect(const ray_t& ray, isect_t* out_isect) const override
-    {
-        if (is_equal(dot(ray.direction(), normal_), (float_t)0))
-            return false;
- 
-        const vec3_t op = position_ - ray.origin();
-        const float_t distance = dot(normal_, op) / dot(normal_, ray.direction());
-
-        if ((distance > epsilon) && (distance < ray.distance()))
-        {
-            point3_t hit_point = ray(distance);
-            if (::distance(position_, hit_point) <= radius_)
-            {
-                ray.set_distance(distance);
-                *out_isect = isect_t(hit_point, normal_, -ray.direction());
-
-                return true;
-            }
-        }
+public:
+    // whether the light is delta distribution(point, directional), or not(area, environment)
+    virtual bool is_delta() const = 0;
+    // whether the light is finite extent (point, area) or not(directional, environment)
+    virtual bool is_finite() const = 0;
 
-        return false;
-    }
+    // only called from `scene_t`
+    virtual void preprocess(const scene_t& scene);
 
-    bounds3_t world_bound() const override
-    {
-        frame_t frame{ normal_ };
-        vec3_t offset = frame.binormal() * radius_ + frame.tangent() * radius_;
-        return bounds3_t(position_ - offset, position_ + offset);
-    }
+    virtual color_t power() const = 0;
 
-    float_t area() const override { return k_pi * radius_ * radius_; }
+    // only work for environment light
+    virtual color_t Le(const ray_t& r) const { return color_t{}; }
 
 public:
-    light_isect_t sample_position(float2_t random, float_t* pdf) const override
-    {
-        isect_t light_isect;
-
-        frame_t frame{ normal_ };
-        point2_t sample_point = concentric_disk_sample(random);
-        light_isect.position = position_ + radius_ * (frame.binormal() * sample_point.x + frame.tangent() * sample_point.y);
+    // Li means : camera <-wo- isect -wi-> light
 
-        light_isect.normal = normalize(normal_);
+    // sample_light/samle_direction
+    virtual light_sample_t sample_Li(const isect_t& isect, float2_t random) const = 0;
 
-        *pdf = 1 / area();
-        return light_isect;
-    }
+    virtual float_t pdf_Li(const isect_t& isect, vec3_t world_wi) const = 0;
 
-public:
-    point3_t position_;
-    normal_t normal_;
-    float_t radius_;
+protected:
+    point3_t world_position_;
+    int samples_num_;
 };
 
-class triangle_t : public shape_t
+using light_list_t = std::vector<light_t*>;
+
+class point_light_t : public light_t
 {
 public:
-    triangle_t(point3_t p0, point3_t p1, point3_t p2, bool flip_normal = false)
+    point_light_t(point3_t world_position, int samples_num, color_t intensity) :
+        light_t(world_position, samples_num),
+        intensity_{ intensity }
     {
-        p0_ = p0;
-        p1_ = p1;
-        p2_ = p2;
-
-        normal_ = normalize(cross(p1_ - p0_, p2_ - p0_));
-        if (flip_normal)
-            normal_ = -normal_;
     }
 
-    bool intersect(const ray_t& ray, isect_t* out_isect) const override
+    bool is_delta() const override { return true; }
+    bool is_finite() const override { return true; }
+
+    color_t power() const override { return 4 * k_pi * intensity_; }
+
+public:
+    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
     {
-        // https://github.com/SmallVCM/SmallVCM/blob/master/src/geometry.hxx#L125-L156
+        light_sample_t sample;
+        sample.position = world_position_;
+        sample.wi = normalize(world_position_ - isect.position);
+        sample.pdf = 1.f;
+        /*
+          if a sphere hold the point light, then:
+              $$ \Phi= A E = \frac{A I} {l^{2}} $$, where $$ A = 4 \pi r^{2} $$
 
-        const vec3_t oa = p0_ - ray.origin();
-        const vec3_t ob = p1_ - ray.origin();
-        const vec3_t oc = p2_ - ray.origin();
+          or from the definition:
+              $$ \mathrm{d} \Phi= \mathrm{d} A E = \frac{\mathrm{d} A I} {l^{2}} $$
 
-        const vec3_t v0 = cross(oc, ob);
-        const vec3_t v1 = cross(ob, oa);
-        const vec3_t v2 = cross(oa, oc);
+          finally we have:
+             $$ E = \frac{I}{l^{2}}$$
 
-        const float_t v0d = dot(v0, ray.direction());
-        const float_t v1d = dot(v1, ray.direction());
-        const float_t v2d = dot(v2, ray.direction());
 
-        if (((v0d <  0.f) && (v1d <  0.f) && (v2d <  0.f)) ||
-            ((v0d >= 0.f) && (v1d >= 0.f) && (v2d >= 0.f)))
-        {
-            // 1. first calculate the vertical distance from ray.origin to the plane,
-            //    by `dot(normal, op)` (or `bo`, `co`)
-            // 2. then calculate the distance from ray.origin to the plane alone ray.direction, 
-            //    by `distance * dot(normal, ray.direction()) = vertical_distance`
-            const float_t distance = dot(normal_, oa) / dot(normal_, ray.direction());
+          as for `Lo = f * Li * cos_theta / pdf`,
 
-            if ((distance > epsilon) && (distance < ray.distance()))
-            {
-                ray.set_distance(distance);
-                point3_t hit_point = ray(distance);
-                *out_isect = isect_t(hit_point, normal_, -ray.direction());
+          for area light:
+              Lo = f * Li * cos_theta / pdf = f * (Li * cos_theta * projected_solid_angle), see `shape::pdf_direction(...)`
 
-                return true;
-            }
-        }
+          for point light:
+              Lo = f * Li * cos_theta / pdf = f * (E * cos_theta / 1), it's no problem
+        */
+        sample.Li = intensity_ / distance_squared(world_position_, isect.position);
 
-        return false;
+        return sample;
     }
 
-    bounds3_t world_bound() const override
+    float_t pdf_Li(
+        const isect_t& isect, vec3_t world_wi) const override
     {
-        return bounds3_t(p0_, p1_).join(p2_);
+        return 0;
     }
 
-    float_t area() const override { return 0.5 * cross(p1_ - p0_, p2_ - p0_).magnitude(); }
+private:
+    color_t intensity_{};
+};
 
+// use a disk to simulate
+class direction_light_t : public light_t
+{
 public:
-    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    direction_light_t(point3_t world_position, int samples_num, color_t irradiance, const vec3_t world_direction) :
+        light_t(world_position, samples_num),
+        irradiance_{ irradiance },
+        world_direction_{ normalize(world_direction) },
+        frame_{ world_direction }
     {
-        point2_t b = uniform_triangle_sample(random);
-
-        isect_t light_isect;
-        light_isect.position = b.x * p0_ + b.y * p1_ + (1 - b.x - b.y) * p2_;
-        light_isect.normal = normal_;
-
-        *pdf = 1 / area();
-        return light_isect;
     }
 
 public:
-    point3_t p0_;
-    point3_t p1_;
-    point3_t p2_;
-    normal_t normal_;
-};
+    bool is_delta() const override { return true; }
+    bool is_finite() const override { return false; }
 
-class rectangle_t : public shape_t
-{
-public:
-    rectangle_t(point3_t p0, point3_t p1, point3_t p2, point3_t p3, bool flip_normal = false)
-    {
-        p0_ = p0;
-        p1_ = p1;
-        p2_ = p2;
-        p3_ = p3;
-        // TODO: CHECK_DEBUG
+    void preprocess(const scene_t& scene) override;
 
-        normal_ = normalize(cross(p1_ - p0_, p2_ - p0_));
-        if (flip_normal)
-            normal_ = -normal_;
+    color_t power() const override
+    {
+        return power_;
     }
 
-    bool intersect(const ray_t& ray, isect_t* out_isect) const override
+public:
+    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
     {
-        // https://github.com/SmallVCM/SmallVCM/blob/master/src/geometry.hxx#L125-L156
-
-        const vec3_t oa = p0_ - ray.origin();
-        const vec3_t ob = p1_ - ray.origin();
-        const vec3_t oc = p2_ - ray.origin();
-        const vec3_t od = p3_ - ray.origin();
-
-        const vec3_t v0 = cross(oc, ob);
-        const vec3_t v1 = cross(ob, oa);
-        const vec3_t v2 = cross(oa, od);
-        const vec3_t v3 = cross(od, oc);
-
-        const float_t v0d = dot(v0, ray.direction());
-        const float_t v1d = dot(v1, ray.direction());
-        const float_t v2d = dot(v2, ray.direction());
-        const float_t v3d = dot(v3, ray.direction());
-
-        if (((v0d <  0.f) && (v1d <  0.f) && (v2d <  0.f) && (v3d <  0.f)) ||
-            ((v0d >= 0.f) && (v1d >= 0.f) && (v2d >= 0.f) && (v3d >= 0.f)))
-        {
-            const float_t distance = dot(normal_, oa) / dot(normal_, ray.direction());
-
-            if ((distance > epsilon) && (distance < ray.distance()))
-            {
-                ray.set_distance(distance);
-                point3_t hit_point = ray(distance);
-                normal_t normal = dot(normal_, ray.direction()) <= 0 ? normal_ : -normal_;
-                *out_isect = isect_t(hit_point, normal, -ray.direction());
-
-                return true;
-            }
-        }
+        light_sample_t sample;
+        sample.wi = -world_direction_;
+        sample.position = isect.position + sample.wi * 2 * world_radius_;
+        sample.pdf = 1;
+        // both delta light, same as point_light_t::sample_Li(...)
+        sample.Li = irradiance_;
 
-        return false;
+        return sample;
     }
 
-    bounds3_t world_bound() const override
+    float_t pdf_Li(
+        const isect_t& isect, vec3_t world_wi) const override
     {
-        return bounds3_t(p0_, p1_).join(p2_).join(p3_);
+        return 0;
     }
 
-    float_t area() const override { return cross(p0_ - p1_, p2_ - p1_).magnitude(); }
-
-public:
-    light_isect_t sample_position(float2_t random, float_t* pdf) const override
-    {
-        isect_t light_isect;
-        light_isect.position = p1_ + (p0_ - p1_) * random[0] + (p2_ - p1_) * random[1];
-        light_isect.normal = normalize(normal_);
+private:
+    color_t irradiance_{};
 
-        *pdf = 1 / area();
-        return light_isect;
-    }
+    point3_t world_center_{};
+    float_t world_radius_{};
+    float_t area_{};
+    color_t power_{};
 
-public:
-    point3_t p0_;
-    point3_t p1_;
-    point3_t p2_;
-    point3_t p3_;
-    normal_t normal_;
+    unit_vec3_t world_direction_{};
+    frame_t frame_{};
 };
 
-class sphere_t : public shape_t
+class area_light_t : public light_t
 {
 public:
-    sphere_t(vec3_t center, float_t radius) :
-        center_(center),
-        radius_(radius),
-        radius_sq_(radius * radius)
+    area_light_t(point3_t world_position, int samples_num, color_t radiance, const shape_t* shape):
+        light_t(world_position, samples_num),
+        radiance_{ radiance },
+        shape_{ shape },
+        power_{ radiance_ * shape->area() * k_pi }
     {
     }
 
-    bool intersect(const ray_t& ray, isect_t* out_isect) const override
-    { 
-        /*
-          ray: p(t) = o + t*d,
-          sphere: ||p - c||^2 = r^2
-
-          if ray and sphere have a intersection p, then:
-             ||p(t) - c||^2 = r^2
-          => ||o + t*d - c||^2 = r^2
-          => (t*d + o - c).(t*d + o - c) = r^2
-          => d.d*t^2 + 2d.(o-c)*t + (o-c).(o-c)-r^2 = 0
-
-          compare with:
-             at^2 + bt + c = 0
-
-          there have:
-             co = o - c
-             a = dot(d, d) = 1;
-             b = 2 * dot(d, co), neg_b' = dot(d, oc);
-             c = dot(co, co) - r^2;
+public:
+    bool is_delta() const override { return false; }
+    bool is_finite() const override { return true; }
 
-          so:
-             t = (-b +/- sqrt(b^2 - 4ac)) / 2a
-               = (-b +/- sqrt(b^2 - 4c)) / 2
-               = ((-2 * dot(d, co) +/- sqrt(4 * dot(d, co)^2 - 4 * (dot(co, co) - r^2))) / 2
-               = -dot(d, co) +/- sqrt( dot(d, co)^2 - dot(co, co) + r^2 )
-               = neg_b' +/- sqrt(discr)
-        */
+    color_t power() const override
+    {
+        return power_;
+    }
 
-        vec3_t oc = center_ - ray.origin();
-        float_t neg_b = dot(oc, ray.direction());
-        float_t discr = neg_b * neg_b - dot(oc, oc) + radius_sq_;
+public:
+    /*
+       isect
+       ----
+         ^    ^
+          \   |
+        wo \  | normal
+            \ |
+             \|
+           -------
+         light_isect
+    */
+    // TODO
+    color_t Le(const isect_t& light_isect, vec3_t wo) const
+    {
+        return (dot(light_isect.normal, wo) > 0) ? radiance_ : color_t();
+    }
 
-        float_t distance = 0;
-        bool hit = false;
-        if (discr >= 0)
-         {
-            float_t sqrt_discr = sqrt(discr);
+public:
+    // sample direction by sample potision on shape
+    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
+    {
+        light_sample_t sample;
+        isect_t light_isect = shape_->sample_direction(isect, random, &sample.pdf);
+        sample.position = light_isect.position;
 
-            if (distance = neg_b - sqrt_discr; distance > epsilon && distance < ray.distance())
-            {
-                hit = true;
-            }
-            else if (distance = neg_b + sqrt_discr; distance > epsilon && distance < ray.distance())
-            {
-                hit = true;
-            }
+        if (sample.pdf == 0 || (light_isect.position - isect.position).magnitude_squared() == 0)
+        {
+            sample.Li = color_t{};
         }
-
-        if (hit)
+        else
         {
-            ray.set_distance(distance);
-            point3_t hit_point = ray(distance);
-            *out_isect = isect_t(hit_point, (hit_point - center_).normalize(), -ray.direction());
+            sample.wi = normalize(light_isect.position - isect.position);
+            sample.Li = Le(light_isect, -sample.wi);
         }
 
-        return hit;
+        return sample;
     }
 
-    bounds3_t world_bound() const override
+    float_t pdf_Li(
+        const isect_t& isect, vec3_t world_wi) const override
     {
-        vec3_t half(radius_, radius_, radius_);
-        return bounds3_t(center_ + half, center_ - half);
+        return shape_->pdf_direction(isect, world_wi);
     }
 
-    float_t area() const override { return 4 * k_pi * radius_sq_; }
+private:
+    color_t radiance_{};
+    color_t power_{};
+    const shape_t* shape_{};
+};
 
+// constant_environment_light_t
+// use a sphere hold all the scene to simulate
+class environment_light_t : public light_t
+{
 public:
-    light_isect_t sample_position(float2_t random, float_t* pdf) const override
+    environment_light_t(point3_t world_position, int samples_num, color_t radiance) :
+        light_t(world_position, samples_num),
+        radiance_{ radiance }
     {
-        unit_vec3_t direction = uniform_sphere_sample(random);
-        point3_t position = center_ + radius_ * direction;
+    }
 
-        isect_t light_isect;
-        light_isect.position = position;
-        light_isect.normal = normalize(direction);
+public:
+    bool is_delta() const override { return false; }
+    bool is_finite() const override { return false; }
 
-        *pdf = 1 / area();
+    void preprocess(const scene_t& scene) override;
 
-        return light_isect;
+    color_t power() const override
+    {
+        return power_;
     }
 
-    // TODO: confirm
-    light_isect_t sample_direction(const isect_t& isect, float2_t random, float_t* pdf) const override
+public:
+    color_t Le(const ray_t& ray) const
     {
-        if (distance_squared(isect.position, center_) <= radius_ * radius_)
-        {
-            isect_t light_isect = sample_position(random, pdf);
-            vec3_t wi = light_isect.position - isect.position;
+        return radiance_;
+    }
 
-            if (wi.magnitude_squared() == 0)
-                *pdf = 0;
-            else
-            {
-                // convert from area measure returned by Sample() call above to solid angle measure.
-                wi = normalize(wi);
-                *pdf *= distance_squared(light_isect.position, isect.position) / abs_dot(isect.normal, -wi);
-            }
+public:
+    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
+    {
+        light_sample_t sample;
+        sample.wi = uniform_sphere_sample(random);
+        sample.position = isect.position + sample.wi * 2 * world_radius_;
 
-            if (std::isinf(*pdf))
-                *pdf = 0.f;
+        float_t theta = spherical_theta(sample.wi);
+        float_t sin_theta = std::sin(theta);
+        sample.pdf = 1 / (2 * k_pi * k_pi * sin_theta);
+        if (sin_theta == 0)
+            sample.pdf = 0;
 
-            return light_isect;
-        }
+        sample.Li = radiance_;
 
-        // sample sphere uniformly inside subtended cone
+        return sample;
+    }
 
-        /*
-                /         _
-               /        / O \
-              /         O O O (a sphere)
-             /       .  \ O /
-            /    .
-           / .     theta
-          . _ _ _ _ _ _ _ _
+    float_t pdf_Li(
+        const isect_t& isect, vec3_t world_wi) const override
+    {
+        float_t theta = spherical_theta(world_wi);
+        float_t sin_theta = std::sin(theta);
 
-        */
+        if (sin_theta == 0)
+            return 0;
 
-        float_t dist = distance(isect.position, center_);
-        float_t inv_dist = 1 / dist;
+        return 1 / (2 * k_pi * k_pi * sin_theta);
+    }
 
-        // compute $\theta$ and $\phi$ values for sample in cone
-        float_t sin_theta_max = radius_ * inv_dist;
-        float_t sin_theta_max_sq = sin_theta_max * sin_theta_max;
-        float_t inv_sin_theta_max = 1 / sin_theta_max;
-        float_t cos_theta_max = std::sqrt(std::max((float_t)0.f, 1 - sin_theta_max_sq));
+private:
+    color_t radiance_{};
 
-        float_t cos_theta = (cos_theta_max - 1) * random[0] + 1;
-        float_t sin_theta_sq = 1 - cos_theta * cos_theta;
+    point3_t world_center_{};
+    float_t world_radius_{};
+    float_t area_{};
+    color_t power_{};
+};
 
-        if (sin_theta_max_sq < 0.00068523f /* sin^2(1.5 deg) */)
-        {
-            /* fall back to a Taylor series expansion for small angles, where
-               the standard approach suffers from severe cancellation errors */
-            sin_theta_sq = sin_theta_max_sq * random[0];
-            cos_theta = std::sqrt(1 - sin_theta_sq);
-        }
+using light_pool_t = pool_t<light_t, point_light_t, direction_light_t, area_light_t, environment_light_t>;
 
-        // compute angle $\alpha$ from center of sphere to sampled point on surface
-        float_t cos_alpha = sin_theta_sq * inv_sin_theta_max +
-            cos_theta * std::sqrt(std::max((float_t)0.f, 1.f - sin_theta_sq * inv_sin_theta_max * inv_sin_theta_max));
-        float_t sin_alpha = std::sqrt(std::max((float_t)0.f, 1.f - cos_alpha * cos_alpha));
-        float_t phi = random[1] * 2 * k_pi;
+#pragma endregion
 
-        // compute coordinate system for sphere sampling
-        vec3_t normal = (center_ - isect.position) * inv_dist;
-        frame_t frame{ normal };
 
-        // compute surface normal and sampled point on sphere
-        vec3_t world_normal =
-            spherical_to_direction(sin_alpha, cos_alpha, phi, -frame.binormal(), -frame.tangent(), -frame.normal());
-        point3_t world_position = center_ + radius_ * point3_t(world_normal.x, world_normal.y, world_normal.z);
 
-        isect_t light_isect;
-        light_isect.position = world_position;
-        light_isect.normal = world_normal;
+#pragma region surface(primitive)
 
-        // uniform cone PDF.
-        *pdf = 1 / (2 * k_pi * (1 - cos_theta_max));
+// 16 bytes, the material and area light are looked up in the `scene_pool_t` of the scene only when shading
+struct surface_t
+{
+    const shape_t* shape{};
+    handle_t material{ k_null_handle }; // in `scene_pool_t::materials`
+    handle_t area_light{ k_null_handle }; // in `scene_pool_t::lights`, null if the surface doesn't emit
 
-        return light_isect;
+    // the closer hit may be overwritten later, see `get_isect()`
+    bool intersect(const ray_t& ray, hit_t* hit) const
+    {
+        bool is_hit = shape->intersect(ray, hit);
+        if (is_hit)
+        {
+            hit->surface = this;
+            hit->instance = nullptr;
+        }
+
+        return is_hit;
     }
 
-    float_t pdf_direction(const isect_t& isect, vec3_t world_wi) const override
+    // geometry of the closest hit, bsdf and emission are built by `isect_t::scattering()`
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const
     {
-        // return uniform PDF if point is inside sphere
-        if (distance_squared(isect.position, center_) <= radius_ * radius_)
-            return shape_t::pdf_direction(isect, world_wi);
+        isect_t isect = shape->get_isect(ray, hit);
+        isect.surface_ = this;
+        return isect;
+    }
 
-        // compute general sphere PDF
-        float_t sin_theta_max_sq = radius_ * radius_ / distance_squared(isect.position, center_);
-        float_t cos_theta_max = std::sqrt(std::max((float_t)0, 1 - sin_theta_max_sq));
-        return uniform_cone_pdf(cos_theta_max);
+    bool intersect_p(const ray_t& ray) const
+    {
+        return shape->intersect_p(ray);
     }
 
-private:
-    vec3_t center_;
-    float_t radius_;
-    float_t radius_sq_;
+    bounds3_t world_bound() const { return shape->world_bound(); }
+    bounds3_t clip_bound(const bounds3_t& clip) const { return shape->clip_bound(clip); }
 };
 
-#pragma endregion
+using surface_list_t = std::vector<surface_t>;
+
+/*
+   owns everything a scene is made of, surfaces and instances refer into it,
+   so a scene is moved as a whole without fixing up any pointer
+*/
+struct scene_pool_t
+{
+    shape_pool_t shapes;
+    triangle_mesh_list_t meshes;
+    material_pool_t materials;
+    light_pool_t lights;
+
+    const material_t* material(const surface_t& surface) const { return materials.get(surface.material); }
+    const area_light_t* area_light(const surface_t& surface) const
+    {
+        return surface.area_light == k_null_handle ? nullptr : &lights.get<area_light_t>(surface.area_light);
+    }
+};
+
+void isect_t::scattering(const scene_pool_t& pool)
+{
+    CHECK_DEBUG(surface_ != nullptr);
 
+    bsdf_ = pool.material(*surface_)->scattering(*this);
 
+    const area_light_t* area_light = pool.area_light(*surface_);
+    emission_ = area_light ? area_light->Le(*this, wo) : color_t{};
+}
 
-#pragma region filter
+template <typename material_type_t>
+void isect_t::scattering(const scene_pool_t& pool)
+{
+    CHECK_DEBUG(surface_ != nullptr);
+
+    bsdf_ = pool.materials.get<material_type_t>(surface_->material).scattering(*this);
+
+    const area_light_t* area_light = pool.area_light(*surface_);
+    emission_ = area_light ? area_light->Le(*this, wo) : color_t{};
+}
 
 #pragma endregion
 
-#pragma region film
+#pragma region accelerator
 
-enum class image_enum_t
+enum class accel_enum_t
 {
-    ppm,
-    bmp,
-    hdr
+    trivial,
+    bvh,
+    sbvh, // BVH with spatial splits, for overlapping long and thin primitives
+    bvh4, // 4-wide BVH, SSE
+    bvh8, // 8-wide BVH, AVX
+    bvh4_quantized, // 4-wide BVH with 8-bit child bounds, about half the node memory of `bvh4`
+    bvh8_quantized, // 8-wide BVH with 8-bit child bounds, about 1/3 the node memory of `bvh8`
+    grid, // uniform grid, for many similar-sized primitives spread evenly
+    kd_tree, // SAH kd-tree, for primitives of widely varying sizes
+    automatic, // one of the above by `select_accel()`
 };
 
-// film_option_t
-struct film_desc_t
+// traversal steps of current thread, only counted with `KY_ACCEL_STATS`
+struct traversal_counter_t
 {
-    int width;
-    int height;
+    int64_t node_visits{};
+    int64_t primitive_tests{};
 };
 
-constexpr float_t clamp01(float_t x) { return std::clamp(x, (float_t)0, (float_t)1); }
-inline color_t clamp01(color_t c) { return color_t(clamp01(c.r), clamp01(c.g), clamp01(c.b)); }
+inline thread_local traversal_counter_t traversal_counter{};
 
-inline uint8_t gamma_encoding(float_t x) { return pow(clamp01(x), 1 / 2.2) * 255 + .5; }
+#ifdef KY_ACCEL_STATS
+    #define KY_COUNT_TRAVERSAL(member) (++traversal_counter.member)
+    #define KY_COUNT_TRAVERSAL_N(member, n) (traversal_counter.member += (n))
+#else
+    #define KY_COUNT_TRAVERSAL(member)
+    #define KY_COUNT_TRAVERSAL_N(member, n)
+#endif
 
-// warpper of `color_t pixels[]`
-class film_t : public nocopyable_t
+struct accel_stats_t
 {
-public:
-    film_t(int width, int height) :
-        width_{ width },
-        height_{ height },
-        pixels_{ std::make_unique<color_t[]>(get_pixel_num()) }
+    int primitive_num{};
+    int reference_num{}; // primitives referenced by leaves, more than `primitive_num` if spatial splits duplicated some
+    int node_num{};
+    size_t node_bytes{}; // memory of all nodes
+    float_t build_seconds{};
+    float_t sah_cost{}; // `accel_t::sah_cost()` right after the last build
+
+    std::string to_string() const
     {
+        std::string result = std::format("{} primitives, {} nodes, {:.1f} node bytes per primitive, {:.3f} seconds to build, SAH cost {:.2f}",
+            primitive_num, node_num, (double)node_bytes / std::max(primitive_num, 1), build_seconds, sah_cost);
+        if (reference_num > primitive_num)
+            result += std::format(", {:.1f}% references duplicated", 100. * (reference_num - primitive_num) / primitive_num);
+
+        return result;
     }
+};
 
+class accel_t
+{
 public:
-    int get_width() const { return width_; }
-    int get_height() const { return height_; }
-    int get_pixel_num() const { return width_ * height_; }
-    int get_channels() const { return 3; }
-    
-    virtual vec2_t get_resolution() const { return { (float_t)width_, (float_t)height_ }; }
-    virtual color_t& operator()(int x, int y)
+    virtual ~accel_t() = default;
+
+    // find the closest intersection alone ray
+    virtual bool intersect(const ray_t& ray, hit_t* hit) const = 0;
+    // whether there is any intersection alone ray, return on the first one found
+    virtual bool intersect_p(const ray_t& ray) const = 0;
+
+    // closest hits of up to `k_max_packet_size` coherent rays, like camera rays of neighbouring pixels,
+    // `is_hits[i]` tells whether `hits[i]` is found, traced one by one unless overridden
+    virtual void intersect_packet(const ray_t* rays, int ray_num, hit_t* hits, bool* is_hits) const
     {
-        CHECK_DEBUG(x >= 0 && x < width_ && y >= 0 && y < height_, 
-            "out of bound: {}, {}", x, y);
-        return *(pixels_.get() + get_width() * y + x);
+        for (int i = 0; i < ray_num; ++i)
+            is_hits[i] = intersect(rays[i], &hits[i]);
     }
 
-    void set_color(int x, int y, color_t color)
+    // `intersect_p()` of up to `k_max_packet_size` rays, like the shadow rays of a shading point,
+    // which may head anywhere, traced one by one unless overridden
+    virtual void intersect_p_packet(const ray_t* rays, int ray_num, bool* is_hits) const
     {
-        operator()(x, y) = color;
+        for (int i = 0; i < ray_num; ++i)
+            is_hits[i] = intersect_p(rays[i]);
     }
-    void clear_color(int x, int y)
+
+    virtual bounds3_t world_bound() const = 0;
+
+    // update bounds bottom-up after primitives moved, the tree itself is kept
+    virtual void refit() = 0;
+    // build again from the current primitives
+    virtual void rebuild() = 0;
+    // expected cost of a ray hitting the root, in primitive intersections, see `basic_bvh_accel_t::split()`
+    virtual float_t sah_cost() const { return (float_t)stats_.primitive_num; }
+
+    // refit, then rebuild if the refitted tree costs more than `rebuild_ratio` times the last built one,
+    // return true if rebuilt
+    bool update(float_t rebuild_ratio = k_rebuild_ratio)
     {
-        set_color(x, y, color_t{});
+        refit();
+        if (sah_cost() <= rebuild_ratio * stats_.sah_cost)
+            return false;
+
+        rebuild();
+        return true;
     }
 
-    void add_color(int x, int y, color_t delta)
+    const accel_stats_t& stats() const { return stats_; }
+
+    // rigid motion keeps refitted trees within this most of the time, a shuffle of the primitives won't
+    static constexpr float_t k_rebuild_ratio = 1.5f;
+
+    static constexpr int k_packet_width = 8; // a packet covers 8x8 pixels
+    static constexpr int k_max_packet_size = k_packet_width * k_packet_width;
+
+protected:
+    accel_stats_t stats_{};
+};
+
+using accel_uptr_t = std::unique_ptr<accel_t>;
+
+
+
+/*
+   surfaces kept by shape type in structure-of-arrays, a ray is tested against `k_simd_width` shapes
+   of the same type at once, without virtual calls or loading the shapes one by one
+
+   each SIMD test repeats the scalar `hit_distance()` of its shape operation by operation, the hits it finds
+   are intersected again by their surfaces, nearest first, to fill `hit_t`
+
+   surfaces are tested in runs of the same type, `sort_by_shape()` a list(or each leaf range of it) first,
+   a lone surface is cheaper to test by itself
+*/
+class surface_soa_t
+{
+    using simd_t = simd_float_t<k_simd_width>;
+
+public:
+    surface_soa_t() = default;
+    explicit surface_soa_t(const surface_list_t& surface_list)
     {
-        color_t& color = operator()(x, y);
-        color = color + delta;
+        references_.reserve(surface_list.size());
+        for (const surface_t& surface : surface_list)
+            add(*surface.shape);
+
+        spheres_.pad();
+        disks_.pad();
+        triangles_.pad();
+        rectangles_.pad();
     }
 
-    void clear(color_t color)
+    // stable, surfaces of the same type keep their order
+    static void sort_by_shape(surface_list_t::iterator begin, surface_list_t::iterator end)
     {
-        for (int i = 0; i < get_pixel_num(); ++i)
+        std::stable_sort(begin, end, [](const surface_t& a, const surface_t& b)
         {
-            pixels_[i] = color;
-        }
+            return soa_enum(a.shape->shape_enum()) < soa_enum(b.shape->shape_enum());
+        });
     }
 
-public:
+    // of the geometry of the surfaces in order, materials and lights aside
+    uint64_t hash() const
+    {
+        uint64_t hash = hash_bytes(nullptr, 0);
+        for (const reference_t& reference : references_)
+            hash = hash_bytes(&reference.type, sizeof(reference.type), hash);
 
-#pragma region store
+        hash = spheres_.hash(hash);
+        hash = disks_.hash(hash);
+        hash = triangles_.hash(hash);
+        return rectangles_.hash(hash);
+    }
 
-    // TODO
-    //add another virtual bool store_image();
-    virtual bool store_image(std::string filename /*bool with_alpha = false*/) const
+public:
+    // closest hit of `surface_list[begin, end)`, `surface_list` is the one `*this` is built from
+    bool intersect(const surface_list_t& surface_list, int begin, int end, const ray_t& ray, hit_t* hit) const
     {
-        CHECK_DEBUG(get_channels() == 3, "Now only support RGB format");
-
-        std::string command{};
-#ifdef KY_OUTPUT_HDR
-        store_hdr_impl(filename += ".hdr", get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
-        // https://github.com/Tom94/tev
-        command = "tev " + filename;
-#else
-        store_bmp_impl(filename += ".bmp", get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
-        command = "mspaint " + filename;
-#endif
+        bool is_hit = false;
 
-#ifdef KY_WINDOWS
-        system(command.c_str());
-        /*
-        std::thread([]()
+        for (int first = begin; first < end;)
         {
-            system("mspaint single.bmp");
-        })
-        .detach();
-        */
-#endif
+            int count = run_length(first, end);
+            if (count == 1)
+            {
+                KY_COUNT_TRAVERSAL(primitive_tests);
+                if (surface_list[first++].intersect(ray, hit))
+                    is_hit = true;
+                continue;
+            }
 
-        return true;
+            float distances[k_simd_width];
+            unsigned mask = hit_mask(first, count, ray, distances);
 
-        /*
-        switch (image_type)
-        {
-        case image_enum_t::ppm:
-            return store_ppm_impl(filename, get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
-        case image_enum_t::bmp:
-            return store_bmp_impl(filename, get_width(), get_height(), get_channels(), (float_t*)pixels_.get());
-        default:
-            break;
+            // a confirmed hit ends the run, the others are farther
+            while (mask != 0)
+            {
+                int nearest = std::countr_zero(mask);
+                for (unsigned rest = mask & (mask - 1); rest != 0; rest &= rest - 1)
+                {
+                    int i = std::countr_zero(rest);
+                    if (distances[i] < distances[nearest])
+                        nearest = i;
+                }
+
+                if (surface_list[first + nearest].intersect(ray, hit))
+                {
+                    is_hit = true;
+                    break;
+                }
+                mask &= ~(1u << nearest);
+            }
+
+            first += count;
         }
-        */
+
+        return is_hit;
     }
 
-    static bool store_ppm_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+    bool intersect_p(const surface_list_t& surface_list, int begin, int end, const ray_t& ray) const
     {
-        std::fstream img_file(filename, std::ios::binary | std::ios::out);
+        for (int first = begin; first < end;)
+        {
+            int count = run_length(first, end);
+            if (count == 1)
+            {
+                KY_COUNT_TRAVERSAL(primitive_tests);
+                if (surface_list[first++].intersect_p(ray))
+                    return true;
+                continue;
+            }
 
-        img_file << std::format("P3\n{} {}\n{}\n", width, height, 255);
+            float distances[k_simd_width];
 
-        int float_num = width * height * channel;
-        for (int index = 0; index < float_num; ++index)
+            for (unsigned mask = hit_mask(first, count, ray, distances); mask != 0; mask &= mask - 1)
+            {
+                if (surface_list[first + std::countr_zero(mask)].intersect_p(ray))
+                    return true;
+            }
+
+            first += count;
+        }
+
+        return false;
+    }
+
+private:
+    // mesh triangles are stored as triangles
+    enum class soa_enum_t : uint8_t
+    {
+        sphere,
+        disk,
+        triangle,
+        rectangle,
+    };
+
+    static soa_enum_t soa_enum(shape_enum_t shape_enum)
+    {
+        switch (shape_enum)
         {
-            img_file << std::format("{} ", gamma_encoding(floats[index]));
+        case shape_enum_t::sphere: return soa_enum_t::sphere;
+        case shape_enum_t::disk: return soa_enum_t::disk;
+        case shape_enum_t::triangle: return soa_enum_t::triangle;
+        case shape_enum_t::mesh_triangle: return soa_enum_t::triangle;
+        case shape_enum_t::rectangle: return soa_enum_t::rectangle;
         }
 
-        return true;
+        LOG_ERROR("unknown shape type");
+        return soa_enum_t::sphere;
     }
-   
-    static bool store_bmp_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+
+    // `index` into the array of its type, same-type neighbours in the list are neighbours there too
+    struct reference_t
     {
-        // https://github.com/SmallVCM/SmallVCM/blob/master/src/framebuffer.hxx#L149-L215
-        // https://github.com/skywind3000/RenderHelp/blob/master/RenderHelp.h#L937-L1018
+        soa_enum_t type{};
+        int index{};
+    };
 
-        std::fstream img_file(filename, std::ios::binary | std::ios::out);
+    // `M` floats per shape, each in its own array
+    template <int M>
+    struct columns_t
+    {
+        std::array<std::vector<float>, M> columns;
+        int size{};
 
+        int push(const std::array<float, M>& values)
+        {
+            for (int c = 0; c < M; ++c)
+                columns[c].push_back(values[c]);
 
-        // 1.write file header & 2.write info header
+            return size++;
+        }
 
-        uint32_t padding_line_bytes = (width * channel + 3) & (~3);
-        uint32_t padding_image_bytes = padding_line_bytes * height;
+        // a full register can be loaded from the last shape
+        void pad()
+        {
+            for (auto& column : columns)
+                column.resize(size + k_simd_width - 1);
+        }
 
-        const uint32_t FILE_HEADER_SIZE = 14;
-        const uint32_t INFO_HEADER_SIZE = 40;
+        simd_t load(int column, int first) const { return simd_t::load(columns[column].data() + first); }
 
-        struct BITMAP_FILE_HEADER_INFO_HEADER
+        uint64_t hash(uint64_t hash) const
         {
-            // file header
-            //char8_t type[2]{ 'B', 'M' };
-            uint32_t file_size{};
-            uint32_t reserved{ 0 };
-            uint32_t databody_offset{ FILE_HEADER_SIZE + INFO_HEADER_SIZE };
+            for (const auto& column : columns)
+                hash = hash_bytes(column.data(), size * sizeof(float), hash);
+
+            return hash;
+        }
+    };
+
+    struct simd_vec3_t
+    {
+        simd_t x, y, z;
+
+        friend simd_vec3_t operator-(const simd_vec3_t& u, const simd_vec3_t& v) { return { u.x - v.x, u.y - v.y, u.z - v.z }; }
+
+        // the same order of operations as `vec3_t::dot()` and `vec3_t::cross()`
+        friend simd_t dot(const simd_vec3_t& u, const simd_vec3_t& v) { return u.x * v.x + u.y * v.y + u.z * v.z; }
+        friend simd_vec3_t cross(const simd_vec3_t& u, const simd_vec3_t& v)
+        {
+            return { u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x };
+        }
+    };
+
+    struct simd_ray_t
+    {
+        simd_vec3_t origin;
+        simd_vec3_t direction;
+        simd_t distance;
+    };
+
+    template <int M>
+    static simd_vec3_t load3(const columns_t<M>& columns, int column, int first)
+    {
+        return { columns.load(column, first), columns.load(column + 1, first), columns.load(column + 2, first) };
+    }
+
+private:
+    void add(const shape_t& shape)
+    {
+        switch (shape.shape_enum())
+        {
+        case shape_enum_t::sphere:
+        {
+            const auto& sphere = static_cast<const sphere_t&>(shape);
+            vec3_t c = sphere.center();
+            references_.push_back({ soa_enum_t::sphere, spheres_.push({ c.x, c.y, c.z, sphere.radius_sq() }) });
+            break;
+        }
+        case shape_enum_t::disk:
+        {
+            const auto& disk = static_cast<const disk_t&>(shape);
+            point3_t p = disk.position_;
+            normal_t n = disk.normal_;
+            references_.push_back({ soa_enum_t::disk, disks_.push({ p.x, p.y, p.z, n.x, n.y, n.z, disk.radius_ }) });
+            break;
+        }
+        case shape_enum_t::triangle:
+        {
+            const auto& triangle = static_cast<const triangle_t&>(shape);
+            add_triangle(triangle.p0_, triangle.p1_, triangle.p2_, triangle.normal_);
+            break;
+        }
+        case shape_enum_t::mesh_triangle:
+        {
+            point3_t p0, p1, p2;
+            static_cast<const mesh_triangle_t&>(shape).positions(&p0, &p1, &p2);
+            add_triangle(p0, p1, p2, cross(p1 - p0, p2 - p0));
+            break;
+        }
+        case shape_enum_t::rectangle:
+        {
+            const auto& rectangle = static_cast<const rectangle_t&>(shape);
+            point3_t p0 = rectangle.p0_, p1 = rectangle.p1_, p2 = rectangle.p2_, p3 = rectangle.p3_;
+            normal_t n = rectangle.normal_;
+            references_.push_back({ soa_enum_t::rectangle, rectangles_.push(
+                { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z, n.x, n.y, n.z }) });
+            break;
+        }
+        }
+    }
+
+    void add_triangle(point3_t p0, point3_t p1, point3_t p2, normal_t n)
+    {
+        references_.push_back({ soa_enum_t::triangle, triangles_.push(
+            { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, n.x, n.y, n.z }) });
+    }
 
-            // info header
-            uint32_t	info_header_size{ INFO_HEADER_SIZE };
+    // surfaces from `first` of the same type, filling at most one register
+    int run_length(int first, int end) const
+    {
+        int last = std::min(end, first + k_simd_width);
+        int count = 1;
+        while (first + count < last && references_[first + count].type == references_[first].type)
+            ++count;
 
-            int32_t     width{};
-            int32_t		height{};
-            int16_t	    color_planes{ 1 };
-            int16_t	    per_pixel_bits{};
-            uint32_t	compression{ 0 };
-            uint32_t	image_bytes{ 0 };
+        return count;
+    }
 
-            uint32_t	x_pixels_per_meter{ 0 };
-            uint32_t	y_pixels_per_meter{ 0 };
-            uint32_t	color_used{ 0 };
-            uint32_t	color_important{ 0 };
-        }
-        bmp_header
+    // bit i is set if the surface `first + i` is hit before `ray.distance()`, at `distances[i]`
+    unsigned hit_mask(int first, int count, const ray_t& ray, float* distances) const
+    {
+        KY_COUNT_TRAVERSAL_N(primitive_tests, count);
+
+        point3_t o = ray.origin();
+        vec3_t d = ray.direction();
+        simd_ray_t simd_ray{
+            { simd_t::broadcast(o.x), simd_t::broadcast(o.y), simd_t::broadcast(o.z) },
+            { simd_t::broadcast(d.x), simd_t::broadcast(d.y), simd_t::broadcast(d.z) },
+            simd_t::broadcast(ray.distance()) };
+
+        reference_t reference = references_[first];
+        int mask = 0;
+        switch (reference.type)
         {
-            .file_size{ FILE_HEADER_SIZE + INFO_HEADER_SIZE + padding_image_bytes },
-            .width{ width },
-            .height{ height },
-            .per_pixel_bits{ (int16_t)(channel * 8) },
-            //.image_bytes{ padding_image_bytes }
-        };
+        case soa_enum_t::sphere: mask = hit_spheres(reference.index, simd_ray, distances); break;
+        case soa_enum_t::disk: mask = hit_disks(reference.index, simd_ray, distances); break;
+        case soa_enum_t::triangle: mask = hit_triangles(reference.index, simd_ray, distances); break;
+        case soa_enum_t::rectangle: mask = hit_rectangles(reference.index, simd_ray, distances); break;
+        }
 
-        img_file
-            .write("BM", 2)
-            .write((char*)&bmp_header, sizeof(bmp_header));
+        return (unsigned)mask & ((1u << count) - 1);
+    }
 
+    // see `sphere_t::hit_distance()`, lanes with `discr < 0` get NaN roots, which fail every comparison
+    int hit_spheres(int first, const simd_ray_t& ray, float* distances) const
+    {
+        const simd_t epsilon = simd_t::broadcast(shape_t::epsilon);
 
-        // 3.without color table
+        simd_vec3_t oc = load3(spheres_, 0, first) - ray.origin;
+        simd_t neg_b = dot(oc, ray.direction);
+        simd_t discr = neg_b * neg_b - dot(oc, oc) + spheres_.load(3, first);
 
+        simd_t sqrt_discr = sqrt(discr);
+        simd_t near_root = neg_b - sqrt_discr;
+        simd_t far_root = neg_b + sqrt_discr;
 
-        // 4.write data body 
+        int near_mask = less_mask(epsilon, near_root) & less_mask(near_root, ray.distance);
+        int far_mask = less_mask(epsilon, far_root) & less_mask(far_root, ray.distance) & ~near_mask;
 
-        // gamma encoding
-        int byte_num = width * height * channel;
-        auto bytes = std::make_unique<uint8_t[]>(byte_num);
-        for (int i = 0; i < byte_num; i += 3)
+        near_root.store(distances);
+        if (far_mask != 0)
         {
-            // BGR
-            bytes[i]     = gamma_encoding(floats[i + 2]);
-            bytes[i + 1] = gamma_encoding(floats[i + 1]);
-            bytes[i + 2] = gamma_encoding(floats[i]);
+            float far_distances[k_simd_width];
+            far_root.store(far_distances);
+            for (unsigned mask = far_mask; mask != 0; mask &= mask - 1)
+                distances[std::countr_zero(mask)] = far_distances[std::countr_zero(mask)];
         }
 
-        int line_num = width * channel;
-        // bmp is stored from bottom to up
-        for (int y = height - 1; y >= 0; --y)
-            img_file.write((const char*)(bytes.get() + y * line_num), line_num);
+        return near_mask | far_mask;
+    }
 
+    // see `disk_t::hit_distance()`
+    int hit_disks(int first, const simd_ray_t& ray, float* distances) const
+    {
+        const simd_t zero = simd_t::broadcast(0);
+        const simd_t epsilon = simd_t::broadcast(shape_t::epsilon);
 
-        return true;
+        simd_vec3_t position = load3(disks_, 0, first);
+        simd_vec3_t normal = load3(disks_, 3, first);
+
+        // `is_equal(dot(d, n), 0)`
+        simd_t d_dot_n = dot(ray.direction, normal);
+        simd_t abs_d_dot_n = max(zero - d_dot_n, d_dot_n);
+        int parallel_mask = less_equal_mask(abs_d_dot_n,
+            simd_t::broadcast(equal_epsilon<float_t>::absolute_epsilon) * max(simd_t::broadcast(1), abs_d_dot_n));
+
+        simd_t distance = dot(normal, position - ray.origin) / d_dot_n;
+        int range_mask = less_mask(epsilon, distance) & less_mask(distance, ray.distance);
+
+        simd_vec3_t hit_point{
+            ray.origin.x + ray.direction.x * distance,
+            ray.origin.y + ray.direction.y * distance,
+            ray.origin.z + ray.direction.z * distance };
+        simd_vec3_t offset = position - hit_point;
+        int inside_mask = less_equal_mask(sqrt(dot(offset, offset)), disks_.load(6, first));
+
+        distance.store(distances);
+        return ~parallel_mask & range_mask & inside_mask;
     }
 
-    static bool store_hdr_impl(const std::string& filename, int width, int height, int channel, const float_t* floats)
+    // see `triangle_hit_distance()`
+    int hit_triangles(int first, const simd_ray_t& ray, float* distances) const
     {
-        // https://github.com/SmallVCM/SmallVCM/blob/master/src/framebuffer.hxx#L218-L251
+        const simd_t zero = simd_t::broadcast(0);
+        const simd_t epsilon = simd_t::broadcast(shape_t::epsilon);
 
-        std::ofstream img_file(filename, std::ios::binary | std::ios::out);
+        simd_vec3_t oa = load3(triangles_, 0, first) - ray.origin;
+        simd_vec3_t ob = load3(triangles_, 3, first) - ray.origin;
+        simd_vec3_t oc = load3(triangles_, 6, first) - ray.origin;
+        simd_vec3_t normal = load3(triangles_, 9, first);
 
-        img_file << std::format(
-            "#?RADIANCE\n"
-            "FORMAT=32-bit_rle_rgbe\n\n"
-            "-Y {} +X {}\n", height, width);
+        simd_t v0d = dot(cross(oc, ob), ray.direction);
+        simd_t v1d = dot(cross(ob, oa), ray.direction);
+        simd_t v2d = dot(cross(oa, oc), ray.direction);
 
-        color_t* pixels = (color_t*)floats;
-        int pixel_num = width * height;
-        for (int index = 0; index < pixel_num; index++)
-        {
-            uint8_t rgbe[4]{};
+        int inside_mask =
+            (less_mask(v0d, zero) & less_mask(v1d, zero) & less_mask(v2d, zero)) |
+            (less_equal_mask(zero, v0d) & less_equal_mask(zero, v1d) & less_equal_mask(zero, v2d));
 
-            color_t color = pixels[index];
-            float v = std::max({ color.r, color.g, color.b });
+        simd_t distance = dot(normal, oa) / dot(normal, ray.direction);
+        int range_mask = less_mask(epsilon, distance) & less_mask(distance, ray.distance);
 
-            if (v >= 1e-32f)
-            {
-                /*
-                   write:
-                        v = m * 2 ^ e ( 0 < m < 1)
-                        r = R * m * 256.0/v
-                   read:
-                        R = r * 2^(e – 128 - 8);
-                */
+        distance.store(distances);
+        return inside_mask & range_mask;
+    }
 
-                int e;
-                float m = float_t(frexp(v, &e) * 256.f / v);
+    // see `rectangle_t::hit_distance()`
+    int hit_rectangles(int first, const simd_ray_t& ray, float* distances) const
+    {
+        const simd_t zero = simd_t::broadcast(0);
+        const simd_t epsilon = simd_t::broadcast(shape_t::epsilon);
 
-                rgbe[0] = uint8_t(color.r * m);
-                rgbe[1] = uint8_t(color.g * m);
-                rgbe[2] = uint8_t(color.b * m);
-                rgbe[3] = uint8_t(e + 128);
-            }
+        simd_vec3_t oa = load3(rectangles_, 0, first) - ray.origin;
+        simd_vec3_t ob = load3(rectangles_, 3, first) - ray.origin;
+        simd_vec3_t oc = load3(rectangles_, 6, first) - ray.origin;
+        simd_vec3_t od = load3(rectangles_, 9, first) - ray.origin;
+        simd_vec3_t normal = load3(rectangles_, 12, first);
 
-            img_file.write((const char*)&rgbe[0], 4);
-        }
+        simd_t v0d = dot(cross(oc, ob), ray.direction);
+        simd_t v1d = dot(cross(ob, oa), ray.direction);
+        simd_t v2d = dot(cross(oa, od), ray.direction);
+        simd_t v3d = dot(cross(od, oc), ray.direction);
 
-        return true;
-    }
+        int inside_mask =
+            (less_mask(v0d, zero) & less_mask(v1d, zero) & less_mask(v2d, zero) & less_mask(v3d, zero)) |
+            (less_equal_mask(zero, v0d) & less_equal_mask(zero, v1d) & less_equal_mask(zero, v2d) & less_equal_mask(zero, v3d));
 
-#pragma endregion
+        simd_t distance = dot(normal, oa) / dot(normal, ray.direction);
+        int range_mask = less_mask(epsilon, distance) & less_mask(distance, ray.distance);
 
-private:
-    int32_t width_{};
-    int32_t height_{};
+        distance.store(distances);
+        return inside_mask & range_mask;
+    }
 
-    std::unique_ptr<color_t[]> pixels_{};
+private:
+    std::vector<reference_t> references_{}; // one per surface of the list
+    columns_t<4> spheres_{}; // center, radius^2
+    columns_t<7> disks_{}; // position, normal, radius
+    columns_t<12> triangles_{}; // p0, p1, p2, normal
+    columns_t<15> rectangles_{}; // p0, p1, p2, p3, normal
 };
 
+
 /*
-   put multi sub-film together in one film, for export multi images at once
-   A_mn = 
-       a_11, a_12 ... a_1n
-       a_21, a_22 ... a_2n
-       ...     ...     ...
-       a_m1, a_m2 ... a_mn
-   where a_ij is a sub-film, m/n is specified by row/column
+   built accelerators on disk, a file per surface list and accelerator type, named by the hash of the geometry,
+   later runs map the file instead of building, nodes are read in place, so processes rendering the same scene
+   share the pages
+
+   layout: accel_cache_header_t | nodes | references(indexes of leaf surfaces into the list built from), 64-byte aligned
+   a file of another version or node layout is built and stored again, bump `k_version` when builds change
 */
-class film_grid_t : public film_t
+struct accel_cache_header_t
+{
+    static constexpr uint32_t k_magic = 0x4341594b; // "KYAC"
+    static constexpr uint32_t k_version = 2;
+
+    uint32_t magic{ k_magic };
+    uint32_t version{ k_version };
+    uint64_t scene_hash{};
+    int32_t accel_enum{};
+    int32_t node_size{};
+    int32_t node_num{};
+    int32_t reference_num{};
+    uint64_t node_offset{};
+    uint64_t reference_offset{};
+    accel_stats_t stats{};
+    bounds3_t world_bound{};
+};
+
+class accel_cache_t
 {
 public:
-    film_grid_t(int row, int column, int sub_width, int sub_height) :
-        film_t(column * sub_width, row * sub_height),
-        row_{ row },
-        column_{ column },
-        sub_width_{ sub_width },
-        sub_height_{ sub_height }
+    // `node_size` of the accelerator type, for files stored by another build of ky
+    accel_cache_t(accel_enum_t accel_enum, const surface_list_t& surface_list, int node_size) :
+        surface_list_{ surface_list },
+        accel_enum_{ accel_enum },
+        node_size_{ node_size },
+        scene_hash_{ surface_soa_t(surface_list).hash() },
+        filename_{ std::format("accel_{:016x}_{}.kyac", scene_hash_, (int)accel_enum) }
     {
     }
 
-public:
-    vec2_t get_resolution() const override { return { (float_t)sub_width_, (float_t)sub_height_ }; }
+    // map the file, false if it's missing or doesn't match, or any node of it points out of the node array
+    // or the references, see `is_valid_nodes()` of `accel_type_t`
+    template <typename accel_type_t>
+    bool load()
+    {
+        auto file = std::make_shared<const mapped_file_t>(filename_);
+        if (!file->is_open() || file->size() < sizeof(accel_cache_header_t))
+            return false;
 
-    color_t& operator()(int x, int y) override
+        const accel_cache_header_t* header = (const accel_cache_header_t*)file->data();
+        bool is_match =
+            header->magic == accel_cache_header_t::k_magic &&
+            header->version == accel_cache_header_t::k_version &&
+            header->scene_hash == scene_hash_ &&
+            header->accel_enum == (int)accel_enum_ &&
+            header->node_size == node_size_ &&
+            header->node_offset + (uint64_t)header->node_num * node_size_ <= file->size() &&
+            header->reference_offset + (uint64_t)header->reference_num * sizeof(int32_t) <= file->size();
+        if (!is_match)
+            return false;
+
+        const int32_t* references = (const int32_t*)(file->data() + header->reference_offset);
+        for (int i = 0; i < header->reference_num; ++i)
+        {
+            if (references[i] < 0 || references[i] >= (int)surface_list_.size())
+                return false;
+        }
+
+        if (!accel_type_t::is_valid_nodes(file->data() + header->node_offset, header->node_num, header->reference_num))
+            return false;
+
+        file_ = std::move(file);
+        return true;
+    }
+
+    // only after `load()` succeeded
+    template <typename node_t>
+    mapped_vector_t<node_t> nodes() const
     {
-        int col_index = subfilm_index % column_;
-        int row_index = subfilm_index / column_;
-        return film_t::operator()(x + col_index * sub_width_ , y + row_index * sub_height_);
+        return { file_, (const node_t*)(file_->data() + header().node_offset), (size_t)header().node_num };
     }
 
-    void next_subfilm()
+    // in leaf order
+    surface_list_t surfaces() const
     {
-        ++subfilm_index;
+        const int32_t* references = (const int32_t*)(file_->data() + header().reference_offset);
+
+        surface_list_t surfaces(header().reference_num);
+        for (int i = 0; i < header().reference_num; ++i)
+            surfaces[i] = surface_list_[references[i]];
+
+        return surfaces;
+    }
+
+    const accel_stats_t& stats() const { return header().stats; }
+    bounds3_t world_bound() const { return header().world_bound; }
+
+    // `surfaces` in leaf order, written to a temporary file renamed over the old one,
+    // so processes mapping the old one keep reading it
+    template <typename node_t>
+    void store(const node_t* nodes, int node_num, const surface_list_t& surfaces,
+        const accel_stats_t& stats, bounds3_t world_bound) const
+    {
+        CHECK(node_size_ == sizeof(node_t));
+
+        // a surface may be referenced by several leaves, but is found by its members
+        std::map<std::tuple<const shape_t*, handle_t, handle_t>, int32_t> indexes;
+        for (int i = (int)surface_list_.size() - 1; i >= 0; --i)
+        {
+            const surface_t& surface = surface_list_[i];
+            indexes[{ surface.shape, surface.material, surface.area_light }] = i;
+        }
+
+        std::vector<int32_t> references(surfaces.size());
+        for (size_t i = 0; i < surfaces.size(); ++i)
+            references[i] = indexes.at({ surfaces[i].shape, surfaces[i].material, surfaces[i].area_light });
+
+        accel_cache_header_t header;
+        header.scene_hash = scene_hash_;
+        header.accel_enum = (int)accel_enum_;
+        header.node_size = node_size_;
+        header.node_num = node_num;
+        header.reference_num = (int)references.size();
+        header.node_offset = align(sizeof(header));
+        header.reference_offset = align(header.node_offset + (uint64_t)node_num * sizeof(node_t));
+        header.stats = stats;
+        header.world_bound = world_bound;
+
+        std::string temporary = std::format("{}.{}", filename_, std::chrono::steady_clock::now().time_since_epoch().count());
+        {
+            std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+            write(stream, &header, sizeof(header), 0);
+            write(stream, nodes, node_num * sizeof(node_t), header.node_offset);
+            write(stream, references.data(), references.size() * sizeof(int32_t), header.reference_offset);
+
+            if (!stream)
+            {
+                LOG("failed to write {}\n", temporary);
+                std::filesystem::remove(temporary);
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary, filename_, error);
+        if (error)
+        {
+            LOG("failed to store {}: {}\n", filename_, error.message());
+            std::filesystem::remove(temporary, error);
+        }
     }
 
 private:
-    int row_{};
-    int column_{};
-    int subfilm_index{};
+    const accel_cache_header_t& header() const { return *(const accel_cache_header_t*)file_->data(); }
 
-    int sub_width_{};
-    int sub_height_{};
-};
+    static uint64_t align(uint64_t offset) { return (offset + 63) / 64 * 64; }
 
-#pragma endregion
+    // zeros up to `offset` first
+    static void write(std::ofstream& stream, const void* data, size_t size, uint64_t offset)
+    {
+        while ((uint64_t)stream.tellp() < offset)
+            stream.put(0);
 
-#pragma region camera
+        stream.write((const char*)data, size);
+    }
 
-/*
-  camera space:
+private:
+    const surface_list_t& surface_list_;
+    accel_enum_t accel_enum_;
+    int node_size_;
+    uint64_t scene_hash_;
+    std::string filename_;
+    mapped_file_sptr_t file_{};
+};
 
-  y (0, 1, 0)         z(0, 0, 1)
-        |            /
-        |          /
-        |        /
-        |      /
-        |    /
-        |  /
-        |/_ _ _ _ _ _ x(1, 0, 0)
-        o
 
-  features:
-    generate ray
-*/
 
-class camera_t
+// test every surface for every ray, `k_simd_width` surfaces of a type at a time
+class trivial_accel_t : public accel_t
 {
 public:
-    virtual ~camera_t() {}
+    trivial_accel_t(surface_list_t surface_list) :
+        surface_list_{ std::move(surface_list) }
+    {
+        surface_soa_t::sort_by_shape(surface_list_.begin(), surface_list_.end());
+        rebuild();
+    }
 
-    camera_t(
-        vec3_t position, vec3_t front, vec3_t up,
-        degree_t fov, vec2_t resolution):
-        position_{ position },
-        front_{ front.normalize() },
-        up_{ up.normalize()},
-        resolution_{ resolution }
+    bool intersect(const ray_t& ray, hit_t* hit) const override
     {
-        // TODO
-        // https://github.com/infancy/pbrt-v3/blob/master/src/core/transform.cpp#L394-L397
- 
-        float_t tan_fov = std::tan(radians(fov) / 2);
+        return soa_.intersect(surface_list_, 0, (int)surface_list_.size(), ray, hit);
+    }
 
-        // left hand, clockwise
-        right_ = up_.cross(front_).normalize() * tan_fov * get_aspect();
-        up_ = front_.cross(right_).normalize() * tan_fov;
+    bool intersect_p(const ray_t& ray) const override
+    {
+        return soa_.intersect_p(surface_list_, 0, (int)surface_list_.size(), ray);
     }
 
-public:
-    // generate primary ray from camera
-    virtual ray_t generate_ray(const camera_sample_t& sample) const
+    bounds3_t world_bound() const override { return world_bound_; }
+
+    void refit() override
     {
-        vec3_t direction =
-            front_ +
-            right_ * (sample.p_film.x / resolution_.x - 0.5) +
-               up_ * (0.5 - sample.p_film.y / resolution_.y);
+        world_bound_ = bounds3_t{};
+        for (const surface_t& surface : surface_list_)
+            world_bound_ = world_bound_.join(surface.world_bound());
 
-        return ray_t{ position_, direction.normalize() };
+        soa_ = surface_soa_t(surface_list_);
     }
 
-    // sample_ray(...)
-
-private:
-    float_t get_aspect() { return resolution_.x / resolution_.y; }
+    void rebuild() override
+    {
+        stats_.build_seconds = timing_seconds([this]() { refit(); });
+        stats_.primitive_num = (int)surface_list_.size();
+        stats_.reference_num = stats_.primitive_num;
+        stats_.sah_cost = sah_cost();
+    }
 
 private:
-    vec3_t position_;
-    unit_vec3_t front_;
-    unit_vec3_t right_;
-    unit_vec3_t up_;
-
-    vec2_t resolution_;
+    surface_list_t surface_list_;
+    surface_soa_t soa_;
+    bounds3_t world_bound_;
 };
 
-using const_camera_sptr_t = std::shared_ptr<const camera_t>;
 
-#pragma endregion
 
+template <int N, bool quantized>
+class wide_bvh_accel_t;
 
+/*
+   bounding volume hierarchy, split by surface area heuristic(SAH)
 
-#pragma region bsdf_utility
+   nodes are stored in a flat array, the two children of a interior node are always adjacent,
+   a parent always comes before its children:
 
-// the functions below are based on local shading coordinate
+             0
+           /   \
+          1     2
+         / \   / \
+        3   4 5   6
 
-inline float_t cos_theta(vec3_t w) { return w.z; }
-inline float_t abs_cos_theta(vec3_t w) { return std::abs(w.z); }
+   the top levels are built serially (with parallel binning over the many primitives there),
+   until ranges are small enough to be handed out to threads as independent subtrees,
+   each subtree is built into its own node array, then spliced under its parent
 
-inline bool same_hemisphere(vec3_t w, vec3_t wp) { return w.z * wp.z > 0; }
+   with a spatial split budget, the build also tries splitting space at a plane, primitives straddling it
+   are referenced by both children with their bounds clipped(SBVH), the budget caps the duplicated
+   references as a ratio of the primitive count, such builds are serial
 
-inline vec3_t reflect(vec3_t wo, normal_t normal)
+   `primitive_t` only needs `intersect()`, `intersect_p()`, `world_bound()` and `clip_bound()`, like `surface_t`
+
+   https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies
+   https://www.nvidia.com/docs/IO/77714/sbvh.pdf (Spatial Splits in Bounding Volume Hierarchies)
+*/
+template <typename primitive_t>
+class basic_bvh_accel_t : public accel_t
 {
-    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularReflection
+    template <int N, bool quantized>
+    friend class wide_bvh_accel_t; // collapsed from `nodes_`
 
-    return -wo + 2 * dot(wo, normal) * normal;
-}
+public:
+    using primitive_list_t = std::vector<primitive_t>;
 
-// eta = eta_i/eta_t
-inline bool refract(vec3_t wi, normal_t normal, float_t eta, vec3_t* out_wt)
-{
-    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularTransmission
-    // https://github.com/mmp/pbrt-v3/blob/master/src/core/reflection.h#L97-L109
+    basic_bvh_accel_t(primitive_list_t primitive_list, int max_primitives_in_node = 4, float_t spatial_split_budget = 0) :
+        max_primitives_in_node_{ std::clamp(max_primitives_in_node, 1, k_max_leaf_primitives) },
+        spatial_split_budget_{ std::max(spatial_split_budget, (float_t)0) }
+    {
+        build_with_stats(primitive_list);
+    }
 
-    // compute $\cos \theta_\mathrm{t}$ using Snell's law
-    float_t cos_theta_i = dot(normal, wi);
-    float_t sin_theta_i_sq = std::max(float_t(0), float_t(1 - cos_theta_i * cos_theta_i));
-    float_t sin_theta_t_sq = eta * eta * sin_theta_i_sq;
+    // nodes mapped from `cache` after `accel_cache_t::load()`, surfaces only
+    basic_bvh_accel_t(const primitive_list_t& primitive_list, const accel_cache_t& cache,
+        int max_primitives_in_node = 4, float_t spatial_split_budget = 0) :
+        max_primitives_in_node_{ std::clamp(max_primitives_in_node, 1, k_max_leaf_primitives) },
+        spatial_split_budget_{ std::max(spatial_split_budget, (float_t)0) }
+    {
+        float_t seconds = timing_seconds([&]()
+        {
+            nodes_ = cache.nodes<node_t>();
+            primitive_list_ = cache.surfaces();
+            if (spatial_split_budget_ > 0)
+                unique_primitive_list_ = primitive_list;
+
+            soa_ = surface_soa_t(primitive_list_);
+        });
+
+        stats_ = cache.stats();
+        stats_.build_seconds = seconds;
+    }
+
+    static int node_size() { return sizeof(node_t); }
 
-    if (sin_theta_t_sq >= 1)
-        return false; // handle total internal reflection for transmission
+    // nodes from a cache file form a tree from node 0, no deeper than the traversal stack,
+    // with children in `[0, node_num)` and leaf primitives in `[0, reference_num)`
+    static bool is_valid_nodes(const uint8_t* data, int node_num, int reference_num)
+    {
+        const node_t* nodes = (const node_t*)data;
+        if (node_num <= 0)
+            return false;
 
-    float_t cos_theta_t = std::sqrt(1 - sin_theta_t_sq);
-    *out_wt = eta * -wi + (eta * cos_theta_i - cos_theta_t) * vec3_t(normal);
+        std::vector<uint8_t> is_visited(node_num);
+        std::vector<std::pair<int, int>> to_visit{ { 0, 1 } }; // node, depth
+        while (!to_visit.empty())
+        {
+            auto [index, depth] = to_visit.back();
+            to_visit.pop_back();
+            if (depth > k_max_depth || is_visited[index])
+                return false;
+            is_visited[index] = true;
 
-    CHECK_DEBUG(out_wt->is_valid() && !out_wt->is_zero());
-    return true;
-}
+            const node_t& node = nodes[index];
+            if (node.offset < 0)
+                return false;
 
-#pragma endregion
+            if (node.is_leaf())
+            {
+                if ((int64_t)node.offset + node.primitive_num > reference_num)
+                    return false;
+            }
+            else
+            {
+                if ((int64_t)node.offset + 1 >= node_num)
+                    return false;
 
-#pragma region fresnel
+                to_visit.push_back({ node.offset, depth + 1 });
+                to_visit.push_back({ node.offset + 1, depth + 1 });
+            }
+        }
 
-float_t fresnel_dielectric(
-    float_t cos_theta_i, 
-    float_t eta_i, float_t eta_t)
-{
-    // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#FresnelReflectance
-    // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L66-L90
+        return true;
+    }
 
-    cos_theta_i = std::clamp(cos_theta_i, (float_t)-1, (float_t)1);
+    void store(const accel_cache_t& cache) const
+    {
+        cache.store(nodes_.data(), (int)nodes_.size(), primitive_list_, stats_, world_bound());
+    }
 
-    bool entering = cos_theta_i > 0.f;
-    if (!entering)
+public:
+    bool intersect(const ray_t& ray, hit_t* hit) const override
     {
-        std::swap(eta_i, eta_t);
-        cos_theta_i = std::abs(cos_theta_i);
+        return traverse<false>(ray, hit);
     }
 
+    bool intersect_p(const ray_t& ray) const override
+    {
+        return traverse<true>(ray, nullptr);
+    }
 
-    // compute $\cos \theta_\mathrm{t}$ using Snell's law
-    float_t sin_theta_i = std::sqrt(std::max((float_t)0, 1 - cos_theta_i * cos_theta_i));
-    float_t sin_theta_t = eta_i / eta_t * sin_theta_i;
+    // the packet visits a node if any of its rays hits the node, rays are box tested `k_simd_width` at a time,
+    // rays left alone in a subtree go on by `traverse()`
+    void intersect_packet(const ray_t* rays, int ray_num, hit_t* hits, bool* is_hits) const override
+    {
+        CHECK_DEBUG(ray_num <= k_max_packet_size);
+        std::fill(is_hits, is_hits + ray_num, false);
+        if (nodes_.empty() || ray_num == 0)
+            return;
 
-    // Handle total internal reflection
-    if (sin_theta_t >= 1)
-        return 1;
+        // children are visited near first for all rays, so they must point to the same octant
+        int dir_is_neg[3] = { rays[0].direction().x < 0, rays[0].direction().y < 0, rays[0].direction().z < 0 };
+        bool is_coherent = true;
+        for (int i = 1; i < ray_num; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+                is_coherent = is_coherent && (rays[i].direction()[axis] < 0) == dir_is_neg[axis];
+        }
 
-    float_t cos_theta_t = std::sqrt(std::max((float_t)0, 1 - sin_theta_t * sin_theta_t));
+        if (!is_coherent || ray_num < k_min_packet_rays)
+        {
+            for (int i = 0; i < ray_num; ++i)
+                is_hits[i] = traverse<false>(rays[i], &hits[i]);
+            return;
+        }
 
+        packet_t packet(rays, ray_num, dir_is_neg);
 
-    float_t r_para = ((eta_t * cos_theta_i) - (eta_i * cos_theta_t)) /
-                   ((eta_t * cos_theta_i) + (eta_i * cos_theta_t));
-    float_t r_perp = ((eta_i * cos_theta_i) - (eta_t * cos_theta_t)) /
-                   ((eta_i * cos_theta_i) + (eta_t * cos_theta_t));
-    return (r_para * r_para + r_perp * r_perp) / 2;
-}
+        struct entry_t
+        {
+            int node{};
+            uint64_t active{}; // rays hitting the parent
+        };
+        entry_t to_visit[k_max_depth];
+        int to_visit_num = 0;
+        to_visit[to_visit_num++] = { 0, ray_num == 64 ? ~0ull : (1ull << ray_num) - 1 };
 
-#pragma region schlick approximation 1994
+        while (to_visit_num > 0)
+        {
+            entry_t entry = to_visit[--to_visit_num];
+            const node_t& node = nodes_[entry.node];
+            KY_COUNT_TRAVERSAL(node_visits);
 
-float_t fresnel_dielectric_schlick(
-    float_t cos_theta_i, float_t cos_theta_t, 
-    float_t eta_i, float_t eta_t)
-{
-    /*
-    cos_theta_i = std::clamp(cos_theta_i, -1.0, 1.0);
-    cos_theta_t = std::clamp(cos_theta_t, -1.0, 1.0);
+            uint64_t active = packet.intersect_p(node.bounds, entry.active);
+            if (active == 0)
+                continue;
 
-    bool entering = cos_theta_i > 0.f;
-    if (!entering)
-    {
-        std::swap(eta_i, eta_t);
-        cos_theta_i = std::abs(cos_theta_i);
-        cos_theta_t = std::abs(cos_theta_t);
+            // the packet has diverged, sharing the node visits no longer pays off
+            if (std::popcount(active) < k_min_packet_rays)
+            {
+                for (; active != 0; active &= active - 1)
+                {
+                    int i = std::countr_zero(active);
+                    if (traverse<false>(rays[i], &hits[i], entry.node))
+                        is_hits[i] = true;
+                    packet.distance[i] = rays[i].distance();
+                }
+
+                continue;
+            }
+
+            if (node.is_leaf())
+            {
+                for (uint64_t mask = active; mask != 0; mask &= mask - 1)
+                {
+                    int i = std::countr_zero(mask);
+                    if (intersect_leaf(node, rays[i], &hits[i]))
+                    {
+                        is_hits[i] = true;
+                        packet.distance[i] = rays[i].distance();
+                    }
+                }
+            }
+            else
+            {
+                // near child on top, the same order as `traverse()`
+                to_visit[to_visit_num++] = { node.offset + 1 - dir_is_neg[node.axis], active };
+                to_visit[to_visit_num++] = { node.offset + dir_is_neg[node.axis], active };
+                prefetch_children(nodes_[to_visit[to_visit_num - 2].node]);
+            }
+        }
     }
-    */
 
-    float_t F0 = (eta_t - eta_i) / (eta_t + eta_i);
-    F0 *= F0;
+    // rays needn't share an octant, any hit ends a ray so the order children are visited in doesn't matter
+    void intersect_p_packet(const ray_t* rays, int ray_num, bool* is_hits) const override
+    {
+        CHECK_DEBUG(ray_num <= k_max_packet_size);
+        std::fill(is_hits, is_hits + ray_num, false);
+        if (nodes_.empty() || ray_num == 0)
+            return;
 
-    //float_t cos_i = eta_i < eta_t ? cos_theta_i : cos_theta_t;
-    float_t cos_i = cos_theta_i < 0 ? -cos_theta_i : cos_theta_t;
+        if (ray_num < k_min_packet_rays)
+        {
+            for (int i = 0; i < ray_num; ++i)
+                is_hits[i] = traverse<true>(rays[i], nullptr);
+            return;
+        }
 
-    return lerp(F0, 1.0f, std::pow(1 - cos_i, 5.0f) );
-}
+        packet_t packet(rays, ray_num, nullptr);
+        uint64_t unoccluded = ray_num == 64 ? ~0ull : (1ull << ray_num) - 1;
 
-float_t fresnel_dielectric_schlick(
-    float_t cos_theta_i,
-    float_t eta_i, float_t eta_t)
-{
-    float_t F0 = (eta_t - eta_i) / (eta_t + eta_i);
-    F0 *= F0;
+        struct entry_t
+        {
+            int node{};
+            uint64_t active{}; // rays hitting the parent
+        };
+        entry_t to_visit[k_max_depth];
+        int to_visit_num = 0;
+        to_visit[to_visit_num++] = { 0, unoccluded };
 
-    return lerp(F0, 1.0f, std::pow(1 - cos_theta_i, 5.0f));
-}
+        while (to_visit_num > 0)
+        {
+            entry_t entry = to_visit[--to_visit_num];
+            const node_t& node = nodes_[entry.node];
+            KY_COUNT_TRAVERSAL(node_visits);
 
-/*
-   given
-     * the cosine of the incidence angle `cos_theta_i`,
-     * the fresnel reflectance at normal incidence `F0`
-   compute reflectance
-*/
-float_t fresnel_dielectric_schlick(float_t cos_theta_i, float_t F0)
-{
-    return lerp(F0, 1.0f, std::pow((1.0f - cos_theta_i), 5.0f));
-}
+            uint64_t active = packet.intersect_p(node.bounds, entry.active & unoccluded);
+            if (active == 0)
+                continue;
 
-/*
-color_t fresnel_dielectric_schlick(float_t cos_theta_i, color_t F0)
-{
-    return lerp(F0, vec3_t(1.0f), std::pow((1.0f - cos_theta_i), 5.0f));
-}
-*/
+            if (node.is_leaf() || std::popcount(active) < k_min_packet_rays)
+            {
+                for (; active != 0; active &= active - 1)
+                {
+                    int i = std::countr_zero(active);
+                    bool is_hit = node.is_leaf() ? intersect_p_leaf(node, rays[i]) : traverse<true>(rays[i], nullptr, entry.node);
+                    if (is_hit)
+                    {
+                        is_hits[i] = true;
+                        unoccluded &= ~(1ull << i);
+                    }
+                }
+            }
+            else
+            {
+                to_visit[to_visit_num++] = { node.offset + 1, active };
+                to_visit[to_visit_num++] = { node.offset, active };
+                prefetch_children(nodes_[node.offset]);
+            }
+        }
+    }
 
-#pragma endregion
+    bounds3_t world_bound() const override
+    {
+        return nodes_.empty() ? bounds3_t{} : nodes_[0].bounds;
+    }
 
-/*
-class fresnel_t
-{
-public:
-    virtual ~fresnel_t() = default;
+    // children always come after their parent, so a reverse sweep sees them refitted first,
+    // leaves of spatial splits grow back to whole primitives, `update()` rebuilds once that costs too much
+    void refit() override
+    {
+        for (int i = (int)nodes_.size() - 1; i >= 0; --i)
+        {
+            node_t& node = nodes_[i];
+            bounds3_t bounds;
 
-    virtual float_t evaluate(float_t cosI) const = 0;
-};
+            if (node.is_leaf())
+            {
+                for (int p = 0; p < node.primitive_num; ++p)
+                    bounds = bounds.join(primitive_list_[node.offset + p].world_bound());
+            }
+            else
+            {
+                bounds = nodes_[node.offset].bounds.join(nodes_[node.offset + 1].bounds);
+            }
 
-class fresnel_dielectric_t : public fresnel_t
-{
-public:
-    fresnel_dielectric_t()
+            node.bounds = bounds;
+        }
+
+        if constexpr (std::is_same_v<primitive_t, surface_t>)
+            soa_ = surface_soa_t(primitive_list_);
+    }
+
+    void rebuild() override
     {
+        // `primitive_list_` may hold duplicates from spatial splits
+        primitive_list_t primitive_list = spatial_split_budget_ > 0 ? unique_primitive_list_ : std::move(primitive_list_);
+        build_with_stats(primitive_list);
     }
 
-    float_t evaluate(float_t cosI) const override
+    float_t sah_cost() const override
     {
-        return 0;
+        if (nodes_.empty())
+            return 0;
+
+        float_t root_area = nodes_[0].bounds.surface_area();
+        if (root_area == 0)
+            return (float_t)primitive_list_.size();
+
+        float_t cost = 0;
+        for (const node_t& node : nodes_)
+        {
+            float_t node_cost = node.is_leaf() ? (float_t)node.primitive_num : k_traversal_cost;
+            cost += node_cost * node.bounds.surface_area();
+        }
+
+        return cost / root_area;
     }
-};
 
-// class fresnel_dummy_t : public fresnel_t
-*/
+private:
+    // closest hit if `any_hit` is false, otherwise stop at the first hit and leave `hit` untouched,
+    // only the subtree of `nodes_[root]` is visited
+    template <bool any_hit>
+    bool traverse(const ray_t& ray, hit_t* hit, int root = 0) const
+    {
+        if (nodes_.empty())
+            return false;
 
-#pragma endregion
+        vec3_t inv_direction(1 / ray.direction().x, 1 / ray.direction().y, 1 / ray.direction().z);
+        int dir_is_neg[3] = { inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0 };
 
-#pragma region bsdf
+        bool is_hit = false;
 
-/*
-   reference:
-     * LuxCoreRender Materials https://wiki.luxcorerender.org/LuxCoreRender_Materials
-     * Shader — Blender Manual https://docs.blender.org/manual/en/latest/render/shader_nodes/shader/index.html
-     * BSDFs - Mitsuba 3 https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html
-*/
+        int to_visit[k_max_depth]{};
+        int to_visit_num = 0;
+        int current = root;
 
-enum class bsdf_enum_t
-{
-    none = 0,
-    reflection = 1,
-    transmission = 2,
-    scattering = reflection | transmission,
+        while (true)
+        {
+            const node_t& node = nodes_[current];
+            KY_COUNT_TRAVERSAL(node_visits);
 
-    diffuse = 4,
-    glossy = 8,
-    specluar = 16,
-};
-KY_ENUM_OPERATORS(bsdf_enum_t)
+            // `ray.distance()` shrinks once a closer primitive is found, so farther nodes are culled
+            if (node.bounds.intersect_p(ray.origin(), inv_direction, dir_is_neg, ray.distance()))
+            {
+                if (node.is_leaf())
+                {
+                    if constexpr (any_hit)
+                    {
+                        if (intersect_p_leaf(node, ray))
+                            return true;
+                    }
+                    else
+                    {
+                        if (intersect_leaf(node, ray, hit))
+                            is_hit = true;
+                    }
+
+                    if (to_visit_num == 0)
+                        break;
+                    current = to_visit[--to_visit_num];
+                }
+                else
+                {
+                    // visit the near child first, the first child holds the smaller part alone `axis`
+                    if (dir_is_neg[node.axis])
+                    {
+                        to_visit[to_visit_num++] = node.offset;
+                        current = node.offset + 1;
+                    }
+                    else
+                    {
+                        to_visit[to_visit_num++] = node.offset + 1;
+                        current = node.offset;
+                    }
+
+                    // the far child came in with its sibling, load its children before it's popped
+                    prefetch_children(nodes_[to_visit[to_visit_num - 1]]);
+                }
+            }
+            else
+            {
+                if (to_visit_num == 0)
+                    break;
+                current = to_visit[--to_visit_num];
+            }
+        }
 
-inline bool is_delta_bsdf(bsdf_enum_t bsdf_type)
-{
-    return enum_have(bsdf_type, bsdf_enum_t::specluar);
-}
+        return is_hit;
+    }
 
-/* 
-  local shading frame:
+private:
+    // rays of `intersect_packet()` in SoA, padded to whole SIMD registers
+    struct packet_t
+    {
+        using simd_t = simd_float_t<k_simd_width>;
+
+        alignas(32) float origin[3][k_max_packet_size]{};
+        alignas(32) float inv_direction[3][k_max_packet_size]{};
+        alignas(32) float distance[k_max_packet_size]{};
+        int dir_is_neg[3]{};
+        bool is_mixed{}; // rays of different octants, without `dir_is_neg`
+        int group_num{}; // SIMD registers per member
+
+        // `dir_is_neg_` is shared by all rays, or null if they head anywhere
+        packet_t(const ray_t* rays, int ray_num, const int* dir_is_neg_) :
+            is_mixed{ dir_is_neg_ == nullptr },
+            group_num{ (ray_num + k_simd_width - 1) / k_simd_width }
+        {
+            if (!is_mixed)
+                std::copy(dir_is_neg_, dir_is_neg_ + 3, dir_is_neg);
 
-      z/n(0, 0, 1)
-       |
-       |
-       |
-       |
-       |_ _ _ _ _ _ x/s(1, 0, 0)
-      / p
-     /
-    /
-  y/t(0, 1, 0)
+            // mixed rays sort the slabs by min/max instead, a finite inverse keeps 0 * infinity from
+            // turning into NaN there, which would leak through min/max
+            constexpr float k_max_inv_direction = 1e30f;
 
-  prev   n   light
-  ----   ^   -----
-    ^    |    ^
-     \   | θ /
-   wo \  |  / wi is unknown, sampling from bsdf or light
-       \ | /
-        \|/
-      -------
-       isect
+            for (int i = 0; i < ray_num; ++i)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    origin[axis][i] = rays[i].origin()[axis];
+                    inv_direction[axis][i] = 1 / rays[i].direction()[axis];
+                    if (is_mixed)
+                        inv_direction[axis][i] = std::clamp(inv_direction[axis][i], -k_max_inv_direction, k_max_inv_direction);
+                }
+                distance[i] = rays[i].distance();
+            }
+        }
 
-   https://www.pbr-book.org/3ed-2018/Reflection_Models#x0-GeometricSetting
-*/
+        // rays of `active` hitting `bounds`, the slab test of `wide_bvh_accel_t` over rays instead of boxes
+        uint64_t intersect_p(const bounds3_t& bounds, uint64_t active) const
+        {
+            constexpr uint64_t k_group_mask = (1ull << k_simd_width) - 1;
+            simd_t conservative = simd_t::broadcast(1 + 2 * error_gamma(3)); // see `bounds3_t::intersect_p()`
 
-struct bsdf_sample_t
-{
-    color_t f{}; // scattering rate 
-    vec3_t wi{}; // world wi
-    float_t pdf{};
-    bsdf_enum_t bsdf_type{}; // flags
-};
+            uint64_t hit = 0;
+            for (int group = 0; group < group_num; ++group)
+            {
+                int first = group * k_simd_width;
+                if (((active >> first) & k_group_mask) == 0)
+                    continue;
+
+                simd_t t_min = simd_t::broadcast(0);
+                simd_t t_max = simd_t::load(distance + first);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    simd_t o = simd_t::load(origin[axis] + first);
+                    simd_t inv = simd_t::load(inv_direction[axis] + first);
+                    simd_t t_near = (simd_t::broadcast(bounds[    dir_is_neg[axis]][axis]) - o) * inv;
+                    simd_t t_far  = (simd_t::broadcast(bounds[1 - dir_is_neg[axis]][axis]) - o) * inv;
+                    if (is_mixed)
+                    {
+                        simd_t t_min_bound = t_near;
+                        t_near = min(t_near, t_far);
+                        t_far = max(t_min_bound, t_far);
+                    }
+
+                    // NaN(0 * inf, ray origin on a slab) keeps the previous value
+                    t_min = max(t_near, t_min);
+                    t_max = min(t_far * conservative, t_max);
+                }
+
+                hit |= (uint64_t)less_equal_mask(t_min, t_max) << first;
+            }
+
+            return hit & active;
+        }
+    };
 
-class bsdf_t
-{
-public:
-    virtual ~bsdf_t() = default;
+    struct primitive_info_t
+    {
+        bounds3_t bounds{};
+        point3_t centroid{};
+        int index{}; // index of `primitive_list`
+    };
 
-    bsdf_t(frame_t shading_frame) :
-        shading_frame_{ shading_frame }
+    struct node_t
     {
-    }
+        bounds3_t bounds{};
+        int32_t offset{}; // leaf: first primitive; interior: first child, the second child is `offset + 1`
+        uint16_t primitive_num{}; // 0 for interior node
+        uint8_t axis{}; // split axis of interior node
 
-public:
-    virtual bool is_delta() const = 0;
+        bool is_leaf() const { return primitive_num > 0; }
+    };
 
-    // or called `f()`, `evaluate()`
-    color_t eval(vec3_t world_wo, vec3_t world_wi) const
+    void prefetch_children(const node_t& node) const
     {
-        return eval_(to_local(world_wo), to_local(world_wi));
+        if (!node.is_leaf())
+            prefetch(&nodes_[node.offset], 2 * sizeof(node_t));
     }
 
-    float_t pdf(vec3_t world_wo, vec3_t world_wi) const
+    // surfaces of a leaf go through `soa_`, other primitives one by one
+    bool intersect_leaf(const node_t& node, const ray_t& ray, hit_t* hit) const
     {
-        return pdf_(to_local(world_wo), to_local(world_wi));
+        if constexpr (std::is_same_v<primitive_t, surface_t>)
+        {
+            return soa_.intersect(primitive_list_, node.offset, node.offset + node.primitive_num, ray, hit);
+        }
+        else
+        {
+            bool is_hit = false;
+            for (int i = 0; i < node.primitive_num; ++i)
+            {
+                KY_COUNT_TRAVERSAL(primitive_tests);
+                if (primitive_list_[node.offset + i].intersect(ray, hit))
+                    is_hit = true;
+            }
+
+            return is_hit;
+        }
     }
 
-    // or called `sample_f()`, `sample_direction()`, `sample_solid_angle()`
-    bsdf_sample_t sample(vec3_t world_wo, float2_t random) const
+    bool intersect_p_leaf(const node_t& node, const ray_t& ray) const
     {
-        bsdf_sample_t sample = sample_(to_local(world_wo), random);
-        sample.wi = to_world(sample.wi); // <--- ATTENTION!!!
+        if constexpr (std::is_same_v<primitive_t, surface_t>)
+        {
+            return soa_.intersect_p(primitive_list_, node.offset, node.offset + node.primitive_num, ray);
+        }
+        else
+        {
+            for (int i = 0; i < node.primitive_num; ++i)
+            {
+                KY_COUNT_TRAVERSAL(primitive_tests);
+                if (primitive_list_[node.offset + i].intersect_p(ray))
+                    return true;
+            }
 
-        return sample;
+            return false;
+        }
     }
 
-    std::tuple<color_t, float_t> eval_and_pdf(vec3_t world_wo, vec3_t world_wi) const
+    // a subtree left to be built by a thread
+    struct subtree_t
     {
-        vec3_t wo = to_local(world_wo), wi = to_local(world_wi);
+        int node_index{}; // index of `nodes_`
+        int begin{};
+        int end{};
+    };
+
+    void build_with_stats(const primitive_list_t& primitive_list)
+    {
+        nodes_.clear();
+        primitive_list_.clear();
+
+        stats_.build_seconds = timing_seconds([&]()
+        {
+            if (spatial_split_budget_ > 0)
+                build_spatial(primitive_list);
+            else
+                build(primitive_list);
 
-        return { eval_(wo, wi), pdf_(wo, wi) };
+            reorder_treelets();
+            build_soa();
+        });
+        stats_.primitive_num = (int)primitive_list.size();
+        stats_.reference_num = (int)primitive_list_.size();
+        stats_.node_num = (int)nodes_.size();
+        stats_.node_bytes = nodes_.size() * sizeof(node_t);
+        stats_.sah_cost = sah_cost();
     }
 
-protected: 
-    virtual color_t eval_(vec3_t wo, vec3_t wi) const = 0;
-    virtual float_t pdf_(vec3_t wo, vec3_t wi) const = 0;
+    /*
+       the builds leave nodes in depth-first order, the children of a node deep in the tree may be far away
+       from it, a ray going down pays a cache miss per level, and a TLB miss too in trees larger than a page
 
-    virtual bsdf_sample_t sample_(vec3_t wo, float2_t random) const = 0;
+       regroup sibling pairs into treelets of a page each, starting from the root, a treelet takes the pairs
+       of its nodes most likely visited next, by their surface area, the pairs left out start treelets
+       of their own, so the nodes a ray visits together are packed in a few pages
 
-private:
-    vec3_t to_local(vec3_t world_vec3) const
-    {
-        return shading_frame_.to_local(world_vec3);
-    }
+       parents still come before children and siblings stay adjacent, which `refit()` and
+       `wide_bvh_accel_t::collapse()` rely on
 
-    vec3_t to_world(vec3_t local_vec3) const
+       Architecture Considerations for Tracing Incoherent Rays, Aila and Karras 2010 (treelets)
+    */
+    void reorder_treelets()
     {
-        return shading_frame_.to_world(local_vec3);
-    }
+        int node_num = (int)nodes_.size();
+        if (node_num < 3)
+            return;
 
-private:
-    frame_t shading_frame_;
+        constexpr int pairs_per_treelet = k_treelet_bytes / (2 * sizeof(node_t));
 
-    // extension point:
-    // std::array<bxdf_uptr, 2> bxdf_list_;
-};
+        std::vector<node_t> ordered;
+        ordered.reserve(node_num);
+        ordered.push_back(nodes_[0]);
 
+        std::vector<int> new_index(node_num);
 
+        // interior nodes whose children are laid out next
+        std::vector<int> treelet_roots{ 0 };
+        for (size_t t = 0; t < treelet_roots.size(); ++t)
+        {
+            std::priority_queue<std::pair<float_t, int>> frontier;
+            frontier.push({ nodes_[treelet_roots[t]].bounds.surface_area(), treelet_roots[t] });
 
-class lambertion_reflection_t : public bsdf_t
-{
-public:
-    lambertion_reflection_t(const frame_t& shading_frame, color_t albedo) :
-        bsdf_t(shading_frame), albedo_{ albedo }
-    {
-    }
+            for (int pair_num = 0; pair_num < pairs_per_treelet && !frontier.empty(); ++pair_num)
+            {
+                int first = nodes_[frontier.top().second].offset;
+                frontier.pop();
 
-    bool is_delta() const override { return false; }
+                for (int child = first; child < first + 2; ++child)
+                {
+                    new_index[child] = (int)ordered.size();
+                    ordered.push_back(nodes_[child]);
 
-    color_t eval_(vec3_t wo, vec3_t wi) const override
-    {
-        // TODO: confirm
-        if (!same_hemisphere(wo, wi))
-            return color_t{};
+                    if (!nodes_[child].is_leaf())
+                        frontier.push({ nodes_[child].bounds.surface_area(), child });
+                }
+            }
 
-        // lambertion surface's albedo divided by $\pi$ is surface bidirectional reflectance
-        return albedo_ * k_inv_pi;
+            for (; !frontier.empty(); frontier.pop())
+                treelet_roots.push_back(frontier.top().second);
+        }
+
+        for (node_t& node : ordered)
+        {
+            if (!node.is_leaf())
+                node.offset = new_index[node.offset];
+        }
+
+        nodes_.vector() = std::move(ordered);
     }
 
-    float_t pdf_(vec3_t wo, vec3_t wi) const override
+    // leaves order their surfaces by shape type, so same-type ones are tested together
+    void build_soa()
     {
-        return same_hemisphere(wo, wi) ? cosine_hemisphere_pdf(abs_cos_theta(wi)) : 0;
+        if constexpr (std::is_same_v<primitive_t, surface_t>)
+        {
+            for (const node_t& node : nodes_)
+            {
+                if (node.is_leaf())
+                {
+                    auto begin = primitive_list_.begin() + node.offset;
+                    surface_soa_t::sort_by_shape(begin, begin + node.primitive_num);
+                }
+            }
+
+            soa_ = surface_soa_t(primitive_list_);
+        }
     }
 
-    bsdf_sample_t sample_(vec3_t wo, float2_t random) const override
+    void build(const primitive_list_t& primitive_list)
     {
-        bsdf_sample_t sample;
+        int primitive_num = (int)primitive_list.size();
+        if (primitive_num == 0)
+            return;
 
-        // cosine-sample the hemisphere, flipping the direction if necessary
-        sample.wi = cosine_hemisphere_sample(random);
-        if (wo.z < 0) 
-            sample.wi.z *= -1;
+        std::vector<primitive_info_t> primitive_infos(primitive_num);
+    #ifdef KY_RELEASE
+        #pragma omp parallel for
+    #endif // !KY_RELEASE
+        for (int i = 0; i < primitive_num; ++i)
+        {
+            bounds3_t bounds = primitive_list[i].world_bound();
+            primitive_infos[i] = { bounds, bounds.centroid(), i };
+        }
 
-        sample.f = eval_(wo, sample.wi);
-        sample.pdf = pdf_(wo, sample.wi);
-        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::diffuse;
+        // a few subtrees per thread for load balance, small scenes end up with a single subtree
+        int thread_num = std::max((int)std::thread::hardware_concurrency(), 1);
+        int subtree_primitive_num = std::max(primitive_num / (4 * thread_num), k_min_subtree_primitives);
 
-        CHECK_DEBUG(sample.f.is_valid());
-        return sample;
-    }
+        std::vector<subtree_t> subtrees;
+        nodes_.reserve(2 * primitive_num - 1);
+        nodes_.emplace_back();
+        build(nodes_.vector(), 0, primitive_infos.data(), 0, primitive_num, subtree_primitive_num, &subtrees);
 
-private:
-    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Matte
-    // https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html#smooth-diffuse-material-diffuse
-    // surface directional-hemispherical reflectance, usually called `albedo`
-    // symbol: $\rho_{\mathrm{hd}}$
-    color_t albedo_{};
-};
+        int subtree_num = (int)subtrees.size();
+        std::vector<std::vector<node_t>> subtree_nodes(subtree_num);
+    #ifdef KY_RELEASE
+        #pragma omp parallel for schedule(dynamic, 1)
+    #endif // !KY_RELEASE
+        for (int i = 0; i < subtree_num; ++i)
+        {
+            const subtree_t& subtree = subtrees[i];
+            std::vector<node_t>& nodes = subtree_nodes[i];
 
+            nodes.reserve(2 * (subtree.end - subtree.begin) - 1);
+            nodes.emplace_back();
+            build(nodes, 0, primitive_infos.data(), subtree.begin, subtree.end, 0, nullptr);
+        }
 
+        // the root of a subtree takes the place of its node, the others are appended,
+        // so parent still comes before children and siblings stay adjacent
+        for (int i = 0; i < subtree_num; ++i)
+        {
+            const std::vector<node_t>& nodes = subtree_nodes[i];
+            int base = (int)nodes_.size() - 1; // `nodes[j]` goes to `nodes_[base + j]` for j > 0
 
-/*
-  ideal specular reflection, ignore fresnel effect,
-  only suitable for some metal materials
+            auto relocate = [base](node_t node)
+            {
+                if (!node.is_leaf())
+                    node.offset += base;
+                return node;
+            };
+
+            nodes_[subtrees[i].node_index] = relocate(nodes[0]);
+            for (int j = 1; j < (int)nodes.size(); ++j)
+                nodes_.push_back(relocate(nodes[j]));
+        }
 
-  as a delta bsdf, it's `eval(...), pdf(...) sample(...)` functions requires special processing,
-  same to `fresnel_specular_t`
-*/
-class perfect_specular_reflection_t : public bsdf_t
-{
-public:
-    perfect_specular_reflection_t(const frame_t& shading_frame, color_t reflectance) :
-        bsdf_t(shading_frame), reflectance_{ reflectance }
-    {
+        // `build()` partitions primitives in place, so the range of leaf node indexes `primitive_infos` directly
+        primitive_list_.reserve(primitive_num);
+        for (const primitive_info_t& info : primitive_infos)
+            primitive_list_.push_back(primitive_list[info.index]);
     }
 
-    bool is_delta() const override { return true; }
+    // build subtree of `nodes[node_index]` from `primitive_infos[begin, end)`,
+    // ranges of no more than `subtree_primitive_num` are pushed to `subtrees` instead if it's not null
+    void build(std::vector<node_t>& nodes, int node_index, primitive_info_t* primitive_infos, int begin, int end,
+        int subtree_primitive_num, std::vector<subtree_t>* subtrees) const
+    {
+        int primitive_num = end - begin;
+        if (subtrees && primitive_num <= subtree_primitive_num)
+        {
+            subtrees->push_back({ node_index, begin, end });
+            return;
+        }
 
-    color_t eval_(vec3_t wo, vec3_t wi) const override { return color_t(); }
-    float_t pdf_(vec3_t wo, vec3_t wi) const override { return 0; }
+        bounds3_t bounds, centroid_bounds;
+    #ifdef KY_RELEASE
+        #pragma omp parallel if (primitive_num >= k_parallel_primitives)
+    #endif // !KY_RELEASE
+        {
+            bounds3_t local_bounds, local_centroid_bounds;
+        #ifdef KY_RELEASE
+            #pragma omp for nowait
+        #endif // !KY_RELEASE
+            for (int i = begin; i < end; ++i)
+            {
+                local_bounds = local_bounds.join(primitive_infos[i].bounds);
+                local_centroid_bounds = local_centroid_bounds.join(primitive_infos[i].centroid);
+            }
 
-    bsdf_sample_t sample_(vec3_t wo, float2_t random) const override
-    {
-        // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#SpecularReflection
-        // https://github.com/infancy/pbrt-v3/blob/master/src/materials/mirror.cpp#L45-L57  mirror material use `FresnelNoOp`
-        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.h#L387-L408   class SpecularReflection;
-        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L181-L191 SpecularReflection::Sample_f(...)
-        
-        bsdf_sample_t sample; 
-        sample.wi = vec3_t(-wo.x, -wo.y, wo.z); // sample.wi = reflect(wo, vec3_t(0, 0, 1));
-        sample.f = reflectance_ / abs_cos_theta(sample.wi); // (f / cos_theta) * Li * cos_theta / pdf => f * Li
-        sample.pdf = 1;
-        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::specluar;
+        #ifdef KY_RELEASE
+            #pragma omp critical
+        #endif // !KY_RELEASE
+            {
+                bounds = bounds.join(local_bounds);
+                centroid_bounds = centroid_bounds.join(local_centroid_bounds);
+            }
+        }
 
-        CHECK_DEBUG(sample.f.is_valid());
-        return sample;
-    }
+        int axis = centroid_bounds.max_extent();
+        int mid = split(primitive_infos, begin, end, bounds, centroid_bounds, axis);
 
-private:
-    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Mirror
-    color_t reflectance_{};
-};
+        if (mid == begin || mid == end)
+        {
+            node_t& leaf = nodes[node_index];
+            leaf.bounds = bounds;
+            leaf.offset = begin;
+            leaf.primitive_num = (uint16_t)primitive_num;
+            return;
+        }
 
+        int children = (int)nodes.size();
+        nodes.emplace_back();
+        nodes.emplace_back();
 
+        node_t& interior = nodes[node_index];
+        interior.bounds = bounds;
+        interior.offset = children;
+        interior.axis = (uint8_t)axis;
 
-/*
-   https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular%20transmission%20projections.svg
+        build(nodes, children,     primitive_infos, begin, mid, subtree_primitive_num, subtrees);
+        build(nodes, children + 1, primitive_infos, mid,   end, subtree_primitive_num, subtrees);
+    }
 
-   ray            N
-    *             |             *
-       *     θ_i  |          *
-          *       |       *
-             *    |    *            outside ior: eta_i
-                * | *
-    - - - - - - - - - - - - - - - - interface
-                  |*
-                  | *               inside ior:  eta_t
-                  |  *
-                  |   *
-                  |    *
-                  | θ_t *
-*/
-class fresnel_specular_t : public bsdf_t
-{
-public:
-    fresnel_specular_t(
-    const frame_t& shading_frame, float_t eta_i, float_t eta_t, color_t reflectance, color_t transmittance) :
-        bsdf_t(shading_frame),
-        eta_i_{ eta_i },
-        eta_t_{ eta_t },
-        reflectance_{ reflectance },
-        transmittance_{ transmittance }
+    void build_spatial(const primitive_list_t& primitive_list)
     {
-    }
+        unique_primitive_list_ = primitive_list;
 
-    bool is_delta() const override { return true; }
+        int primitive_num = (int)primitive_list.size();
+        if (primitive_num == 0)
+            return;
 
-    color_t eval_(vec3_t wo, vec3_t wi) const override { return color_t(); }
-    float_t pdf_(vec3_t wo, vec3_t wi) const override { return 0; }
+        // a reference is a whole or clipped primitive, `centroid` is of the clipped bounds
+        std::vector<primitive_info_t> references(primitive_num);
+        bounds3_t bounds;
+        for (int i = 0; i < primitive_num; ++i)
+        {
+            bounds3_t reference_bounds = primitive_list[i].world_bound();
+            references[i] = { reference_bounds, reference_bounds.centroid(), i };
+            bounds = bounds.join(reference_bounds);
+        }
 
-    bsdf_sample_t sample_(vec3_t wo, float2_t random) const override
-    {
-        // https://www.pbr-book.org/3ed-2018/Reflection_Models/Specular_Reflection_and_Transmission#FresnelReflectance
-        // 
-        // https://github.com/infancy/pbrt-v3/blob/master/src/materials/glass.cpp#L64-L69   full smooth glass
-        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.h#L440-L463   class FresnelSpecular;
-        // https://github.com/infancy/pbrt-v3/blob/master/src/core/reflection.cpp#L627-L667 FresnelSpecular::Sample_f(...)
+        spatial_build_t context{ primitive_list };
+        context.min_overlap_area = k_min_spatial_overlap * bounds.surface_area();
+        context.reference_budget = (int)(spatial_split_budget_ * primitive_num);
 
+        nodes_.reserve(2 * primitive_num - 1);
+        primitive_list_.reserve(primitive_num);
+        nodes_.emplace_back();
+        build_spatial(context, 0, std::move(references), 0);
+    }
 
-        bsdf_sample_t sample;
+    struct spatial_build_t
+    {
+        const primitive_list_t& primitive_list;
+        float_t min_overlap_area{}; // smaller overlap of object split children isn't worth spatial splits
+        int reference_budget{}; // duplicated references left
+    };
 
-        // percentage of light's reflect and refract
-        float_t reflect_percent = fresnel_dielectric(cos_theta(wo), eta_i_, eta_t_);
-        float_t refract_percent = 1 - reflect_percent;
+    // build subtree of `nodes_[node_index]` from `references`, leaf references are appended to `primitive_list_`
+    void build_spatial(spatial_build_t& context, int node_index, std::vector<primitive_info_t> references, int depth)
+    {
+        int reference_num = (int)references.size();
 
-        // and probability of single ray is reflect or refract
-        float_t Pr_reflect = reflect_percent, Pr_refract = refract_percent;
+        bounds3_t bounds, centroid_bounds;
+        for (const primitive_info_t& reference : references)
+        {
+            bounds = bounds.join(reference.bounds);
+            centroid_bounds = centroid_bounds.join(reference.centroid);
+        }
 
-        // Russian roulette
-        if (random[0] < Pr_reflect)
+        // object split, reorders `references` in place
+        int axis = centroid_bounds.max_extent();
+        int mid = split(references.data(), 0, reference_num, bounds, centroid_bounds, axis);
+        bool is_object_leaf = mid == 0 || mid == reference_num;
+
+        float_t object_cost = (float_t)reference_num;
+        bounds3_t overlap = bounds;
+        if (!is_object_leaf)
         {
-            // specular reflection
+            bounds3_t left_bounds, right_bounds;
+            for (int i = 0; i < mid; ++i)
+                left_bounds = left_bounds.join(references[i].bounds);
+            for (int i = mid; i < reference_num; ++i)
+                right_bounds = right_bounds.join(references[i].bounds);
+
+            object_cost = k_traversal_cost +
+                (mid * left_bounds.surface_area() + (reference_num - mid) * right_bounds.surface_area()) / bounds.surface_area();
+            overlap = left_bounds.intersect(right_bounds);
+        }
 
-            sample.wi = vec3_t(-wo.x, -wo.y, wo.z);
+        // spatial split only pays off where the object split children overlap a lot
+        std::vector<primitive_info_t> left, right;
+        bool is_spatial = false;
+        if (context.reference_budget > 0 && depth < k_max_spatial_depth && reference_num > 1 &&
+            !overlap.is_empty() && overlap.surface_area() > context.min_overlap_area)
+        {
+            is_spatial = spatial_split(context, references, bounds, is_object_leaf ? k_infinity : object_cost, &axis, &left, &right);
+        }
 
-            sample.pdf = Pr_reflect;
-            sample.f = (reflectance_ * reflect_percent) / abs_cos_theta(sample.wi);
-            sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::specluar;
+        if (!is_spatial && is_object_leaf)
+        {
+            node_t& leaf = nodes_[node_index];
+            leaf.bounds = bounds;
+            leaf.offset = (int32_t)primitive_list_.size();
+            leaf.primitive_num = (uint16_t)reference_num;
+
+            for (const primitive_info_t& reference : references)
+                primitive_list_.push_back(context.primitive_list[reference.index]);
+            return;
+        }
 
-            CHECK_DEBUG(sample.f.is_valid());
+        if (!is_spatial)
+        {
+            left.assign(references.begin(), references.begin() + mid);
+            right.assign(references.begin() + mid, references.end());
         }
-        else
+        references = {};
+
+        int children = (int)nodes_.size();
+        nodes_.emplace_back();
+        nodes_.emplace_back();
+
+        node_t& interior = nodes_[node_index];
+        interior.bounds = bounds;
+        interior.offset = children;
+        interior.axis = (uint8_t)axis;
+
+        build_spatial(context, children,     std::move(left),  depth + 1);
+        build_spatial(context, children + 1, std::move(right), depth + 1);
+    }
+
+    // find the best plane in bins of `bounds` alone its longest axis, split `references` there if it's cheaper
+    // than `object_cost` and the budget allows its duplicates, return false otherwise
+    bool spatial_split(spatial_build_t& context, const std::vector<primitive_info_t>& references, const bounds3_t& bounds,
+        float_t object_cost, int* out_axis, std::vector<primitive_info_t>* left, std::vector<primitive_info_t>* right) const
+    {
+        int axis = bounds.max_extent();
+        float_t origin = bounds[0][axis];
+        float_t width = (bounds[1][axis] - origin) / k_spatial_bin_num;
+        if (!(width > 0))
+            return false;
+
+        // a reference enters the bin of its min and exits the bin of its max,
+        // each bin in between takes the part clipped to it
+        struct bin_t
         {
-            // specular refract/transmission
+            bounds3_t bounds{};
+            int enter{};
+            int exit{};
+        };
+        bin_t bins[k_spatial_bin_num]{};
 
-            normal_t normal(0, 0, 1); // use `z` as normal
-            bool into = normal.dot(wo) > 0; // ray from outside going in?
+        auto bin_index = [&](float_t x)
+        {
+            return std::clamp((int)((x - origin) / width), 0, k_spatial_bin_num - 1);
+        };
+        auto plane = [&](int b) { return b == k_spatial_bin_num ? bounds[1][axis] : origin + b * width; };
 
-            normal_t wo_normal = into ? normal : normal * -1;
-            float_t eta = into ? eta_i_ / eta_t_ : eta_t_ / eta_i_;
+        for (const primitive_info_t& reference : references)
+        {
+            int first = bin_index(reference.bounds[0][axis]);
+            int last = bin_index(reference.bounds[1][axis]);
 
-            if (refract(wo, wo_normal, eta, &sample.wi))
+            for (int b = first; b <= last; ++b)
             {
-                sample.pdf = Pr_refract;
-                sample.f = (transmittance_ * refract_percent) / abs_cos_theta(sample.wi);
-                sample.bsdf_type = bsdf_enum_t::transmission | bsdf_enum_t::specluar;
+                bounds3_t clipped = first == last ? reference.bounds :
+                    context.primitive_list[reference.index].clip_bound(reference.bounds.slab(axis, plane(b), plane(b + 1)));
+                bins[b].bounds = bins[b].bounds.join(clipped);
+            }
 
-                CHECK_DEBUG(sample.f.is_valid());
+            bins[first].enter += 1;
+            bins[last].exit += 1;
+        }
+
+        // same sweeps as `split()`
+        float_t right_area[k_spatial_bin_num]{};
+        int right_count[k_spatial_bin_num]{};
+        {
+            bounds3_t right_bounds;
+            int count = 0;
+            for (int i = k_spatial_bin_num - 1; i > 0; --i)
+            {
+                right_bounds = right_bounds.join(bins[i].bounds);
+                count += bins[i].exit;
+
+                right_area[i] = right_bounds.is_empty() ? 0 : right_bounds.surface_area();
+                right_count[i] = count;
+            }
+        }
+
+        float_t min_cost = object_cost;
+        int min_cost_bin = -1;
+        {
+            bounds3_t left_bounds;
+            int count = 0;
+            for (int i = 0; i < k_spatial_bin_num - 1; ++i)
+            {
+                left_bounds = left_bounds.join(bins[i].bounds);
+                count += bins[i].enter;
+
+                int duplicates = count + right_count[i + 1] - (int)references.size();
+                if (count == 0 || right_count[i + 1] == 0 || left_bounds.is_empty() || duplicates > context.reference_budget)
+                    continue;
+
+                float_t cost = k_traversal_cost +
+                    (count * left_bounds.surface_area() + right_count[i + 1] * right_area[i + 1]) / bounds.surface_area();
+
+                if (cost < min_cost)
+                {
+                    min_cost = cost;
+                    min_cost_bin = i;
+                }
+            }
+        }
+
+        float_t leaf_cost = (float_t)references.size();
+        if (min_cost_bin < 0 || ((int)references.size() <= max_primitives_in_node_ && min_cost >= leaf_cost))
+            return false;
+
+        // references straddling the plane go to both sides, clipped
+        float_t split_plane = plane(min_cost_bin + 1);
+        left->clear();
+        right->clear();
+        for (const primitive_info_t& reference : references)
+        {
+            if (reference.bounds[1][axis] <= split_plane)
+            {
+                left->push_back(reference);
+            }
+            else if (reference.bounds[0][axis] >= split_plane)
+            {
+                right->push_back(reference);
             }
             else
             {
-                sample.f = color_t(); // total internal reflection
+                const primitive_t& primitive = context.primitive_list[reference.index];
+                bounds3_t left_bounds = primitive.clip_bound(reference.bounds.slab(axis, -k_infinity, split_plane));
+                bounds3_t right_bounds = primitive.clip_bound(reference.bounds.slab(axis, split_plane, k_infinity));
+
+                if (!left_bounds.is_empty())
+                    left->push_back({ left_bounds, left_bounds.centroid(), reference.index });
+                if (!right_bounds.is_empty())
+                    right->push_back({ right_bounds, right_bounds.centroid(), reference.index });
             }
         }
 
-        return sample;
+        if (left->empty() || right->empty())
+            return false;
+
+        context.reference_budget -= (int)(left->size() + right->size() - references.size());
+        *out_axis = axis;
+        return true;
     }
 
-    /*
-    // smallpt version
-    color_t sample_(vec3_t wo, float2_t random,
-        vec3_t* out_wi, float_t* out_pdf_direction, bsdf_enum_t* out_bsdf_type) const override
+    // partition `primitive_infos[begin, end)` alone `axis`, return `begin` if it should be a leaf
+    int split(primitive_info_t* primitive_infos, int begin, int end,
+        const bounds3_t& bounds, const bounds3_t& centroid_bounds, int axis) const
     {
-        normal_t normal(0, 0, 1);
-        bool into = normal.dot(wo) > 0; // ray from outside going in?
+        int primitive_num = end - begin;
+        if (primitive_num == 1)
+            return begin;
 
-        normal_t wo_normal = into ? normal : normal * -1;
-        float_t eta = into ? etaI_ / etaT_ : etaT_ / etaI_;
+        float_t centroid_min = centroid_bounds[0][axis];
+        float_t centroid_max = centroid_bounds[1][axis];
 
-        if (!refract(wo, wo_normal, eta, out_wi))
+        // all centroids at the same point, no way to split them
+        if (centroid_max == centroid_min)
         {
-            return color_t(); // total internal reflection
+            if (primitive_num <= k_max_leaf_primitives)
+                return begin;
+
+            return begin + primitive_num / 2;
         }
 
-        float_t cos_theta_a = wo.dot(wo_normal);
-        float_t cos_theta_b = (*out_wi).dot(normal);
-        float_t cos_theta_i = into ? cos_theta_a : cos_theta_b;
+        if (primitive_num <= 2 || bounds.surface_area() == 0)
+        {
+            int mid = begin + primitive_num / 2;
+            std::nth_element(primitive_infos + begin, primitive_infos + mid, primitive_infos + end,
+                [axis](const primitive_info_t& a, const primitive_info_t& b)
+                {
+                    return a.centroid[axis] < b.centroid[axis];
+                });
+            return mid;
+        }
 
-        float_t Re = fresnel_dielectric_schlick(cos_theta_a, etaI_, etaT_);
-        float_t Tr = 1 - Re;
+        // bin primitives by centroid
+        constexpr int bucket_num = 12;
+        struct bucket_t
+        {
+            int count{};
+            bounds3_t bounds{};
+        };
+        bucket_t buckets[bucket_num]{};
 
-        if (random[0] < Re)
+        auto bucket_index = [&](point3_t centroid)
         {
-            // Compute specular reflection for _FresnelSpecular_
+            int b = (int)(bucket_num * (centroid[axis] - centroid_min) / (centroid_max - centroid_min));
+            return std::clamp(b, 0, bucket_num - 1);
+        };
 
-            *out_wi = vec3_t(-wo.x, -wo.y, wo.z);
-            *out_pdf_direction = Re; // Russian roulette???
+    #ifdef KY_RELEASE
+        #pragma omp parallel if (primitive_num >= k_parallel_primitives)
+    #endif // !KY_RELEASE
+        {
+            bucket_t local_buckets[bucket_num]{};
+        #ifdef KY_RELEASE
+            #pragma omp for nowait
+        #endif // !KY_RELEASE
+            for (int i = begin; i < end; ++i)
+            {
+                bucket_t& bucket = local_buckets[bucket_index(primitive_infos[i].centroid)];
+                bucket.count += 1;
+                bucket.bounds = bucket.bounds.join(primitive_infos[i].bounds);
+            }
 
-            return (Re * R_) / abs_cos_theta(*out_wi);
+        #ifdef KY_RELEASE
+            #pragma omp critical
+        #endif // !KY_RELEASE
+            for (int b = 0; b < bucket_num; ++b)
+            {
+                buckets[b].count += local_buckets[b].count;
+                buckets[b].bounds = buckets[b].bounds.join(local_buckets[b].bounds);
+            }
         }
-        else
+
+        // sweep from right to left, then from left to right, to get SAH cost of splitting after each bucket
+        float_t right_area[bucket_num]{};
+        int right_count[bucket_num]{};
         {
-            // Compute specular transmission for _FresnelSpecular_
+            bounds3_t right_bounds;
+            int count = 0;
+            for (int i = bucket_num - 1; i > 0; --i)
+            {
+                right_bounds = right_bounds.join(buckets[i].bounds);
+                count += buckets[i].count;
 
-            *out_pdf_direction = Tr;
-            return (T_ * Tr) / abs_cos_theta(*out_wi);
+                right_area[i] = count > 0 ? right_bounds.surface_area() : 0;
+                right_count[i] = count;
+            }
+        }
+
+        float_t min_cost = k_infinity;
+        int min_cost_bucket = -1;
+        {
+            bounds3_t left_bounds;
+            int count = 0;
+            for (int i = 0; i < bucket_num - 1; ++i)
+            {
+                left_bounds = left_bounds.join(buckets[i].bounds);
+                count += buckets[i].count;
+
+                if (count == 0 || right_count[i + 1] == 0)
+                    continue;
+
+                // relative cost: traversal 1/8, intersection 1
+                float_t cost = k_traversal_cost +
+                    (count * left_bounds.surface_area() + right_count[i + 1] * right_area[i + 1]) / bounds.surface_area();
+
+                if (cost < min_cost)
+                {
+                    min_cost = cost;
+                    min_cost_bucket = i;
+                }
+            }
         }
+
+        float_t leaf_cost = (float_t)primitive_num;
+        if (min_cost_bucket < 0 || (primitive_num <= max_primitives_in_node_ && min_cost >= leaf_cost))
+            return begin;
+
+        primitive_info_t* mid = std::partition(primitive_infos + begin, primitive_infos + end,
+            [&](const primitive_info_t& info)
+            {
+                return bucket_index(info.centroid) <= min_cost_bucket;
+            });
+
+        return (int)(mid - primitive_infos);
     }
-    */
 
 private:
-    // outside and inside ior of interface
-    float_t eta_i_{}; // ior_i_
-    float_t eta_t_{}; // ior_t_
-
-    // https://wiki.luxcorerender.org/LuxCoreRender_Materials_Glass
-    // https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_bsdfs.html#smooth-dielectric-material-dielectric
-    // optional factor that can be used to modulate the specular reflection/transmission component. 
-    color_t reflectance_{};
-    color_t transmittance_{};
+    static constexpr int k_max_leaf_primitives = 255;
+    static constexpr int k_max_depth = 64;
+    static constexpr float_t k_traversal_cost = 0.125f; // relative to a primitive intersection
+    static constexpr int k_min_subtree_primitives = 1024; // smaller subtrees aren't worth a thread
+    static constexpr int k_parallel_primitives = 64 * 1024; // bin in parallel above this
+    static constexpr int k_min_packet_rays = 4; // fewer active rays go on one by one
+    static constexpr int k_spatial_bin_num = 16;
+    static constexpr int k_max_spatial_depth = 48; // keep room in the traversal stack of `k_max_depth`
+    static constexpr float_t k_min_spatial_overlap = 1e-5f; // relative to the root surface area
+    static constexpr int k_treelet_bytes = 4096; // a page
+
+    int max_primitives_in_node_{};
+    float_t spatial_split_budget_{}; // max duplicated references per primitive, 0 for no spatial split
+
+    mapped_vector_t<node_t> nodes_{};
+    primitive_list_t primitive_list_{}; // ordered by leaf nodes
+    primitive_list_t unique_primitive_list_{}; // input of spatial split builds, `primitive_list_` has duplicates then
+    surface_soa_t soa_{}; // of `primitive_list_`, only for surfaces
 };
 
+using bvh_accel_t = basic_bvh_accel_t<surface_t>;
 
 
-// physically based(energy conservation) Phong specular reflection model
-// Lafortune and Willems, “Using the modified Phong reflectance model for physically based rendering”, Technical Report http://graphics.cs.kuleuven.be/publications/Phong/
-class phong_specular_reflection_t : public bsdf_t
+
+/*
+   wide BVH collapsed from the binary one, all `N` child bounds of a node are tested by one SIMD slab test
+
+   a wide node starts from the two children of a binary node, then keeps opening the interior child
+   with the largest surface area, until it has `N` children or only leaves left
+
+   interior children of a node are adjacent in `nodes_`, primitives of its leaf children are adjacent in
+   `surface_list_`, so the quantized node only keeps two base indexes and 8-bit primitive counts,
+   and its child bounds are 8-bit grid cells of the node bounds, rounded outward
+
+   https://www.embree.org/papers/2008-SIMD-BVH.pdf (Multi Bounding Volume Hierarchies)
+   https://research.nvidia.com/publication/2017-07_efficient-incoherent-ray-traversal-gpus-through-compressed-wide-bvhs
+*/
+template <int N, bool quantized>
+class wide_bvh_accel_t : public accel_t
 {
 public:
-    phong_specular_reflection_t(const frame_t& shading_frame, /*color_t Kd,*/ color_t Ks, float_t exponent) :
-        bsdf_t(shading_frame),
-        Ks_{ Ks },
-        exponent_{ exponent }
+    wide_bvh_accel_t(surface_list_t surface_list)
     {
+        build_with_stats(std::move(surface_list));
     }
 
-    bool is_delta() const override { return false; }
+    // see `basic_bvh_accel_t`
+    wide_bvh_accel_t(const surface_list_t&, const accel_cache_t& cache)
+    {
+        float_t seconds = timing_seconds([&]()
+        {
+            nodes_ = cache.nodes<node_t>();
+            surface_list_ = cache.surfaces();
+            soa_ = surface_soa_t(surface_list_);
+        });
+
+        world_bound_ = cache.world_bound();
+        stats_ = cache.stats();
+        stats_.build_seconds = seconds;
+    }
+
+    static int node_size() { return sizeof(node_t); }
 
-    color_t eval_(vec3_t wo, vec3_t wi) const override
+    // see `basic_bvh_accel_t::is_valid_nodes()`
+    static bool is_valid_nodes(const uint8_t* data, int node_num, int reference_num)
     {
-        // TODO: confirm
-        if (!same_hemisphere(wo, wi))
-            return color_t{};
+        const node_t* nodes = (const node_t*)data;
+        if (node_num <= 0)
+            return false;
 
-        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
-        const float_t cos_alpha = dot(wr, wi);
+        std::vector<uint8_t> is_visited(node_num);
+        std::vector<std::pair<int, int>> to_visit{ { 0, 1 } }; // node, depth
+        while (!to_visit.empty())
+        {
+            auto [index, depth] = to_visit.back();
+            to_visit.pop_back();
+            if (depth > k_max_depth || is_visited[index])
+                return false;
+            is_visited[index] = true;
+
+            const node_t& node = nodes[index];
+            if (node.child_num > N)
+                return false;
+
+            int32_t offset[N];
+            int32_t primitive_num[N];
+            node.children(offset, primitive_num);
+            for (int i = 0; i < node.child_num; ++i)
+            {
+                if (offset[i] < 0)
+                    return false;
 
-        const color_t rho = Ks_ * (exponent_ + 2.f) * k_inv_2pi;
-        return rho * std::pow(cos_alpha, exponent_);
+                if (primitive_num[i] > 0)
+                {
+                    if ((int64_t)offset[i] + primitive_num[i] > reference_num)
+                        return false;
+                }
+                else
+                {
+                    if (offset[i] >= node_num)
+                        return false;
+
+                    to_visit.push_back({ offset[i], depth + 1 });
+                }
+            }
+        }
+
+        return true;
     }
 
-    float_t pdf_(vec3_t wo, vec3_t wi) const override
+    void store(const accel_cache_t& cache) const
     {
-        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
-        //const float_t cos_alpha = dot(wr, wi);
+        cache.store(nodes_.data(), (int)nodes_.size(), surface_list_, stats_, world_bound_);
+    }
 
-        return cosine_hemisphere_pdf_phong(wr, wi);
+public:
+    bool intersect(const ray_t& ray, hit_t* hit) const override
+    {
+        return traverse<false>(ray, hit);
     }
 
-    bsdf_sample_t sample_(vec3_t wo, float2_t random) const override
+    bool intersect_p(const ray_t& ray) const override
     {
-        bsdf_sample_t sample;
+        return traverse<true>(ray, nullptr);
+    }
 
-        // TODO
-        sample.wi = cosine_hemisphere_sample_phong(random);
+    bounds3_t world_bound() const override
+    {
+        return world_bound_;
+    }
 
-        const vec3_t wr = reflect(wo, vec3_t(0, 0, 1));
-        frame_t frame{ wr };
-        sample.wi = frame.to_world(sample.wi);
+    // wide nodes are allocated after their parent too, a reverse sweep sees children refitted first
+    void refit() override
+    {
+        std::vector<bounds3_t> node_bounds(nodes_.size());
 
-        if (wo.z < 0)
-            sample.wi.z *= -1;
+        for (int n = (int)nodes_.size() - 1; n >= 0; --n)
+        {
+            node_t& node = nodes_[n];
 
-        sample.f = eval_(wo, sample.wi);
-        sample.pdf = pdf_(wo, sample.wi);
-        sample.bsdf_type = bsdf_enum_t::reflection | bsdf_enum_t::glossy;
-        
-        return sample;
+            int32_t offset[N];
+            int32_t primitive_num[N];
+            node.children(offset, primitive_num);
+
+            bounds3_t child_bounds[N];
+            for (int i = 0; i < node.child_num; ++i)
+            {
+                if (primitive_num[i] > 0)
+                {
+                    for (int p = 0; p < primitive_num[i]; ++p)
+                        child_bounds[i] = child_bounds[i].join(surface_list_[offset[i] + p].world_bound());
+                }
+                else
+                {
+                    child_bounds[i] = node_bounds[offset[i]];
+                }
+
+                node_bounds[n] = node_bounds[n].join(child_bounds[i]);
+            }
+
+            set_bounds(node, node_bounds[n], child_bounds);
+        }
+
+        world_bound_ = node_bounds.empty() ? bounds3_t{} : node_bounds[0];
+        soa_ = surface_soa_t(surface_list_);
     }
 
-private:
-    // cosine lobe hemisphere sampling
-    vec3_t cosine_hemisphere_sample_phong(vec2_t random) const
+    void rebuild() override
     {
-        const float_t phi = 2.f * k_pi * random[0];
-        const float_t cos_theta = std::pow(random[1], 1.f / (exponent_ + 1.f));
-        const float_t sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+        build_with_stats(std::move(surface_list_));
+    }
 
-        return vec3_t(
-            std::cos(phi) * sin_theta,
-            std::sin(phi) * sin_theta,
-            cos_theta);
+    // a wide node costs one traversal step, see `basic_bvh_accel_t::sah_cost()`
+    float_t sah_cost() const override
+    {
+        float_t root_area = world_bound_.surface_area();
+        if (nodes_.empty() || root_area == 0)
+            return (float_t)surface_list_.size();
+
+        float_t cost = 0;
+        for (const node_t& node : nodes_)
+        {
+            bounds3_t node_bounds;
+            for (int i = 0; i < node.child_num; ++i)
+            {
+                bounds3_t bounds = child_bounds(node, i);
+                node_bounds = node_bounds.join(bounds);
+                cost += node.primitive_num[i] * bounds.surface_area();
+            }
+
+            cost += k_traversal_cost * node_bounds.surface_area();
+        }
+
+        return cost / root_area;
     }
 
-    float_t cosine_hemisphere_pdf_phong(
-        vec3_t aNormal, vec3_t aDirection) const
+private:
+    using simd_t = simd_float_t<N>;
+
+    // closest hit if `any_hit` is false, otherwise stop at the first hit and leave `hit` untouched
+    template <bool any_hit>
+    bool traverse(const ray_t& ray, hit_t* hit) const
     {
-        const float_t cosTheta = std::max(0.f, dot(aNormal, aDirection));
-        return (exponent_ + 1.f) * std::pow(cosTheta, exponent_) * k_inv_2pi;
+        if (nodes_.empty())
+            return false;
+
+        vec3_t inv_direction(1 / ray.direction().x, 1 / ray.direction().y, 1 / ray.direction().z);
+        int dir_is_neg[3] = { inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0 };
+
+        simd_t origin[3] = {
+            simd_t::broadcast(ray.origin().x), simd_t::broadcast(ray.origin().y), simd_t::broadcast(ray.origin().z) };
+        simd_t inv[3] = {
+            simd_t::broadcast(inv_direction.x), simd_t::broadcast(inv_direction.y), simd_t::broadcast(inv_direction.z) };
+        simd_t conservative = simd_t::broadcast(1 + 2 * error_gamma(3)); // see `bounds3_t::intersect_p()`
+
+        bool is_hit = false;
+
+        // both wide nodes and leaves are pushed, the nearest one on top
+        struct entry_t
+        {
+            int32_t offset{};
+            int32_t primitive_num{}; // 0 for wide node
+            float_t t_near{};
+        };
+        entry_t to_visit[k_max_depth * N];
+        int to_visit_num = 0;
+        to_visit[to_visit_num++] = { 0, 0, 0 };
+
+        while (to_visit_num > 0)
+        {
+            entry_t entry = to_visit[--to_visit_num];
+
+            // a closer surface may have been found since the entry was pushed
+            if (entry.t_near > ray.distance())
+                continue;
+
+            if (entry.primitive_num > 0)
+            {
+                int end = entry.offset + entry.primitive_num;
+                if constexpr (any_hit)
+                {
+                    if (soa_.intersect_p(surface_list_, entry.offset, end, ray))
+                        return true;
+                }
+                else
+                {
+                    if (soa_.intersect(surface_list_, entry.offset, end, ray, hit))
+                        is_hit = true;
+                }
+
+                continue;
+            }
+
+            const node_t& node = nodes_[entry.offset];
+            KY_COUNT_TRAVERSAL(node_visits);
+
+            simd_t t_min = simd_t::broadcast(0);
+            simd_t t_max = simd_t::broadcast(ray.distance());
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                simd_t t_near = (node.bounds(    dir_is_neg[axis], axis) - origin[axis]) * inv[axis];
+                simd_t t_far  = (node.bounds(1 - dir_is_neg[axis], axis) - origin[axis]) * inv[axis];
+
+                // NaN(0 * inf, ray origin on a slab) keeps the previous value
+                t_min = max(t_near, t_min);
+                t_max = min(t_far * conservative, t_max);
+            }
+
+            int mask = less_equal_mask(t_min, t_max) & ((1 << node.child_num) - 1);
+            if (mask == 0)
+                continue;
+
+            float t_near[N];
+            t_min.store(t_near);
+
+            int32_t offset[N];
+            int32_t primitive_num[N];
+            node.children(offset, primitive_num);
+
+            // insertion sort on the stack top, farther children go deeper
+            int first = to_visit_num;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                int i = std::countr_zero((unsigned)mask);
+                entry_t child{ offset[i], primitive_num[i], t_near[i] };
+                if (child.primitive_num == 0)
+                    prefetch(&nodes_[child.offset], sizeof(node_t));
+
+                int j = to_visit_num++;
+                for (; j > first && to_visit[j - 1].t_near < child.t_near; --j)
+                    to_visit[j] = to_visit[j - 1];
+                to_visit[j] = child;
+            }
+        }
+
+        return is_hit;
     }
 
 private:
-    color_t Ks_{};
-    float_t exponent_{};
-};
+    // 8-bit grid of `bounds` on `axis`, `dequantize(quantize_min(x)) <= x <= dequantize(quantize_max(x))`
+    struct quantizer_t
+    {
+        float origin{};
+        float scale{};
 
-#pragma endregion
+        quantizer_t(float min, float max) : origin{ min }
+        {
+            CHECK(std::isfinite(min) && std::isfinite(max), "quantized BVH needs finite bounds");
+            if (!(max > min))
+                return;
 
-#pragma region texture
+            scale = (max - min) / 255;
 
-// TODO
-// class texture_t
+            // a ulp of slack, FMA contraction in the build may round differently from the traversal,
+            // grow by at least a ulp of `origin`, tiny bounds far from origin would take forever otherwise
+            while (std::nextafter(dequantize(255), -k_infinity) < max)
+                scale += std::max(scale, std::abs(origin) / 255) * k_epsilon;
+        }
 
-#pragma endregion
+        float dequantize(int q) const { return origin + (float)q * scale; }
 
-#pragma region material
+        uint8_t quantize_min(float x) const
+        {
+            if (scale == 0)
+                return 0;
 
-class material_t
-{
-public:
-    virtual ~material_t() = default;
+            int q = std::clamp((int)std::floor((x - origin) / scale), 0, 255);
+            while (q > 0 && std::nextafter(dequantize(q), k_infinity) > x)
+                --q;
+            return (uint8_t)q;
+        }
 
-    virtual bsdf_uptr_t scattering(const isect_t& isect) const = 0;
-};
+        uint8_t quantize_max(float x) const
+        {
+            if (scale == 0)
+                return 0;
 
-using material_sptr_t = std::shared_ptr<material_t>;
-using material_list_t = std::vector<material_sptr_t>;
+            int q = std::clamp((int)std::ceil((x - origin) / scale), 0, 255);
+            while (q < 255 && std::nextafter(dequantize(q), -k_infinity) < x)
+                ++q;
+            return (uint8_t)q;
+        }
+    };
 
-class matte_material_t : public material_t
-{
-public:
-    matte_material_t(color_t diffuse_color) :
-        diffuse_color_{ diffuse_color }
+    struct alignas(32) full_node_t
+    {
+        float bounds_[2][3][N]{}; // [min/max][axis][child], children after `child_num` are masked out
+        int32_t offset[N]{}; // interior child: index of `nodes_`; leaf child: first primitive
+        uint8_t primitive_num[N]{}; // 0 for interior child
+        uint8_t child_num{};
+
+        simd_t bounds(int min_max, int axis) const { return simd_t::load(bounds_[min_max][axis]); }
+
+        void children(int32_t* offsets, int32_t* primitive_nums) const
+        {
+            for (int i = 0; i < N; ++i)
+            {
+                offsets[i] = offset[i];
+                primitive_nums[i] = primitive_num[i];
+            }
+        }
+    };
+
+    struct alignas(16) quantized_node_t
+    {
+        float origin[3]{}; // min point of the node bounds
+        float scale[3]{}; // size of a grid cell per axis
+        uint8_t bounds_[2][3][N]{}; // [min/max][axis][child], in grid cells
+        int32_t child_base{}; // first interior child in `nodes_`, the others follow in child order
+        int32_t primitive_base{}; // first primitive of leaf children, the others follow in child order
+        uint8_t primitive_num[N]{}; // 0 for interior child
+        uint8_t child_num{};
+
+        simd_t bounds(int min_max, int axis) const
+        {
+            return simd_t::broadcast(origin[axis]) + simd_t::load(bounds_[min_max][axis]) * simd_t::broadcast(scale[axis]);
+        }
+
+        void children(int32_t* offsets, int32_t* primitive_nums) const
+        {
+            int32_t child = child_base;
+            int32_t primitive = primitive_base;
+            for (int i = 0; i < child_num; ++i)
+            {
+                primitive_nums[i] = primitive_num[i];
+                offsets[i] = primitive_num[i] > 0 ? primitive : child++;
+                primitive += primitive_num[i];
+            }
+        }
+    };
+
+    using node_t = std::conditional_t<quantized, quantized_node_t, full_node_t>;
+    using binary_node_t = bvh_accel_t::node_t;
+
+    // write bounds of the first `node.child_num` children, quantized ones to the grid of `node_bounds`
+    static void set_bounds(node_t& node, const bounds3_t& node_bounds, const bounds3_t* child_bounds)
     {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if constexpr (quantized)
+            {
+                quantizer_t quantizer(node_bounds[0][axis], node_bounds[1][axis]);
+                node.origin[axis] = quantizer.origin;
+                node.scale[axis] = quantizer.scale;
+                for (int i = 0; i < node.child_num; ++i)
+                {
+                    node.bounds_[0][axis][i] = quantizer.quantize_min(child_bounds[i][0][axis]);
+                    node.bounds_[1][axis][i] = quantizer.quantize_max(child_bounds[i][1][axis]);
+                }
+            }
+            else
+            {
+                for (int i = 0; i < node.child_num; ++i)
+                {
+                    node.bounds_[0][axis][i] = child_bounds[i][0][axis];
+                    node.bounds_[1][axis][i] = child_bounds[i][1][axis];
+                }
+            }
+        }
     }
 
-    bsdf_uptr_t scattering(const isect_t& isect) const override
+    // bounds of child `i` as traversal sees them
+    static bounds3_t child_bounds(const node_t& node, int i)
     {
-        return std::make_unique<lambertion_reflection_t>(frame_t(isect.normal), diffuse_color_);
-    }
-
-private:
-    color_t diffuse_color_{}; // or named `Kd`, `C_diff`
-};
+        float_t p[2][3]{};
+        for (int min_max = 0; min_max < 2; ++min_max)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if constexpr (quantized)
+                    p[min_max][axis] = node.origin[axis] + (float)node.bounds_[min_max][axis][i] * node.scale[axis];
+                else
+                    p[min_max][axis] = node.bounds_[min_max][axis][i];
+            }
+        }
 
-class mirror_material_t : public material_t
-{
-public:
-    mirror_material_t(color_t specular_color) :
-        specular_color_{ specular_color }
-    {
+        return bounds3_t(point3_t(p[0][0], p[0][1], p[0][2]), point3_t(p[1][0], p[1][1], p[1][2]));
     }
 
-    bsdf_uptr_t scattering(const isect_t& isect) const override
+    void build_with_stats(surface_list_t surface_list)
     {
-        return std::make_unique<perfect_specular_reflection_t>(frame_t(isect.normal), specular_color_);
-    }
+        nodes_.clear();
+        surface_list_.clear();
+        world_bound_ = bounds3_t{};
 
-private:
-    color_t specular_color_{}; // or named `Ks`, `C_spec`
-};
+        stats_.build_seconds = timing_seconds([&]()
+        {
+            bvh_accel_t binary(std::move(surface_list));
+            if (!binary.nodes_.empty())
+            {
+                surface_list_.reserve(binary.primitive_list_.size());
+                nodes_.reserve(binary.nodes_.size() / (N - 1) + 1);
+                nodes_.emplace_back();
+                collapse(binary.nodes_.vector(), binary.primitive_list_, 0, 0);
+            }
 
-class glass_material_t : public material_t
-{
-public:
-    glass_material_t(
-    float_t eta, color_t reflection_color = color_t{ 1, 1, 1 }, color_t transmission_color = color_t{ 1, 1, 1 }) :
-        eta_{ eta },
-        reflection_color_{ reflection_color },
-        transmission_color_{ transmission_color }
-    {
+            // leaves are copied from `binary`, already ordered by shape type
+            soa_ = surface_soa_t(surface_list_);
+        });
+        stats_.primitive_num = (int)surface_list_.size();
+        stats_.reference_num = stats_.primitive_num;
+        stats_.node_num = (int)nodes_.size();
+        stats_.node_bytes = nodes_.size() * sizeof(node_t);
+        stats_.sah_cost = sah_cost();
     }
 
-    bsdf_uptr_t scattering(const isect_t& isect) const override
+    // fill `nodes_[node_index]` from the subtree of `binary_nodes[binary_index]`
+    void collapse(const std::vector<binary_node_t>& binary_nodes, const surface_list_t& binary_surface_list,
+        int binary_index, int node_index)
     {
-        return std::make_unique<fresnel_specular_t>(frame_t(isect.normal), 1, eta_, reflection_color_, transmission_color_);
-    }
+        int children[N]{};
+        int child_num = 0;
 
-private:
-    float_t eta_{};
-    color_t reflection_color_{}; // or named `Kr`
-    color_t transmission_color_{}; // or named `Kt`
-};
+        const binary_node_t& root = binary_nodes[binary_index];
+        if (root.is_leaf())
+        {
+            children[child_num++] = binary_index;
+        }
+        else
+        {
+            children[child_num++] = root.offset;
+            children[child_num++] = root.offset + 1;
+        }
 
-class plastic_material_t : public material_t
-{
-public:
-    plastic_material_t(color_t diffuse_color, color_t specular_color, float_t shininess) :
-        diffuse_color_{ diffuse_color },
-        specular_color_{ specular_color },
-        exponent_{ shininess } // TODO
-    {
-        //CHECK_DEBUG((Kd_ + Ks_).small_than({ 1, 1, 1 }));
+        while (child_num < N)
+        {
+            int largest = -1;
+            float_t largest_area = -1;
+            for (int i = 0; i < child_num; ++i)
+            {
+                const binary_node_t& child = binary_nodes[children[i]];
+                if (!child.is_leaf() && child.bounds.surface_area() > largest_area)
+                {
+                    largest = i;
+                    largest_area = child.bounds.surface_area();
+                }
+            }
 
-        float_t diffuse = diffuse_color.luminance();
-        float_t specular = specular_color.luminance();
-        float_t luminance = diffuse + specular;
-        
-        diffuse_probility_ = diffuse / luminance;
-        specular_probility_ = specular / luminance;
-    }
+            if (largest < 0)
+                break;
 
-    bsdf_uptr_t scattering(const isect_t& isect) const override
-    {
-        float_t random = rng_.uniform_float();
-        if (random < specular_probility_)
+            int opened = binary_nodes[children[largest]].offset;
+            children[largest] = opened;
+            children[child_num++] = opened + 1;
+        }
+
+        bounds3_t node_bounds;
+        bounds3_t child_bounds[N];
+        for (int i = 0; i < child_num; ++i)
         {
-            return std::make_unique<phong_specular_reflection_t>(frame_t(isect.normal), specular_color_ / specular_probility_, exponent_);
+            child_bounds[i] = binary_nodes[children[i]].bounds;
+            node_bounds = node_bounds.join(child_bounds[i]);
         }
-        else
+
+        if (node_index == 0)
+            world_bound_ = node_bounds;
+
+        node_t node{};
+        node.child_num = (uint8_t)child_num;
+        set_bounds(node, node_bounds, child_bounds);
+
+        if constexpr (quantized)
         {
-            return std::make_unique<lambertion_reflection_t>(frame_t(isect.normal), diffuse_color_ / diffuse_probility_);
+            node.child_base = (int32_t)nodes_.size();
+            node.primitive_base = (int32_t)surface_list_.size();
         }
-    }
 
-private:
-    color_t diffuse_color_{};
-    color_t specular_color_{};
-    float_t exponent_{};
+        int interior_num = 0;
+        int interior_binary[N]{};
+        int interior_wide[N]{};
 
-    float_t diffuse_probility_{};
-    float_t specular_probility_{};
-    mutable rng_t rng_{};
-};
+        for (int i = 0; i < child_num; ++i)
+        {
+            const binary_node_t& child = binary_nodes[children[i]];
 
-// TODO: Normalizing Bling-Phong BRDF
+            if (child.is_leaf())
+            {
+                int32_t offset = (int32_t)surface_list_.size();
+                for (int p = 0; p < child.primitive_num; ++p)
+                    surface_list_.push_back(binary_surface_list[child.offset + p]);
 
-#pragma endregion
+                if constexpr (!quantized)
+                    node.offset[i] = offset;
+                node.primitive_num[i] = (uint8_t)child.primitive_num;
+            }
+            else
+            {
+                int32_t offset = (int32_t)nodes_.size();
+                nodes_.emplace_back();
 
+                if constexpr (!quantized)
+                    node.offset[i] = offset;
 
+                interior_binary[interior_num] = children[i];
+                interior_wide[interior_num] = offset;
+                ++interior_num;
+            }
+        }
 
-#pragma region light
+        nodes_[node_index] = node;
 
-enum class light_flag_t
-{
-    delta_position = 1,
-    delta_direction = 2,
+        for (int i = 0; i < interior_num; ++i)
+            collapse(binary_nodes, binary_surface_list, interior_binary[i], interior_wide[i]);
+    }
 
-    area = 4,
-    infinite = 8
+private:
+    static constexpr int k_max_depth = 64;
+    static constexpr float_t k_traversal_cost = 0.125f; // same as `basic_bvh_accel_t`
+
+    mapped_vector_t<node_t> nodes_{};
+    surface_list_t surface_list_{}; // ordered by leaf children of each node
+    surface_soa_t soa_{}; // of `surface_list_`
+    bounds3_t world_bound_{};
 };
-KY_ENUM_OPERATORS(light_flag_t)
 
-inline bool is_delta_light(light_flag_t flags)
-{
-    return enum_have(flags, light_flag_t::delta_position) ||
-           enum_have(flags, light_flag_t::delta_direction);
-}
 
 
 /*
-// called `LightLeSample` in pbrt-v4, `PositionSample` in mitsuba3
-// mainly used for light.sample_Le()
-struct position_sample_t
+   uniform grid, surfaces are referenced by every cell their bounds overlap, cells are walked in the order
+   the ray passes them(3D-DDA), a hit closer than the next cell boundary ends the walk
+
+   about 3 * cbrt(n) cells along the longest axis, each cell is a range of `surface_list_` like a leaf,
+   suits scenes of many similar-sized primitives spread evenly, a large primitive is referenced by many cells
+
+   https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Further_Reading
+   A Fast Voxel Traversal Algorithm for Ray Tracing, Amanatides and Woo 1987
+*/
+class grid_accel_t : public accel_t
 {
-    bool is_delta;
-    point3_t position; // maybe zero
-    normal_t normal; // maybe zero
-    ray_t ray;
-    float_t pdf_position = 0;
-    float_t pdf_direction = 0;
-    color_t Le; // for light
+public:
+    grid_accel_t(surface_list_t surface_list) :
+        primitive_list_{ std::move(surface_list) }
+    {
+        rebuild();
+    }
 
-    position_sample_t() = default;
-    position_sample_t(
-    point3_t position, normal_t normal, const ray_t& ray,
-    float_t pdf_position, float_t pdf_direction,
-    color_t emission) :
-        position{ position },
-        normal{ normal },
-        ray(ray),
-        pdf_position(pdf_position),
-        pdf_direction(pdf_direction),
-        Le(emission)
+    bool intersect(const ray_t& ray, hit_t* hit) const override
     {
+        return traverse<false>(ray, hit);
     }
 
-    float_t abs_cos_theta(vec3_t w) const { return is_delta ? 1 : abs_dot(w, normal); }
-};
-*/
+    bool intersect_p(const ray_t& ray) const override
+    {
+        return traverse<true>(ray, nullptr);
+    }
 
-/*
-   called `LightLiSample` in pbrt-v4, `DirectionSample` in mitsuba3
-   mainly used for light.sample_Li()
-*/
-struct light_sample_t // : public position_sample_t
-{
-    point3_t position{};
-    vec3_t wi{}; // isect -> light, alone ray's direction
-    float_t pdf{}; // pdf of direction(convert from pdf of position)
-    color_t Li{}; // for light
+    bounds3_t world_bound() const override { return world_bound_; }
 
-    light_sample_t() = default;
-    light_sample_t(const isect_t& isect, vec3_t wi, float_t pdf, color_t Li) :
-        position{ isect.position },
-        wi{ wi },
-        pdf{ pdf },
-        Li{ Li }
+    // cells follow the scene bounds, moved primitives are binned again by a full build
+    void refit() override { rebuild(); }
+
+    void rebuild() override
     {
+        stats_.build_seconds = timing_seconds([this]() { build(); });
+        stats_.primitive_num = (int)primitive_list_.size();
+        stats_.sah_cost = sah_cost();
     }
-};
 
-class scene_t;
-
-class light_t
-{
-public:
-    virtual ~light_t() = default;
-    light_t(/*light_flag_t flags,*/ point3_t world_position, int samples_num = 1):
-        world_position_{ world_position },
-        samples_num_{ samples_num }
+    // a ray hitting the grid passes a cell with the probability of their surface area ratio, like a BVH node,
+    // all cells are the same size, each costs a step and its references
+    float_t sah_cost() const override
     {
+        float_t root_area = world_bound_.surface_area();
+        if (surface_list_.empty() || root_area == 0)
+            return (float_t)primitive_list_.size();
+
+        int cell_num = resolution_[0] * resolution_[1] * resolution_[2];
+        float_t cell_area = 2 * (cell_width_[0] * cell_width_[1] + cell_width_[1] * cell_width_[2] + cell_width_[2] * cell_width_[0]);
+
+        return (k_traversal_cost * cell_num + surface_list_.size()) * cell_area / root_area;
     }
 
-public:
-    // whether the light is delta distribution(point, directional), or not(area, environment)
-    virtual bool is_delta() const = 0;
-    // whether the light is finite extent (point, area) or not(directional, environment)
-    virtual bool is_finite() const = 0;
+private:
+    void build()
+    {
+        world_bound_ = bounds3_t{};
+        std::vector<bounds3_t> bounds;
+        bounds.reserve(primitive_list_.size());
+        for (const surface_t& surface : primitive_list_)
+        {
+            bounds.push_back(surface.world_bound());
+            world_bound_ = world_bound_.join(bounds.back());
+        }
 
-    // only called from `scene_t`
-    virtual void preprocess(const scene_t& scene);
+        surface_list_.clear();
+        cell_begin_.assign(1, 0);
+        if (primitive_list_.empty())
+        {
+            soa_ = surface_soa_t(surface_list_);
+            return;
+        }
 
-    virtual color_t power() const = 0;
+        vec3_t diagonal = world_bound_.diagonal();
+        float_t max_extent = diagonal[world_bound_.max_extent()];
+        float_t cells_per_unit = max_extent > 0 ? k_density * std::cbrt((float_t)primitive_list_.size()) / max_extent : 0;
 
-    // only work for environment light
-    virtual color_t Le(const ray_t& r) const { return color_t{}; }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            resolution_[axis] = std::clamp((int)std::round(diagonal[axis] * cells_per_unit), 1, k_max_resolution);
+            cell_width_[axis] = diagonal[axis] / resolution_[axis];
+            inv_cell_width_[axis] = cell_width_[axis] > 0 ? 1 / cell_width_[axis] : 0;
+        }
 
-public:
-    // Li means : camera <-wo- isect -wi-> light
+        // count the references of each cell, then place them, cells are in x-major order
+        int cell_num = resolution_[0] * resolution_[1] * resolution_[2];
+        std::vector<int> cell_count(cell_num + 1, 0);
 
-    // sample_light/samle_direction
-    virtual light_sample_t sample_Li(const isect_t& isect, float2_t random) const = 0;
+        auto for_each_cell = [this](const bounds3_t& bound, auto function)
+        {
+            int min[3], max[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                min[axis] = to_cell(bound[0], axis);
+                max[axis] = to_cell(bound[1], axis);
+            }
 
-    virtual float_t pdf_Li(const isect_t& isect, vec3_t world_wi) const = 0;
+            for (int z = min[2]; z <= max[2]; ++z)
+                for (int y = min[1]; y <= max[1]; ++y)
+                    for (int x = min[0]; x <= max[0]; ++x)
+                        function(cell_index(x, y, z));
+        };
 
-protected:
-    point3_t world_position_;
-    int samples_num_;
-};
+        for (const bounds3_t& bound : bounds)
+            for_each_cell(bound, [&](int cell) { ++cell_count[cell + 1]; });
 
-using light_sptr_t = std::shared_ptr<light_t>;
-using light_list_t = std::vector<light_sptr_t>;
+        cell_begin_.resize(cell_num + 1);
+        for (int cell = 0; cell < cell_num; ++cell)
+            cell_begin_[cell + 1] = cell_begin_[cell] + cell_count[cell + 1];
 
-class point_light_t : public light_t
-{
-public:
-    point_light_t(point3_t world_position, int samples_num, color_t intensity) :
-        light_t(world_position, samples_num),
-        intensity_{ intensity }
-    {
+        std::vector<int> cell_end(cell_begin_.begin(), cell_begin_.end() - 1);
+        surface_list_.resize(cell_begin_.back());
+        for (int i = 0; i < (int)primitive_list_.size(); ++i)
+            for_each_cell(bounds[i], [&](int cell) { surface_list_[cell_end[cell]++] = primitive_list_[i]; });
+
+        for (int cell = 0; cell < cell_num; ++cell)
+            surface_soa_t::sort_by_shape(surface_list_.begin() + cell_begin_[cell], surface_list_.begin() + cell_begin_[cell + 1]);
+        soa_ = surface_soa_t(surface_list_);
+
+        stats_.reference_num = (int)surface_list_.size();
+        stats_.node_num = cell_num;
+        stats_.node_bytes = cell_begin_.size() * sizeof(int);
     }
 
-    bool is_delta() const override { return true; }
-    bool is_finite() const override { return true; }
+    int to_cell(point3_t p, int axis) const
+    {
+        int cell = (int)((p[axis] - world_bound_[0][axis]) * inv_cell_width_[axis]);
+        return std::clamp(cell, 0, resolution_[axis] - 1);
+    }
 
-    color_t power() const override { return 4 * k_pi * intensity_; }
+    int cell_index(int x, int y, int z) const { return (z * resolution_[1] + y) * resolution_[0] + x; }
 
-public:
-    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
+    template <bool any_hit>
+    bool traverse(const ray_t& ray, hit_t* hit) const
     {
-        light_sample_t sample;
-        sample.position = world_position_;
-        sample.wi = normalize(world_position_ - isect.position);
-        sample.pdf = 1.f;
-        /*
-          if a sphere hold the point light, then:
-              $$ \Phi= A E = \frac{A I} {l^{2}} $$, where $$ A = 4 \pi r^{2} $$
+        vec3_t inv_direction(1 / ray.direction().x, 1 / ray.direction().y, 1 / ray.direction().z);
 
-          or from the definition:
-              $$ \mathrm{d} \Phi= \mathrm{d} A E = \frac{\mathrm{d} A I} {l^{2}} $$
+        float_t t0, t1;
+        if (surface_list_.empty() || !world_bound_.intersect_p(ray.origin(), inv_direction, ray.distance(), &t0, &t1))
+            return false;
 
-          finally we have:
-             $$ E = \frac{I}{l^{2}}$$
+        // set up the walk from the cell the ray enters
+        point3_t entry = ray(t0);
+        int cell[3], step[3], out[3];
+        float_t next_crossing[3], delta[3];
 
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            cell[axis] = to_cell(entry, axis);
+            float_t direction = ray.direction()[axis];
 
-          as for `Lo = f * Li * cos_theta / pdf`,
+            if (direction == 0)
+            {
+                next_crossing[axis] = k_infinity;
+                delta[axis] = k_infinity;
+                step[axis] = 0;
+                out[axis] = -1;
+            }
+            else if (direction > 0)
+            {
+                float_t boundary = world_bound_[0][axis] + (cell[axis] + 1) * cell_width_[axis];
+                next_crossing[axis] = t0 + (boundary - entry[axis]) * inv_direction[axis];
+                delta[axis] = cell_width_[axis] * inv_direction[axis];
+                step[axis] = 1;
+                out[axis] = resolution_[axis];
+            }
+            else
+            {
+                float_t boundary = world_bound_[0][axis] + cell[axis] * cell_width_[axis];
+                next_crossing[axis] = t0 + (boundary - entry[axis]) * inv_direction[axis];
+                delta[axis] = -cell_width_[axis] * inv_direction[axis];
+                step[axis] = -1;
+                out[axis] = -1;
+            }
+        }
 
-          for area light:
-              Lo = f * Li * cos_theta / pdf = f * (Li * cos_theta * projected_solid_angle), see `shape::pdf_direction(...)`
+        bool is_hit = false;
 
-          for point light:
-              Lo = f * Li * cos_theta / pdf = f * (E * cos_theta / 1), it's no problem
-        */
-        sample.Li = intensity_ / distance_squared(world_position_, isect.position);
+        while (true)
+        {
+            KY_COUNT_TRAVERSAL(node_visits);
 
-        return sample;
-    }
+            int index = cell_index(cell[0], cell[1], cell[2]);
+            if constexpr (any_hit)
+            {
+                if (soa_.intersect_p(surface_list_, cell_begin_[index], cell_begin_[index + 1], ray))
+                    return true;
+            }
+            else
+            {
+                if (soa_.intersect(surface_list_, cell_begin_[index], cell_begin_[index + 1], ray, hit))
+                    is_hit = true;
+            }
 
-    float_t pdf_Li(
-        const isect_t& isect, vec3_t world_wi) const override
-    {
-        return 0;
+            // step across the nearest boundary, unless a hit comes before it
+            int axis = next_crossing[0] < next_crossing[1] ?
+                (next_crossing[0] < next_crossing[2] ? 0 : 2) :
+                (next_crossing[1] < next_crossing[2] ? 1 : 2);
+            if (ray.distance() < next_crossing[axis])
+                break;
+
+            cell[axis] += step[axis];
+            if (cell[axis] == out[axis])
+                break;
+            next_crossing[axis] += delta[axis];
+        }
+
+        return is_hit;
     }
 
 private:
-    color_t intensity_{};
+    static constexpr float_t k_density = 3; // cells along the longest axis per cube root of the primitive count
+    static constexpr float_t k_traversal_cost = 0.125f; // a cell step, same as `basic_bvh_accel_t`
+    static constexpr int k_max_resolution = 128;
+
+    surface_list_t primitive_list_{};
+    surface_list_t surface_list_{}; // references of each cell in order, a surface overlapping many cells repeats
+    std::vector<int> cell_begin_{}; // references of cell i are `surface_list_[cell_begin_[i], cell_begin_[i + 1])`
+    surface_soa_t soa_{}; // of `surface_list_`
+    bounds3_t world_bound_{};
+
+    int resolution_[3]{};
+    float_t cell_width_[3]{};
+    float_t inv_cell_width_[3]{};
 };
 
-// use a disk to simulate
-class direction_light_t : public light_t
+
+
+/*
+   kd-tree, space is split by axis-aligned planes placed by SAH over the bound edges of the primitives,
+   a primitive straddling a plane goes to both sides, leaves don't overlap so the walk front to back
+   stops at the first leaf holding a hit
+
+   interior nodes are followed by their below child, the above child is at `offset`, like `basic_bvh_accel_t`
+   the split planes are part of the tree, so `refit()` builds it again
+
+   https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Kd-Tree_Accelerator
+*/
+class kd_tree_accel_t : public accel_t
 {
 public:
-    direction_light_t(point3_t world_position, int samples_num, color_t irradiance, const vec3_t world_direction) :
-        light_t(world_position, samples_num),
-        irradiance_{ irradiance },
-        world_direction_{ normalize(world_direction) },
-        frame_{ world_direction }
+    kd_tree_accel_t(surface_list_t surface_list, int max_primitives_in_node = 1) :
+        primitive_list_{ std::move(surface_list) },
+        max_primitives_in_node_{ std::max(max_primitives_in_node, 1) }
     {
+        rebuild();
     }
 
-public:
-    bool is_delta() const override { return true; }
-    bool is_finite() const override { return false; }
-
-    void preprocess(const scene_t& scene) override;
-
-    color_t power() const override
+    bool intersect(const ray_t& ray, hit_t* hit) const override
     {
-        return power_;
+        return traverse<false>(ray, hit);
     }
 
-public:
-    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
+    bool intersect_p(const ray_t& ray) const override
     {
-        light_sample_t sample;
-        sample.wi = -world_direction_;
-        sample.position = isect.position + sample.wi * 2 * world_radius_;
-        sample.pdf = 1;
-        // both delta light, same as point_light_t::sample_Li(...)
-        sample.Li = irradiance_;
-
-        return sample;
+        return traverse<true>(ray, nullptr);
     }
 
-    float_t pdf_Li(
-        const isect_t& isect, vec3_t world_wi) const override
+    bounds3_t world_bound() const override { return world_bound_; }
+
+    void refit() override { rebuild(); }
+
+    void rebuild() override
     {
-        return 0;
+        stats_.build_seconds = timing_seconds([this]() { build(); });
+        stats_.primitive_num = (int)primitive_list_.size();
+        stats_.sah_cost = sah_cost();
     }
 
-private:
-    color_t irradiance_{};
+    // see `basic_bvh_accel_t::sah_cost()`, node bounds aren't stored, they're cut from the scene bounds by the planes
+    float_t sah_cost() const override
+    {
+        float_t root_area = world_bound_.surface_area();
+        if (nodes_.empty() || root_area == 0)
+            return (float_t)primitive_list_.size();
 
-    point3_t world_center_{};
-    float_t world_radius_{};
-    float_t area_{};
-    color_t power_{};
+        float_t cost = 0;
+        std::vector<std::pair<int, bounds3_t>> to_visit{ { 0, world_bound_ } };
+        while (!to_visit.empty())
+        {
+            auto [index, bounds] = to_visit.back();
+            to_visit.pop_back();
 
-    unit_vec3_t world_direction_{};
-    frame_t frame_{};
-};
+            const node_t& node = nodes_[index];
+            if (node.is_leaf())
+            {
+                cost += node.primitive_num * bounds.surface_area();
+                continue;
+            }
 
-class area_light_t : public light_t
-{
-public:
-    area_light_t(point3_t world_position, int samples_num, color_t radiance, const shape_t* shape):
-        light_t(world_position, samples_num),
-        radiance_{ radiance },
-        shape_{ shape },
-        power_{ radiance_ * shape->area() * k_pi }
-    {
-    }
+            cost += k_traversal_cost / k_intersect_cost * bounds.surface_area();
+            to_visit.push_back({ index + 1, bounds.slab(node.axis, -k_infinity, node.split) });
+            to_visit.push_back({ node.offset, bounds.slab(node.axis, node.split, k_infinity) });
+        }
 
-public:
-    bool is_delta() const override { return false; }
-    bool is_finite() const override { return true; }
+        return cost / root_area;
+    }
 
-    color_t power() const override
+private:
+    struct node_t
     {
-        return power_;
-    }
+        float_t split{}; // position of the plane alone `axis`, interior nodes only
+        int32_t offset{}; // above child of interior nodes, first surface of leaves
+        int32_t primitive_num{};
+        int32_t axis{}; // 3 for leaves
 
-public:
-    /*
-       isect
-       ----
-         ^    ^
-          \   |
-        wo \  | normal
-            \ |
-             \|
-           -------
-         light_isect
-    */
-    // TODO
-    color_t Le(const isect_t& light_isect, vec3_t wo) const
+        bool is_leaf() const { return axis == 3; }
+    };
+
+    struct edge_t
     {
-        return (dot(light_isect.normal, wo) > 0) ? radiance_ : color_t();
-    }
+        float_t t{};
+        int primitive{};
+        bool is_start{};
+    };
 
-public:
-    // sample direction by sample potision on shape
-    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
+    void build()
     {
-        light_sample_t sample;
-        isect_t light_isect = shape_->sample_direction(isect, random, &sample.pdf);
-        sample.position = light_isect.position;
+        nodes_.clear();
+        surface_list_.clear();
+        world_bound_ = bounds3_t{};
 
-        if (sample.pdf == 0 || (light_isect.position - isect.position).magnitude_squared() == 0)
+        int primitive_num = (int)primitive_list_.size();
+        std::vector<bounds3_t> bounds;
+        bounds.reserve(primitive_num);
+        for (const surface_t& surface : primitive_list_)
         {
-            sample.Li = color_t{};
+            bounds.push_back(surface.world_bound());
+            world_bound_ = world_bound_.join(bounds.back());
         }
-        else
+
+        if (primitive_num > 0)
         {
-            sample.wi = normalize(light_isect.position - isect.position);
-            sample.Li = Le(light_isect, -sample.wi);
+            int max_depth = std::min((int)std::round(8 + 1.3f * std::log2((float_t)primitive_num)), k_max_depth);
+
+            std::vector<int> primitive_indices(primitive_num);
+            std::iota(primitive_indices.begin(), primitive_indices.end(), 0);
+
+            // scratch space shared by all nodes, the above primitives of each level are kept until their subtree is built
+            std::vector<edge_t> edges[3];
+            for (auto& axis_edges : edges)
+                axis_edges.resize(2 * (size_t)primitive_num);
+            std::vector<int> below_indices(primitive_num);
+            std::vector<int> above_indices((size_t)(max_depth + 1) * primitive_num);
+
+            build_node(world_bound_, bounds, primitive_indices.data(), primitive_num, max_depth,
+                edges, below_indices.data(), above_indices.data(), 0);
         }
 
-        return sample;
+        soa_ = surface_soa_t(surface_list_);
+
+        stats_.reference_num = (int)surface_list_.size();
+        stats_.node_num = (int)nodes_.size();
+        stats_.node_bytes = nodes_.size() * sizeof(node_t);
     }
 
-    float_t pdf_Li(
-        const isect_t& isect, vec3_t world_wi) const override
+    void build_node(const bounds3_t& node_bounds, const std::vector<bounds3_t>& bounds,
+        const int* primitive_indices, int primitive_num, int depth,
+        std::vector<edge_t> edges[3], int* below_indices, int* above_indices, int bad_refines)
     {
-        return shape_->pdf_direction(isect, world_wi);
-    }
+        int node_index = (int)nodes_.size();
+        nodes_.emplace_back();
 
-private:
-    color_t radiance_{};
-    color_t power_{};
-    const shape_t* shape_{};
-};
+        auto make_leaf = [&]()
+        {
+            node_t& node = nodes_[node_index];
+            node.axis = 3;
+            node.offset = (int32_t)surface_list_.size();
+            node.primitive_num = primitive_num;
+
+            for (int i = 0; i < primitive_num; ++i)
+                surface_list_.push_back(primitive_list_[primitive_indices[i]]);
+            surface_soa_t::sort_by_shape(surface_list_.begin() + node.offset, surface_list_.end());
+        };
 
-// constant_environment_light_t
-// use a sphere hold all the scene to simulate
-class environment_light_t : public light_t
-{
-public:
-    environment_light_t(point3_t world_position, int samples_num, color_t radiance) :
-        light_t(world_position, samples_num),
-        radiance_{ radiance }
-    {
-    }
+        float_t total_area = node_bounds.surface_area();
+        if (primitive_num <= max_primitives_in_node_ || depth == 0 || !(total_area > 0))
+        {
+            make_leaf();
+            return;
+        }
 
-public:
-    bool is_delta() const override { return false; }
-    bool is_finite() const override { return false; }
+        // choose the plane of the lowest cost, along the longest axis first, then the other two
+        int best_axis = -1, best_offset = -1;
+        float_t best_cost = k_infinity;
+        float_t old_cost = k_intersect_cost * primitive_num;
+        vec3_t diagonal = node_bounds.diagonal();
 
-    void preprocess(const scene_t& scene) override;
+        int axis = node_bounds.max_extent();
+        for (int retries = 0; retries < 3 && best_axis == -1; ++retries, axis = (axis + 1) % 3)
+        {
+            std::vector<edge_t>& axis_edges = edges[axis];
+            for (int i = 0; i < primitive_num; ++i)
+            {
+                int primitive = primitive_indices[i];
+                axis_edges[2 * i]     = { bounds[primitive][0][axis], primitive, true };
+                axis_edges[2 * i + 1] = { bounds[primitive][1][axis], primitive, false };
+            }
 
-    color_t power() const override
-    {
-        return power_;
-    }
+            // a start comes before an end at the same position, a flat primitive stays on one side
+            std::sort(axis_edges.begin(), axis_edges.begin() + 2 * primitive_num, [](const edge_t& a, const edge_t& b)
+            {
+                return a.t == b.t ? a.is_start > b.is_start : a.t < b.t;
+            });
 
-public:
-    color_t Le(const ray_t& ray) const
-    {
-        return radiance_;
-    }
+            int other0 = (axis + 1) % 3, other1 = (axis + 2) % 3;
+            int below_num = 0, above_num = primitive_num;
 
-public:
-    light_sample_t sample_Li(const isect_t& isect, float2_t random) const override
-    {
-        light_sample_t sample;
-        sample.wi = uniform_sphere_sample(random);
-        sample.position = isect.position + sample.wi * 2 * world_radius_;
+            for (int i = 0; i < 2 * primitive_num; ++i)
+            {
+                if (!axis_edges[i].is_start)
+                    --above_num;
 
-        float_t theta = spherical_theta(sample.wi);
-        float_t sin_theta = std::sin(theta);
-        sample.pdf = 1 / (2 * k_pi * k_pi * sin_theta);
-        if (sin_theta == 0)
-            sample.pdf = 0;
+                float_t t = axis_edges[i].t;
+                if (t > node_bounds[0][axis] && t < node_bounds[1][axis])
+                {
+                    float_t below_area = 2 * (diagonal[other0] * diagonal[other1] +
+                        (t - node_bounds[0][axis]) * (diagonal[other0] + diagonal[other1]));
+                    float_t above_area = 2 * (diagonal[other0] * diagonal[other1] +
+                        (node_bounds[1][axis] - t) * (diagonal[other0] + diagonal[other1]));
+
+                    float_t empty_bonus = (below_num == 0 || above_num == 0) ? k_empty_bonus : 0;
+                    float_t cost = k_traversal_cost + k_intersect_cost * (1 - empty_bonus) *
+                        (below_area * below_num + above_area * above_num) / total_area;
+
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_offset = i;
+                    }
+                }
 
-        sample.Li = radiance_;
+                if (axis_edges[i].is_start)
+                    ++below_num;
+            }
+        }
 
-        return sample;
+        // a few splits costing more than the leaf may still pay off further down
+        if (best_cost > old_cost)
+            ++bad_refines;
+        if ((best_cost > 4 * old_cost && primitive_num < 16) || best_axis == -1 || bad_refines == 3)
+        {
+            make_leaf();
+            return;
+        }
+
+        const std::vector<edge_t>& axis_edges = edges[best_axis];
+        int below_num = 0, above_num = 0;
+        for (int i = 0; i < best_offset; ++i)
+            if (axis_edges[i].is_start)
+                below_indices[below_num++] = axis_edges[i].primitive;
+        for (int i = best_offset + 1; i < 2 * primitive_num; ++i)
+            if (!axis_edges[i].is_start)
+                above_indices[above_num++] = axis_edges[i].primitive;
+
+        float_t split = axis_edges[best_offset].t;
+        bounds3_t below_bounds = node_bounds.slab(best_axis, -k_infinity, split);
+        bounds3_t above_bounds = node_bounds.slab(best_axis, split, k_infinity);
+
+        // the below child reads `below_indices` before reusing it
+        build_node(below_bounds, bounds, below_indices, below_num, depth - 1,
+            edges, below_indices, above_indices + primitive_num, bad_refines);
+
+        node_t& node = nodes_[node_index];
+        node.split = split;
+        node.offset = (int32_t)nodes_.size();
+        node.axis = best_axis;
+
+        build_node(above_bounds, bounds, above_indices, above_num, depth - 1,
+            edges, below_indices, above_indices + primitive_num, bad_refines);
     }
 
-    float_t pdf_Li(
-        const isect_t& isect, vec3_t world_wi) const override
+    template <bool any_hit>
+    bool traverse(const ray_t& ray, hit_t* hit) const
     {
-        float_t theta = spherical_theta(world_wi);
-        float_t sin_theta = std::sin(theta);
+        vec3_t inv_direction(1 / ray.direction().x, 1 / ray.direction().y, 1 / ray.direction().z);
 
-        if (sin_theta == 0)
-            return 0;
+        float_t t_min, t_max;
+        if (nodes_.empty() || !world_bound_.intersect_p(ray.origin(), inv_direction, ray.distance(), &t_min, &t_max))
+            return false;
 
-        return 1 / (2 * k_pi * k_pi * sin_theta);
+        struct entry_t
+        {
+            int node{};
+            float_t t_min{}, t_max{};
+        };
+        entry_t to_visit[k_max_depth];
+        int to_visit_num = 0;
+        int current = 0;
+
+        bool is_hit = false;
+
+        while (true)
+        {
+            // `ray.distance()` shrinks once a closer primitive is found, leaves beyond it are skipped,
+            // a NaN range(a ray lying in a split plane) visits both sides
+            if (ray.distance() < t_min)
+                break;
+
+            const node_t& node = nodes_[current];
+            KY_COUNT_TRAVERSAL(node_visits);
+
+            if (!node.is_leaf())
+            {
+                int axis = node.axis;
+                float_t origin = ray.origin()[axis];
+                float_t t_plane = (node.split - origin) * inv_direction[axis];
+
+                bool below_first = (origin < node.split) || (origin == node.split && ray.direction()[axis] <= 0);
+                int first = below_first ? current + 1 : node.offset;
+                int second = below_first ? node.offset : current + 1;
+
+                if (t_plane > t_max || t_plane <= 0)
+                    current = first;
+                else if (t_plane < t_min)
+                    current = second;
+                else
+                {
+                    to_visit[to_visit_num++] = { second, t_plane, t_max };
+                    current = first;
+                    t_max = t_plane;
+                }
+
+                continue;
+            }
+
+            if constexpr (any_hit)
+            {
+                if (soa_.intersect_p(surface_list_, node.offset, node.offset + node.primitive_num, ray))
+                    return true;
+            }
+            else
+            {
+                if (soa_.intersect(surface_list_, node.offset, node.offset + node.primitive_num, ray, hit))
+                    is_hit = true;
+            }
+
+            if (to_visit_num == 0)
+                break;
+
+            const entry_t& entry = to_visit[--to_visit_num];
+            current = entry.node;
+            t_min = entry.t_min;
+            t_max = entry.t_max;
+        }
+
+        return is_hit;
     }
 
 private:
-    color_t radiance_{};
-
-    point3_t world_center_{};
-    float_t world_radius_{};
-    float_t area_{};
-    color_t power_{};
+    static constexpr int k_max_depth = 64;
+    static constexpr float_t k_intersect_cost = 80;
+    static constexpr float_t k_traversal_cost = 1;
+    static constexpr float_t k_empty_bonus = 0.5f;
+
+    surface_list_t primitive_list_{};
+    int max_primitives_in_node_{};
+
+    std::vector<node_t> nodes_{};
+    surface_list_t surface_list_{}; // ordered by leaves, a surface straddling split planes repeats
+    surface_soa_t soa_{}; // of `surface_list_`
+    bounds3_t world_bound_{};
 };
 
-#pragma endregion
 
 
+/*
+   pick an accelerator from a glance at the scene, without building any:
 
-#pragma region surface(primitive)
+   - a few surfaces are cheaper to test one by one
+   - similar-sized surfaces filling the scene bounds evenly suit a grid
+   - sizes varying a lot(a large ground under small props) suit a kd-tree, which splits around big surfaces tightly
+   - otherwise a BVH, as wide as the SIMD registers
 
-struct surface_t
+   see `render_accel_benchmark()` for how they compare
+*/
+accel_enum_t select_accel(const surface_list_t& surface_list)
 {
-    const shape_t* shape{};
-    const material_t* material{};
-    const area_light_t* area_light{};
+    constexpr int k_trivial_max = 32;
+    if ((int)surface_list.size() <= k_trivial_max)
+        return accel_enum_t::trivial;
+
+    bounds3_t world_bound;
+    double size_sum = 0, size_sq_sum = 0;
+    for (const surface_t& surface : surface_list)
+    {
+        bounds3_t bound = surface.world_bound();
+        world_bound = world_bound.join(bound);
+
+        double size = bound.diagonal().magnitude();
+        size_sum += size;
+        size_sq_sum += size * size;
+    }
+
+    // coefficient of variation of the bound diagonals
+    double n = (double)surface_list.size();
+    double mean = size_sum / n;
+    double variance = std::max(size_sq_sum / n - mean * mean, 0.);
+    double size_variation = mean > 0 ? std::sqrt(variance) / mean : 0;
+
+    // ratio of the cells holding some centroid, of a coarse grid of about one centroid per cell
+    int resolution = std::clamp((int)std::cbrt(n), 1, 64);
+    std::vector<bool> is_occupied((size_t)resolution * resolution * resolution, false);
+    for (const surface_t& surface : surface_list)
+    {
+        vec3_t offset = world_bound.offset(surface.world_bound().centroid());
+        int cell[3];
+        for (int axis = 0; axis < 3; ++axis)
+            cell[axis] = std::clamp((int)(offset[axis] * resolution), 0, resolution - 1);
+        is_occupied[((size_t)cell[2] * resolution + cell[1]) * resolution + cell[0]] = true;
+    }
+    double occupancy = (double)std::count(is_occupied.begin(), is_occupied.end(), true) / is_occupied.size();
+
+    if (size_variation < 0.5 && occupancy > 0.5)
+        return accel_enum_t::grid;
+    if (size_variation > 2)
+        return accel_enum_t::kd_tree;
+    return k_simd_width == 8 ? accel_enum_t::bvh8 : accel_enum_t::bvh4;
+}
 
-    bool intersect(const ray_t& ray, isect_t* isect) const
+
+
+// spatial splits may add up to 30% more references for `accel_enum_t::sbvh`
+constexpr float_t k_sbvh_budget = 0.3f;
+
+// map `accel_type_t` from `accel_cache_t` with `KY_ACCEL_CACHE`, or build and store it
+template <typename accel_type_t, typename... args_t>
+accel_uptr_t create_cached_accel(accel_enum_t accel_enum, surface_list_t surface_list, args_t... args)
+{
+#ifdef KY_ACCEL_CACHE
+    accel_cache_t cache(accel_enum, surface_list, accel_type_t::node_size());
+    if (cache.template load<accel_type_t>())
+        return std::make_unique<accel_type_t>(surface_list, cache, args...);
+
+    auto accel = std::make_unique<accel_type_t>(surface_list, args...);
+    accel->store(cache);
+    return accel;
+#else
+    return std::make_unique<accel_type_t>(std::move(surface_list), args...);
+#endif // KY_ACCEL_CACHE
+}
+
+accel_uptr_t create_accel(accel_enum_t accel_enum, surface_list_t surface_list)
+{
+    switch (accel_enum)
+    {
+    case accel_enum_t::trivial:
+        return std::make_unique<trivial_accel_t>(std::move(surface_list));
+    case accel_enum_t::bvh:
+        return create_cached_accel<bvh_accel_t>(accel_enum, std::move(surface_list));
+    case accel_enum_t::sbvh:
+        return create_cached_accel<bvh_accel_t>(accel_enum, std::move(surface_list), 4, k_sbvh_budget);
+    case accel_enum_t::bvh4:
+        return create_cached_accel<wide_bvh_accel_t<4, false>>(accel_enum, std::move(surface_list));
+    case accel_enum_t::bvh8:
+        return create_cached_accel<wide_bvh_accel_t<8, false>>(accel_enum, std::move(surface_list));
+    case accel_enum_t::bvh4_quantized:
+        return create_cached_accel<wide_bvh_accel_t<4, true>>(accel_enum, std::move(surface_list));
+    case accel_enum_t::bvh8_quantized:
+        return create_cached_accel<wide_bvh_accel_t<8, true>>(accel_enum, std::move(surface_list));
+    case accel_enum_t::grid:
+        return std::make_unique<grid_accel_t>(std::move(surface_list));
+    case accel_enum_t::kd_tree:
+        return std::make_unique<kd_tree_accel_t>(std::move(surface_list));
+    case accel_enum_t::automatic:
+    {
+        accel_enum_t selected = select_accel(surface_list);
+        return create_accel(selected, std::move(surface_list));
+    }
+    }
+
+    return nullptr;
+}
+
+
+
+using const_accel_sptr_t = std::shared_ptr<const accel_t>;
+
+/*
+   two-level acceleration: an instance places a shared bottom-level accelerator into the world,
+   rays are transformed into its object space, so copies of an asset don't copy its surfaces,
+   a top-level `basic_bvh_accel_t<instance_t>` spans the instances
+
+   surfaces of an instance are not sampled as lights, `light_list` only knows world space shapes
+
+   https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Primitive_Interface_and_Geometric_Primitives#TransformedPrimitive:ObjectInstancingandAnimatedPrimitives
+*/
+class instance_t
+{
+public:
+    instance_t(const_accel_sptr_t accel, const transform_t& object_to_world) :
+        accel_{ std::move(accel) },
+        object_to_world_{ object_to_world },
+        world_bound_{ object_to_world_.transform_bounds(accel_->world_bound()) }
     {
-        bool hit = shape->intersect(ray, isect);
-        if (hit)
-        {
-            isect->surface_ = this;
-            isect->bsdf_ = material->scattering(*isect);
-            isect->emission_ = area_light ? area_light->Le(*isect, isect->wo) : color_t{};
-        }
+    }
 
-        return hit;
+public:
+    // `hit` is left in object space, see `get_isect()`
+    bool intersect(const ray_t& ray, hit_t* hit) const
+    {
+        float_t scale{};
+        ray_t object_ray = to_object(ray, &scale);
+        if (!accel_->intersect(object_ray, hit))
+            return false;
+
+        ray.set_distance(object_ray.distance() / scale);
+        hit->instance = this;
+        return true;
     }
-};
 
-using surface_list_t = std::vector<surface_t>;
+    // world space intersection of a hit found by `intersect()`
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const
+    {
+        float_t scale{};
+        isect_t isect = hit.surface->get_isect(to_object(ray, &scale), hit);
 
-#pragma endregion
+        isect.position = object_to_world_.transform_point(isect.position);
+        isect.normal = normalize(object_to_world_.transform_normal(isect.normal));
+        isect.wo = -ray.direction();
+        return isect;
+    }
 
-#pragma region accelerator
+    bool intersect_p(const ray_t& ray) const
+    {
+        float_t scale{};
+        return accel_->intersect_p(to_object(ray, &scale));
+    }
 
-enum class accel_enum_t
-{
-    trivial
-    // bvh
-};
+    bounds3_t world_bound() const { return world_bound_; }
+    bounds3_t clip_bound(const bounds3_t& clip) const { return world_bound_.intersect(clip); }
 
-// TODO
-class accel_t
-{
-public:
-    virtual ~accel_t() = default;
-    accel_t(surface_list_t surface_list) :
-        surface_list_{ surface_list }
+private:
+    // object space ray keeps a unit direction, `scale` maps world distance to object distance
+    ray_t to_object(const ray_t& ray, float_t* scale) const
     {
+        const mat4_t& world_to_object = object_to_world_.inverse_matrix();
+
+        vec3_t direction = world_to_object.transform_vector(ray.direction());
+        *scale = direction.magnitude();
+
+        return ray_t{ world_to_object.transform_point(ray.origin()), direction / *scale, ray.distance() * *scale };
     }
 
 private:
-    surface_list_t surface_list_;
+    const_accel_sptr_t accel_;
+    transform_t object_to_world_;
+    bounds3_t world_bound_;
 };
 
+using instance_list_t = std::vector<instance_t>;
+
 #pragma endregion
 
 #pragma region scene
@@ -3073,23 +7764,37 @@ enum class cornell_box_enum_t
 };
 KY_ENUM_OPERATORS(cornell_box_enum_t)
 
+// shapes of `scene_t::create_cornell_box_scene()` a caller may move, whether they're in the scene or not
+struct cornell_box_shapes_t
+{
+    handle_t large_ball{ k_null_handle };
+    handle_t left_ball{ k_null_handle }; // the small mirror one
+    handle_t right_ball{ k_null_handle }; // the small glass one
+};
+
 class scene_t : public nocopyable_t
 {
 public:
     scene_t() = default;
+    // `surface_list` and `instance_list` refer into `pool`, the accelerators own them
     scene_t(
-    const_camera_sptr_t camera,
-    shape_list_t shape_list, material_list_t material_list, light_list_t light_list, 
-    surface_list_t surface_list, environment_light_t* env_light = nullptr) :
+    const_camera_sptr_t camera, scene_pool_t pool,
+    surface_list_t surface_list, handle_t env_light = k_null_handle,
+    accel_enum_t accel_enum = accel_enum_t::bvh, instance_list_t instance_list = {}) :
         camera_{ camera },
-        shape_list_{ shape_list },
-        material_list_{ material_list },
-        light_list_{ light_list },
-        environment_light_{ env_light },
-        surface_list_{ surface_list },
-        accel_{ surface_list_ }
+        pool_{ std::move(pool) },
+        environment_light_{ env_light == k_null_handle ? nullptr : &pool_.lights.get<environment_light_t>(env_light) },
+        accel_enum_{ accel_enum == accel_enum_t::automatic ? select_accel(surface_list) : accel_enum },
+        accel_{ create_accel(accel_enum_, std::move(surface_list)) }
     {
-        for (light_sptr_t& light : light_list_)
+        // an instance is far more expensive to intersect than a surface, keep one per leaf
+        if (!instance_list.empty())
+            instance_accel_ = std::make_unique<basic_bvh_accel_t<instance_t>>(std::move(instance_list), 1);
+
+        for (int i = 0; i < pool_.lights.size(); ++i)
+            light_list_.push_back(pool_.lights[i]);
+
+        for (light_t* light : light_list_)
         {
             light->preprocess(*this);
         }
@@ -3098,20 +7803,85 @@ public:
     }
 
 public:
+    // find the closest hit first, then shade it once
     bool intersect(const ray_t& ray, isect_t* isect) const
     {
-        bool is_hit = false;
+        if (!intersect_geometry(ray, isect))
+            return false;
+
+        isect->scattering(pool_);
+        return true;
+    }
+
+    // closest hit without its bsdf and emission, left to the caller, see `shading_queue_t`
+    bool intersect_geometry(const ray_t& ray, isect_t* isect) const
+    {
+        hit_t hit;
+        if (!find_hit(ray, &hit))
+            return false;
 
-        int surface_num = surface_list_.size();
-        for (int i = 0; i < surface_num; ++i)
+        *isect = get_isect(ray, hit);
+        return true;
+    }
+
+    // closest hits of coherent rays, see `accel_t::intersect_packet()`, bsdfs left to the caller as above
+    void intersect_packet_geometry(const ray_t* rays, int ray_num, isect_t* isects, bool* is_hits) const
+    {
+        hit_t hits[accel_t::k_max_packet_size];
+        find_hit_packet(rays, ray_num, hits, is_hits);
+
+        for (int i = 0; i < ray_num; ++i)
         {
-            if (surface_list_[i].intersect(ray, isect))
-                is_hit = true;
+            if (is_hits[i])
+                isects[i] = get_isect(rays[i], hits[i]);
         }
+    }
+
+    // traversal keeps a compact `hit_t` of the closest hit so far, the full isect is built once at the end
+    bool find_hit(const ray_t& ray, hit_t* hit) const
+    {
+        bool is_hit = accel_->intersect(ray, hit);
+
+        // `ray.distance()` is already shortened by a hit surface
+        if (instance_accel_ && instance_accel_->intersect(ray, hit))
+            is_hit = true;
 
         return is_hit;
     }
 
+    void find_hit_packet(const ray_t* rays, int ray_num, hit_t* hits, bool* is_hits) const
+    {
+        accel_->intersect_packet(rays, ray_num, hits, is_hits);
+
+        if (instance_accel_)
+        {
+            bool is_instance_hits[accel_t::k_max_packet_size];
+            instance_accel_->intersect_packet(rays, ray_num, hits, is_instance_hits);
+            for (int i = 0; i < ray_num; ++i)
+                is_hits[i] = is_hits[i] || is_instance_hits[i];
+        }
+    }
+
+    isect_t get_isect(const ray_t& ray, const hit_t& hit) const
+    {
+        return hit.instance ? hit.instance->get_isect(ray, hit) : hit.surface->get_isect(ray, hit);
+    }
+
+
+    // ray of `occluded()`, stopping just short of `distance`
+    static ray_t shadow_ray(
+        point3_t position,
+        normal_t normal,
+        vec3_t direction,
+        float_t distance)
+    {
+        return ray_t{ offset_ray_origin(position, normal, direction), direction, distance - 2e-3f };
+    }
+    static ray_t shadow_ray(const isect_t& isect1, point3_t isect2)
+    {
+        return shadow_ray(isect1.position, isect1.normal,
+            normalize(isect2 - isect1.position), distance(isect1.position, isect2));
+    }
 
     bool occluded(
         point3_t position,
@@ -3119,9 +7889,8 @@ public:
         vec3_t direction,
         float_t distance) const
     {
-        ray_t ray{ offset_ray_origin(position, normal, direction), direction, distance - 2e-3f };
-        isect_t unused;
-        return intersect(ray, &unused);
+        ray_t ray = shadow_ray(position, normal, direction, distance);
+        return accel_->intersect_p(ray) || (instance_accel_ && instance_accel_->intersect_p(ray));
     }
     bool occluded(const isect_t& isect1, point3_t isect2) const
     {
@@ -3134,21 +7903,52 @@ public:
             normalize(isect2.position - isect1.position), distance(isect1.position, isect2.position));
     }
 
-
-    bounds3_t world_bound() const
+    // `occluded()` of up to `accel_t::k_max_packet_size` shadow rays at once, see `accel_t::intersect_p_packet()`
+    void occluded_packet(const ray_t* rays, int ray_num, bool* is_occludeds) const
     {
-        bounds3_t bounds3;
-        
-        for (const surface_t& surface : surface_list_)
+        accel_->intersect_p_packet(rays, ray_num, is_occludeds);
+
+        if (instance_accel_)
         {
-            bounds3 = bounds3.join(surface.shape->world_bound());
+            for (int i = 0; i < ray_num; ++i)
+                is_occludeds[i] = is_occludeds[i] || instance_accel_->intersect_p(rays[i]);
         }
+    }
+
+
+    bounds3_t world_bound() const
+    {
+        bounds3_t world_bound = accel_->world_bound();
+        if (instance_accel_)
+            world_bound = world_bound.join(instance_accel_->world_bound());
+
+        return world_bound;
+    }
+
+    // call after shapes moved by `shape_t::transform()`, refit the accelerator, or rebuild it when refitting
+    // has degraded it too much, return true if rebuilt; instances can't move, their accelerator is kept
+    bool update(float_t rebuild_ratio = accel_t::k_rebuild_ratio)
+    {
+        bool is_rebuilt = accel_->update(rebuild_ratio);
+
+        // direction and environment lights depend on the world bound
+        for (light_t* light : light_list_)
+            light->preprocess(*this);
 
-        return bounds3;
+        return is_rebuilt;
     }
 
 public:
     const camera_t* get_camera() const { return camera_.get(); }
+    const accel_t& accel() const { return *accel_; }
+    const accel_t* instance_accel() const { return instance_accel_.get(); }
+    // the one `accel()` is built by, chosen by `select_accel()` if the scene is created with `automatic`
+    accel_enum_t accel_enum() const { return accel_enum_; }
+
+    const scene_pool_t& pool() const { return pool_; }
+
+    // move it by `shape_t::transform()` then `update()` the scene
+    shape_t* shape(handle_t handle) { return pool_.shapes.get(handle); }
 
     int light_count() const { return light_list_.size(); }
     const light_list_t& light_list() const
@@ -3166,7 +7966,8 @@ public:
     }
 
 public:
-    static scene_t create_cornell_box_scene(cornell_box_enum_t scene_enum, point2_t film_resolution)
+    static scene_t create_cornell_box_scene(cornell_box_enum_t scene_enum, point2_t film_resolution,
+        accel_enum_t accel_enum = accel_enum_t::bvh, cornell_box_shapes_t* shapes = nullptr)
     {
         // https://github.com/SmallVCM/SmallVCM/blob/master/src/scene.hxx#L132
 
@@ -3199,16 +8000,17 @@ public:
             LOG_ERROR("cannot set both large balls\n");
         }
 
-        material_sptr_t black = std::make_shared<matte_material_t>(color_t());
-        material_sptr_t white = std::make_shared<matte_material_t>(color_t(.8, .8, .8));
-        material_sptr_t red   = std::make_shared<matte_material_t>(color_t(0.803922f, 0.152941f, 0.152941f));
-        material_sptr_t green = std::make_shared<matte_material_t>(color_t(0.156863f, 0.803922f, 0.172549f));
-        material_sptr_t blue  = std::make_shared<matte_material_t>(color_t(0.156863f, 0.172549f, 0.803922f));
+        scene_pool_t pool;
+
+        handle_t black = pool.materials.add(matte_material_t(color_t()));
+        handle_t white = pool.materials.add(matte_material_t(color_t(.8, .8, .8)));
+        handle_t red   = pool.materials.add(matte_material_t(color_t(0.803922f, 0.152941f, 0.152941f)));
+        handle_t green = pool.materials.add(matte_material_t(color_t(0.156863f, 0.803922f, 0.172549f)));
+        handle_t blue  = pool.materials.add(matte_material_t(color_t(0.156863f, 0.172549f, 0.803922f)));
 
-        material_sptr_t glossy = std::make_shared<plastic_material_t>(color_t(.1, .1, .1), color_t(.7, .7, .7), 90.);
-        material_sptr_t mirror_mat = std::make_shared<mirror_material_t>(color_t(1, 1, 1));
-        material_sptr_t glass_mat = std::make_shared<glass_material_t>(1.6);
-        material_list_t material_list{ black, white, red, green, blue, glossy, mirror_mat, glass_mat };
+        handle_t glossy = pool.materials.add(plastic_material_t(color_t(.1, .1, .1), color_t(.7, .7, .7), 90.));
+        handle_t mirror_mat = pool.materials.add(mirror_material_t(color_t(1, 1, 1)));
+        handle_t glass_mat = pool.materials.add(glass_material_t(1.6));
 
         #pragma region shape
 
@@ -3236,11 +8038,11 @@ public:
             vec3_t( 1.28975f,  1.25549f,  1.28002f), // 6
             vec3_t(-1.27029f,  1.25549f,  1.28002f)  // 7
         };
-        shape_sptr_t left   = std::make_shared<rectangle_t>(cb[3], cb[0], cb[4], cb[7]);
-        shape_sptr_t right  = std::make_shared<rectangle_t>(cb[1], cb[2], cb[6], cb[5]);
-        shape_sptr_t back   = std::make_shared<rectangle_t>(cb[0], cb[3], cb[2], cb[1]);
-        shape_sptr_t bottom = std::make_shared<rectangle_t>(cb[0], cb[1], cb[5], cb[4]);
-        shape_sptr_t top    = std::make_shared<rectangle_t>(cb[2], cb[3], cb[7], cb[6]);
+        handle_t left   = pool.shapes.add(rectangle_t(cb[3], cb[0], cb[4], cb[7]));
+        handle_t right  = pool.shapes.add(rectangle_t(cb[1], cb[2], cb[6], cb[5]));
+        handle_t back   = pool.shapes.add(rectangle_t(cb[0], cb[3], cb[2], cb[1]));
+        handle_t bottom = pool.shapes.add(rectangle_t(cb[0], cb[1], cb[5], cb[4]));
+        handle_t top    = pool.shapes.add(rectangle_t(cb[2], cb[3], cb[7], cb[6]));
 
 
         // large ball
@@ -3256,9 +8058,12 @@ public:
         vec3_t left_center  = left_wall_center  + vec3_t(2.f * length_x / 7.f, 0, 0);
         vec3_t right_center = right_wall_center - vec3_t(2.f * length_x / 7.f, 0, 0);
 
-        shape_sptr_t large_ball  = std::make_shared<sphere_t>(large_center, large_radius);
-        shape_sptr_t left_ball   = std::make_shared<sphere_t>(left_center, small_radius);
-        shape_sptr_t right_ball  = std::make_shared<sphere_t>(right_center, small_radius);
+        handle_t large_ball  = pool.shapes.add(sphere_t(large_center, large_radius));
+        handle_t left_ball   = pool.shapes.add(sphere_t(left_center, small_radius));
+        handle_t right_ball  = pool.shapes.add(sphere_t(right_center, small_radius));
+
+        if (shapes)
+            *shapes = { large_ball, left_ball, right_ball };
 
 
         // small light box at the ceiling
@@ -3273,52 +8078,43 @@ public:
             vec3_t( 0.25f,  0.25f, 1.28002f),
             vec3_t(-0.25f,  0.25f, 1.28002f)
         };
-        shape_sptr_t left2   = std::make_shared<rectangle_t>(lb[3], lb[7], lb[4], lb[0]);
-        shape_sptr_t right2  = std::make_shared<rectangle_t>(lb[1], lb[5], lb[6], lb[2]);
-        shape_sptr_t front2  = std::make_shared<rectangle_t>(lb[4], lb[7], lb[6], lb[5]);
-        shape_sptr_t back2   = std::make_shared<rectangle_t>(lb[0], lb[1], lb[2], lb[3]);
-        shape_sptr_t bottom2 = std::make_shared<rectangle_t>(lb[0], lb[4], lb[5], lb[1]);
-
-        shape_list_t shape_list
-        { 
-            left, right, back, bottom, top, 
-            large_ball, left_ball, right_ball,
-            left2, right2, front2, back2, bottom2, 
-        };
+        handle_t left2   = pool.shapes.add(rectangle_t(lb[3], lb[7], lb[4], lb[0]));
+        handle_t right2  = pool.shapes.add(rectangle_t(lb[1], lb[5], lb[6], lb[2]));
+        handle_t front2  = pool.shapes.add(rectangle_t(lb[4], lb[7], lb[6], lb[5]));
+        handle_t back2   = pool.shapes.add(rectangle_t(lb[0], lb[1], lb[2], lb[3]));
+        handle_t bottom2 = pool.shapes.add(rectangle_t(lb[0], lb[4], lb[5], lb[1]));
 
         #pragma endregion
 
 
         #pragma region light
 
-        light_list_t light_list{};
+        // all shapes are added, they stay in place from here
+        handle_t area_light = k_null_handle;
         if (enum_have(scene_enum, light_area))
         {
-            light_list.push_back(
-                std::make_shared<area_light_t>(point3_t(), 1, color_t(25, 25, 25), bottom2.get()));
+            area_light = pool.lights.add(
+                area_light_t(point3_t(), 1, color_t(25, 25, 25), pool.shapes.get(bottom2)));
         }
 
         if (enum_have(scene_enum, light_direction))
         {
-            light_list.push_back(
-                std::make_shared<direction_light_t>(point3_t(), 1, color_t(10, 4, 0), vec3_t(-1, -1.5, -1)));
+            pool.lights.add(
+                direction_light_t(point3_t(), 1, color_t(10, 4, 0), vec3_t(-1, -1.5, -1)));
         }
 
         if (enum_have(scene_enum, light_point))
         {
             float_t I = 70 * k_inv_4pi;
-            light_list.push_back(
-                std::make_shared<point_light_t>(point3_t(0.0, 0.5, 1.0), 1, color_t(I, I, I)));
+            pool.lights.add(
+                point_light_t(point3_t(0.0, 0.5, 1.0), 1, color_t(I, I, I)));
         }
 
-        environment_light_t* environment_light{};
+        handle_t environment_light = k_null_handle;
         if (enum_have(scene_enum, light_environment))
         {
             color_t L = color_t(135. / 255, 206. / 255, 250. / 255);
-            auto light = std::make_shared<environment_light_t>(point3_t(), 1, L);
-            light_list.push_back(light);
-
-            environment_light = light.get();
+            environment_light = pool.lights.add(environment_light_t(point3_t(), 1, L));
         }
 
         #pragma endregion
@@ -3326,41 +8122,43 @@ public:
 
         #pragma region surface
 
+        auto shape = [&pool](handle_t handle) { return pool.shapes.get(handle); };
+
         surface_list_t surface_list
         {
-            {   left.get(),   green.get(), nullptr},
-            {  right.get(),     red.get(), nullptr },
-            {    top.get(),   white.get(), nullptr },
-            { bottom.get(),  glossy.get(), nullptr },
-            {   back.get(),    blue.get(), nullptr },
+            {   shape(left),   green, k_null_handle },
+            {  shape(right),     red, k_null_handle },
+            {    shape(top),   white, k_null_handle },
+            { shape(bottom),  glossy, k_null_handle },
+            {   shape(back),    blue, k_null_handle },
         };
 
         if (enum_have(scene_enum, large_mirror_sphere))
-            surface_list.push_back({ large_ball.get(), mirror_mat.get(), nullptr });
+            surface_list.push_back({ shape(large_ball), mirror_mat, k_null_handle });
         else if (enum_have(scene_enum, large_glass_sphere))
-            surface_list.push_back({ large_ball.get(), glass_mat.get(), nullptr });
+            surface_list.push_back({ shape(large_ball), glass_mat, k_null_handle });
 
         if (enum_have(scene_enum, small_mirror_sphere))
-            surface_list.push_back({ left_ball.get(), mirror_mat.get(), nullptr });
+            surface_list.push_back({ shape(left_ball), mirror_mat, k_null_handle });
         if (enum_have(scene_enum, small_glass_sphere))
-            surface_list.push_back({ right_ball.get(), glass_mat.get(), nullptr });
+            surface_list.push_back({ shape(right_ball), glass_mat, k_null_handle });
 
         if (enum_have(scene_enum, light_area))
         {
-            surface_list.push_back({   left2.get(), white.get(), nullptr });
-            surface_list.push_back({  right2.get(), white.get(), nullptr });
-            surface_list.push_back({  front2.get(), white.get(), nullptr });
-            surface_list.push_back({   back2.get(), white.get(), nullptr });
-            surface_list.push_back({ bottom2.get(), black.get(), (area_light_t*)light_list[0].get() });
+            surface_list.push_back({   shape(left2), white, k_null_handle });
+            surface_list.push_back({  shape(right2), white, k_null_handle });
+            surface_list.push_back({  shape(front2), white, k_null_handle });
+            surface_list.push_back({   shape(back2), white, k_null_handle });
+            surface_list.push_back({ shape(bottom2), black, area_light });
         }
 
         #pragma endregion
 
 
-        return scene_t{ camera, shape_list, material_list, light_list, surface_list, environment_light };
+        return scene_t{ camera, std::move(pool), std::move(surface_list), environment_light, accel_enum };
     }
 
-    static scene_t create_mis_scene(point2_t film_resolution)
+    static scene_t create_mis_scene(point2_t film_resolution, accel_enum_t accel_enum = accel_enum_t::bvh)
     {
         // https://github.com/mitsuba-renderer/mitsuba-data/blob/master/docs/scenes/include/veach_mis.xml
         // TODO: specify film, sampler of this scene
@@ -3386,93 +8184,228 @@ public:
             vec3_t{ 0, -4, 12.5 }, vec3_t{ 0, 1, 0 },
             50, film_resolution);
 
-        material_sptr_t black = std::make_shared<matte_material_t>(color_t());
-        material_sptr_t gray = std::make_shared<matte_material_t>(color_t(.4, .4, .4));
-        material_sptr_t silver = std::make_shared<plastic_material_t>(color_t(0.07, 0.09, 0.13), color_t(1, 1, 1), 5000);
-        material_list_t material_list{ black, gray, silver };
+        scene_pool_t pool;
+
+        handle_t black = pool.materials.add(matte_material_t(color_t()));
+        handle_t gray = pool.materials.add(matte_material_t(color_t(.4, .4, .4)));
+        handle_t silver = pool.materials.add(plastic_material_t(color_t(0.07, 0.09, 0.13), color_t(1, 1, 1), 5000));
 
 #pragma region shape
 
-        shape_sptr_t bottom = std::make_shared<rectangle_t>(
-            point3_t(-10, -4.14615, 10), point3_t(-10, -4.14615, -10), point3_t(10, -4.14615, -10), point3_t(10, -4.14615, 10), true);
-        shape_sptr_t back = std::make_shared<rectangle_t>(
-            point3_t(-10, -10, 2), point3_t(-10, 10, 2), point3_t(10, 10, 2), point3_t(10, -10, 2), true);
-
-        shape_sptr_t plank0 = std::make_shared<rectangle_t>(
-            point3_t(4, -2.70651, -0.25609), point3_t(4, -2.08375, 0.526323), point3_t(-4, -2.08375, 0.526323), point3_t(-4, -2.70651, -0.25609), true);
-        shape_sptr_t plank1 = std::make_shared<rectangle_t>(
-            point3_t(4, -3.28825, -1.36972), point3_t(4, -2.83856, -0.476536), point3_t(-4, -2.83856, -0.476536), point3_t(-4, -3.28825, -1.36972), true);
-        shape_sptr_t plank2 = std::make_shared<rectangle_t>(
-            point3_t(4, -3.73096, -2.70046), point3_t(4, -3.43378, -1.74564), point3_t(-4, -3.43378, -1.74564), point3_t(-4, -3.73096, -2.70046), true);
-        shape_sptr_t plank3 = std::make_shared<rectangle_t>(
-            point3_t(4, -3.99615, -4.0667), point3_t(4, -3.82069, -3.08221), point3_t(-4, -3.82069, -3.08221), point3_t(-4, -3.99615, -4.0667), true);
-
-        shape_sptr_t ball0 = std::make_shared<sphere_t>(point3_t(10, 10, -4), 0.5);
-        shape_sptr_t ball1 = std::make_shared<sphere_t>(point3_t(-3.75, 0, 0), 0.03333);
-        shape_sptr_t ball2 = std::make_shared<sphere_t>(point3_t(-1.25, 0, 0), 0.1);
-        shape_sptr_t ball3 = std::make_shared<sphere_t>(point3_t(1.25, 0, 0), 0.3);
-        shape_sptr_t ball4 = std::make_shared<sphere_t>(point3_t(3.75, 0, 0), 0.9);
-
-        shape_list_t shape_list
-        {
-            bottom, back,
-            plank0, plank1, plank2, plank3,
-            ball0, ball1, ball2, ball3, ball4
-        };
+        handle_t bottom = pool.shapes.add(rectangle_t(
+            point3_t(-10, -4.14615, 10), point3_t(-10, -4.14615, -10), point3_t(10, -4.14615, -10), point3_t(10, -4.14615, 10), true));
+        handle_t back = pool.shapes.add(rectangle_t(
+            point3_t(-10, -10, 2), point3_t(-10, 10, 2), point3_t(10, 10, 2), point3_t(10, -10, 2), true));
+
+        handle_t plank0 = pool.shapes.add(rectangle_t(
+            point3_t(4, -2.70651, -0.25609), point3_t(4, -2.08375, 0.526323), point3_t(-4, -2.08375, 0.526323), point3_t(-4, -2.70651, -0.25609), true));
+        handle_t plank1 = pool.shapes.add(rectangle_t(
+            point3_t(4, -3.28825, -1.36972), point3_t(4, -2.83856, -0.476536), point3_t(-4, -2.83856, -0.476536), point3_t(-4, -3.28825, -1.36972), true));
+        handle_t plank2 = pool.shapes.add(rectangle_t(
+            point3_t(4, -3.73096, -2.70046), point3_t(4, -3.43378, -1.74564), point3_t(-4, -3.43378, -1.74564), point3_t(-4, -3.73096, -2.70046), true));
+        handle_t plank3 = pool.shapes.add(rectangle_t(
+            point3_t(4, -3.99615, -4.0667), point3_t(4, -3.82069, -3.08221), point3_t(-4, -3.82069, -3.08221), point3_t(-4, -3.99615, -4.0667), true));
+
+        handle_t ball0 = pool.shapes.add(sphere_t(point3_t(10, 10, -4), 0.5));
+        handle_t ball1 = pool.shapes.add(sphere_t(point3_t(-3.75, 0, 0), 0.03333));
+        handle_t ball2 = pool.shapes.add(sphere_t(point3_t(-1.25, 0, 0), 0.1));
+        handle_t ball3 = pool.shapes.add(sphere_t(point3_t(1.25, 0, 0), 0.3));
+        handle_t ball4 = pool.shapes.add(sphere_t(point3_t(3.75, 0, 0), 0.9));
 
 #pragma endregion
 
-        // light0 used as envirment light
-        auto light0 = std::make_shared<area_light_t>(point3_t(), 1, color_t(800, 800, 800), ball0.get());
-        auto light1 = std::make_shared<area_light_t>(point3_t(), 1, color_t(901.803, 901.803, 901.803), ball2.get());
-        auto light2 = std::make_shared<area_light_t>(point3_t(), 1, color_t(100, 100, 100), ball1.get());
-        auto light3 = std::make_shared<area_light_t>(point3_t(), 1, color_t(11.1111, 11.1111, 11.1111), ball3.get());
-        auto light4 = std::make_shared<area_light_t>(point3_t(), 1, color_t(1.23457, 1.23457, 1.23457), ball4.get());
+        auto shape = [&pool](handle_t handle) { return pool.shapes.get(handle); };
 
-        light_list_t light_list
-        {
-           light0, light1, light2, light3, light4
-        };
+        // light0 used as envirment light
+        handle_t light0 = pool.lights.add(area_light_t(point3_t(), 1, color_t(800, 800, 800), shape(ball0)));
+        handle_t light1 = pool.lights.add(area_light_t(point3_t(), 1, color_t(901.803, 901.803, 901.803), shape(ball2)));
+        handle_t light2 = pool.lights.add(area_light_t(point3_t(), 1, color_t(100, 100, 100), shape(ball1)));
+        handle_t light3 = pool.lights.add(area_light_t(point3_t(), 1, color_t(11.1111, 11.1111, 11.1111), shape(ball3)));
+        handle_t light4 = pool.lights.add(area_light_t(point3_t(), 1, color_t(1.23457, 1.23457, 1.23457), shape(ball4)));
 
         /*
         float_t I = 70000 * k_inv_4pi;
-        light_list.push_back(
-            std::make_shared<point_light_t>(point3_t(10.0, 10, -4), 1, color_t(I, I, I)));
+        pool.lights.add(
+            point_light_t(point3_t(10.0, 10, -4), 1, color_t(I, I, I)));
         */
 
         surface_list_t surface_list
         {
-            { bottom.get(), gray.get(), nullptr},
-            {   back.get(), gray.get(), nullptr},
+            { shape(bottom), gray, k_null_handle },
+            {   shape(back), gray, k_null_handle },
+
+            { shape(plank0), silver, k_null_handle },
+            { shape(plank1), silver, k_null_handle },
+            { shape(plank2), silver, k_null_handle },
+            { shape(plank3), silver, k_null_handle },
+
+            { shape(ball0),  black, light0 },
+            { shape(ball1),  black, light1 },
+            { shape(ball2),  black, light2 },
+            { shape(ball3),  black, light3 },
+            { shape(ball4),  black, light4 },
+        };
+
+        // TODO
+        return scene_t{ camera, std::move(pool), std::move(surface_list), k_null_handle, accel_enum };
+    }
+
+    // a cube of `particle_num` equal balls on a jittered lattice, `select_accel()` takes a grid for it;
+    // inside a room far larger than the balls it takes a kd-tree, see `render_accel_benchmark()`
+    static scene_t create_particle_scene(point2_t film_resolution, int particle_num = 1000, bool is_in_room = false,
+        accel_enum_t accel_enum = accel_enum_t::bvh)
+    {
+        // world coord: same as cornell box scene, z is up
+
+        int side = std::max((int)std::round(std::cbrt((float_t)particle_num)), 1);
+        float_t half = side / 2.f; // of the cube, a lattice cell is 1 wide
+        float_t room_half = 4 * half;
+
+        const_camera_sptr_t camera = std::make_shared<camera_t>(
+            point3_t{ 0, -half * 3.5f, half * 1.5f },
+            vec3_t{ 0, 1, -0.15f }, vec3_t{ 0, 0.15f, 1 },
+            50, film_resolution);
+
+        scene_pool_t pool;
+
+        handle_t white = pool.materials.add(matte_material_t(color_t(.8, .8, .8)));
+        handle_t orange = pool.materials.add(matte_material_t(color_t(.8, .4, .1)));
+        handle_t glossy = pool.materials.add(plastic_material_t(color_t(0.1f, 0.2f, 0.6f), color_t(.4, .4, .4), 200.));
+
+        rng_t rng(7);
+        std::vector<handle_t> particles;
+        for (int i = 0; i < side * side * side; ++i)
+        {
+            point3_t center(
+                (i % side) - half + 0.5f + (rng.uniform_float() - 0.5f) * 0.2f,
+                (i / side % side) - half + 0.5f + (rng.uniform_float() - 0.5f) * 0.2f,
+                (i / (side * side)) + 0.5f + (rng.uniform_float() - 0.5f) * 0.2f);
+            particles.push_back(pool.shapes.add(sphere_t(center, 0.15f)));
+        }
+
+        // open to the camera
+        std::vector<handle_t> walls;
+        if (is_in_room)
+        {
+            float_t r = room_half;
+            walls.push_back(pool.shapes.add(rectangle_t(
+                point3_t(-r, -r, 0), point3_t(r, -r, 0), point3_t(r, r, 0), point3_t(-r, r, 0)))); // floor
+            walls.push_back(pool.shapes.add(rectangle_t(
+                point3_t(-r, -r, 2 * r), point3_t(-r, r, 2 * r), point3_t(r, r, 2 * r), point3_t(r, -r, 2 * r)))); // ceiling
+            walls.push_back(pool.shapes.add(rectangle_t(
+                point3_t(-r, r, 0), point3_t(r, r, 0), point3_t(r, r, 2 * r), point3_t(-r, r, 2 * r)))); // back
+            walls.push_back(pool.shapes.add(rectangle_t(
+                point3_t(-r, -r, 0), point3_t(-r, r, 0), point3_t(-r, r, 2 * r), point3_t(-r, -r, 2 * r)))); // left
+            walls.push_back(pool.shapes.add(rectangle_t(
+                point3_t(r, -r, 0), point3_t(r, -r, 2 * r), point3_t(r, r, 2 * r), point3_t(r, r, 0)))); // right
+        }
+
+        pool.lights.add(direction_light_t(point3_t(), 1, color_t(3, 3, 3), vec3_t(-1, 1.5, -2)));
+        handle_t sky = pool.lights.add(environment_light_t(point3_t(), 1, color_t(135. / 255, 206. / 255, 250. / 255)));
+
+        surface_list_t surface_list;
+        for (size_t i = 0; i < particles.size(); ++i)
+            surface_list.push_back({ pool.shapes.get(particles[i]), i % 2 ? orange : glossy, k_null_handle });
+        for (handle_t wall : walls)
+            surface_list.push_back({ pool.shapes.get(wall), white, k_null_handle });
+
+        return scene_t{ camera, std::move(pool), std::move(surface_list), sky, accel_enum };
+    }
+
+    // a field of `instance_num` copies of one asset(a ball on a hexagonal plate), all share one bottom-level accelerator
+    static scene_t create_instance_scene(point2_t film_resolution, int instance_num = 1024,
+        accel_enum_t accel_enum = accel_enum_t::bvh)
+    {
+        // world coord: same as cornell box scene, z is up
+
+        int side = (int)std::ceil(std::sqrt((float_t)instance_num));
+        float_t spacing = 1.5f;
+        float_t half = side * spacing / 2;
+
+        const_camera_sptr_t camera = std::make_shared<camera_t>(
+            point3_t{ 0, -half * 1.6f, half },
+            vec3_t{ 0, 1.6f, -1 }, vec3_t{ 0, 1, 1.6f },
+            50, film_resolution);
+
+        scene_pool_t pool;
+
+        handle_t gray   = pool.materials.add(matte_material_t(color_t(.5, .5, .5)));
+        handle_t white  = pool.materials.add(matte_material_t(color_t(.8, .8, .8)));
+        handle_t glossy = pool.materials.add(plastic_material_t(color_t(0.6f, 0.15f, 0.1f), color_t(.4, .4, .4), 200.));
+
+        handle_t ground = pool.shapes.add(rectangle_t(
+            point3_t(-half, -half, 0), point3_t(half, -half, 0), point3_t(half, half, 0), point3_t(-half, half, 0)));
+
+        // asset in object space
+        handle_t ball = pool.shapes.add(sphere_t(point3_t(0, 0, 0.5f), 0.5f));
+
+        // hexagonal prism: top center, top ring, bottom ring
+        std::vector<point3_t> positions{ point3_t(0, 0, 0.04f) };
+        for (float_t z : { 0.04f, 0.001f })
+        {
+            for (int i = 0; i < 6; ++i)
+                positions.push_back(point3_t(0.6f * std::cos(i * k_pi / 3), 0.6f * std::sin(i * k_pi / 3), z));
+        }
+
+        std::vector<int> indices;
+        for (int i = 0; i < 6; ++i)
+        {
+            int top = 1 + i, top_next = 1 + (i + 1) % 6;
+            int bottom = 7 + i, bottom_next = 7 + (i + 1) % 6;
+
+            indices.insert(indices.end(), { 0, top, top_next });
+            indices.insert(indices.end(), { bottom, bottom_next, top_next });
+            indices.insert(indices.end(), { bottom, top_next, top });
+        }
+        pool.meshes.push_back(std::make_unique<triangle_mesh_t>(std::move(positions), std::move(indices)));
+        const triangle_mesh_t* plate = pool.meshes.back().get();
+
+        surface_list_t asset_surface_list{ { pool.shapes.get(ball), glossy, k_null_handle } };
+        for (int i = 0; i < plate->triangle_num(); ++i)
+            asset_surface_list.push_back({ plate->triangle(i), white, k_null_handle });
+
+        const_accel_sptr_t asset = create_accel(accel_enum, std::move(asset_surface_list));
+
+        rng_t rng(7);
+        instance_list_t instance_list;
+        instance_list.reserve(instance_num);
+        for (int i = 0; i < instance_num; ++i)
+        {
+            vec3_t position(
+                ((i % side) - (side - 1) / 2.f) * spacing + (rng.uniform_float() - 0.5f) * 0.3f,
+                ((i / side) - (side - 1) / 2.f) * spacing + (rng.uniform_float() - 0.5f) * 0.3f,
+                0);
+            float_t size = 0.5f + 0.5f * rng.uniform_float();
+            float_t height = size * (0.7f + 0.9f * rng.uniform_float());
+
+            mat4_t object_to_world =
+                mat4_t::translate(position) *
+                mat4_t::rotate(360 * rng.uniform_float(), vec3_t(0, 0, 1)) *
+                mat4_t::scale(vec3_t(size, size, height));
+            instance_list.emplace_back(asset, transform_t(object_to_world));
+        }
 
-            { plank0.get(), silver.get(), nullptr},
-            { plank1.get(), silver.get(), nullptr},
-            { plank2.get(), silver.get(), nullptr},
-            { plank3.get(), silver.get(), nullptr},
+        pool.lights.add(direction_light_t(point3_t(), 1, color_t(3, 3, 3), vec3_t(-1, 1.5, -2)));
+        handle_t sky = pool.lights.add(environment_light_t(point3_t(), 1, color_t(135. / 255, 206. / 255, 250. / 255)));
 
-            { ball0.get(),  black.get(), light0.get() },
-            { ball1.get(),  black.get(), light1.get() },
-            { ball2.get(),  black.get(), light2.get() },
-            { ball3.get(),  black.get(), light3.get() },
-            { ball4.get(),  black.get(), light4.get() },
+        surface_list_t surface_list
+        {
+            { pool.shapes.get(ground), gray, k_null_handle },
         };
 
-        // TODO
-        return scene_t{ camera, shape_list, material_list, light_list, surface_list };
+        return scene_t{ camera, std::move(pool), std::move(surface_list), sky, accel_enum, std::move(instance_list) };
     }
 
 private:
     const_camera_sptr_t camera_;
+    scene_pool_t pool_;
 
-    shape_list_t shape_list_;
-    material_list_t material_list_;
-
-    light_list_t light_list_;
+    light_list_t light_list_; // all lights of `pool_` in the order added
     environment_light_t* environment_light_;
 
-    // TODO: std::vector<std::function<intersect(ray_t ray), result_t> surfaces_;
-    surface_list_t surface_list_;
-    accel_t accel_;
+    accel_enum_t accel_enum_;
+    accel_uptr_t accel_; // owns the surfaces
+    accel_uptr_t instance_accel_; // top-level, null without instances
 };
 
 
@@ -3579,6 +8512,8 @@ enum class integrator_enum_t
     path_tracing_recursion,
     path_tracing_recursion_defered,
     path_tracing_iteration,
+    path_tracing_sorted, // `path_tracing_iteration` with the rays of each bounce of a tile sorted before tracing
+    path_tracing_wavefront, // `path_tracing_iteration` as stages over queues of paths
     //path_tracing_split,
 };
 
@@ -3591,14 +8526,179 @@ struct light_list_sample_t
 };
 
 
+// shadow rays of a shading point with the lighting each brings if it's unoccluded,
+// traced together by `resolve()` after all lights are sampled, see `integrator_t::sample_all_light()`
+class shadow_batch_t
+{
+public:
+    int size() const { return (int)rays_.size(); }
+
+    void clear()
+    {
+        rays_.clear();
+        unoccluded_Lds_.clear();
+    }
+
+    void add(const ray_t& ray, color_t unoccluded_Ld)
+    {
+        rays_.push_back(ray);
+        unoccluded_Lds_.push_back(unoccluded_Ld);
+    }
+
+    const std::vector<ray_t>& rays() const { return rays_; }
+    const std::vector<color_t>& unoccluded_Lds() const { return unoccluded_Lds_; }
+
+    // weight the lighting of the rays added since `first`
+    void scale(int first, float_t weight)
+    {
+        for (int i = first; i < size(); ++i)
+            unoccluded_Lds_[i] *= weight;
+    }
+    void scale(int first, color_t weight)
+    {
+        for (int i = first; i < size(); ++i)
+            unoccluded_Lds_[i] *= weight;
+    }
+
+    // sum of the lighting of unoccluded rays, the batch is cleared
+    color_t resolve(const scene_t* scene)
+    {
+        color_t Ld{};
+        bool is_occludeds[accel_t::k_max_packet_size];
+
+        for (int first = 0; first < size(); first += accel_t::k_max_packet_size)
+        {
+            int ray_num = std::min(size() - first, accel_t::k_max_packet_size);
+            scene->occluded_packet(rays_.data() + first, ray_num, is_occludeds);
+
+            for (int i = 0; i < ray_num; ++i)
+            {
+                if (!is_occludeds[i])
+                    Ld += unoccluded_Lds_[first + i];
+            }
+        }
+
+        clear();
+        return Ld;
+    }
+
+private:
+    std::vector<ray_t> rays_;
+    std::vector<color_t> unoccluded_Lds_;
+};
+
+
+/*
+   shading stage of breadth-first integrators: hits found by `scene_t::intersect_geometry()` are binned by
+   material type(and by material of textured ones), then the bsdfs of a bin are built by a loop over one
+   material class, instead of a virtual `material_t::scattering()` per hit in random material order;
+   the type is in the material handle of the surface, binning doesn't touch the material itself
+
+     shading_queue.bin(pool, isects, is_hits, &paths);           // misses first, then hits bin by bin
+     shading_queue.scattering(pool, isects, paths, begin, end);  // any part of `paths`, e.g. a chunk of a thread
+*/
+class shading_queue_t
+{
+public:
+    // reorder `paths`(indices of `isects`) by bin, keeping the order of paths in a bin
+    void bin(const scene_pool_t& pool, const isect_t* isects, const uint8_t* is_hits, std::vector<int>* paths)
+    {
+        bin_begins_.fill(0);
+        for (int path : *paths)
+            ++bin_begins_[bin_of(isects, is_hits, path) + 1];
+
+        for (int bin = 0; bin < k_bin_num; ++bin)
+            bin_begins_[bin + 1] += bin_begins_[bin];
+
+        auto bin_ends = bin_begins_;
+        binned_.resize(paths->size());
+        for (int path : *paths)
+            binned_[bin_ends[bin_of(isects, is_hits, path)]++] = path;
+
+        // textured materials build a bsdf from each hit, keep hits of one material together
+        for (int bin = 1; bin < k_bin_num; ++bin)
+        {
+            auto first = binned_.begin() + bin_begins_[bin], last = binned_.begin() + bin_begins_[bin + 1];
+            if (std::any_of(first, last, [&](int path) { return pool.material(*isects[path].surface())->is_textured(); }))
+            {
+                std::stable_sort(first, last, [&](int a, int b)
+                    { return isects[a].surface()->material < isects[b].surface()->material; });
+            }
+        }
+
+        paths->swap(binned_);
+    }
+
+    // build bsdf and emission of the hits among `paths[begin, end)`, `paths` as reordered by `bin()`
+    void scattering(const scene_pool_t& pool, isect_t* isects, const std::vector<int>& paths, int begin, int end) const
+    {
+        // bin 0 holds the misses
+        for (int bin = 1; bin < k_bin_num; ++bin)
+        {
+            const int* first = paths.data() + std::max(begin, bin_begins_[bin]);
+            const int* last = paths.data() + std::min(end, bin_begins_[bin + 1]);
+            if (first >= last)
+                continue;
+
+            switch ((material_enum_t)(bin - 1))
+            {
+                case material_enum_t::matte:   scattering<matte_material_t>(pool, isects, first, last); break;
+                case material_enum_t::mirror:  scattering<mirror_material_t>(pool, isects, first, last); break;
+                case material_enum_t::glass:   scattering<glass_material_t>(pool, isects, first, last); break;
+                case material_enum_t::plastic: scattering<plastic_material_t>(pool, isects, first, last); break;
+                default: LOG_ERROR("unknown material type {}", bin - 1);
+            }
+        }
+    }
+
+private:
+    static int bin_of(const isect_t* isects, const uint8_t* is_hits, int path)
+    {
+        return is_hits[path] ? 1 + material_pool_t::type(isects[path].surface()->material) : 0;
+    }
+
+    template <typename material_type_t>
+    static void scattering(const scene_pool_t& pool, isect_t* isects, const int* first, const int* last)
+    {
+        for (; first != last; ++first)
+            isects[*first].template scattering<material_type_t>(pool);
+    }
+
+private:
+    static constexpr int k_bin_num = 1 + (int)material_enum_t::count;
+
+    std::array<int, k_bin_num + 1> bin_begins_{};
+    std::vector<int> binned_;
+};
+
+
+/*
+   vertices of the paths in flight of `path_tracing_wavefront_t`, in structure-of-arrays, a path is an index,
+   all paths of a wave are at the same bounce, so it isn't stored
+*/
 struct path_vertex_t
 {
-    scene_t* scene{};
-    sampler_t* sampler{};
-    ray_t ray;
-    int depth;
-    bool is_prev_specular;
-    isect_t isect;
+    std::vector<ray_t> rays; // to find the next vertex
+    std::vector<isect_t> isects; // found by `rays`
+    std::vector<uint8_t> is_hits;
+    std::vector<color_t> betas; // path throughput weight
+    std::vector<color_t> Los; // radiance gathered so far
+    std::vector<int> pixels;
+    std::vector<uint8_t> is_prev_speculars;
+    std::vector<int> shadow_begins, shadow_ends; // shadow rays of the vertex in the batch of its chunk
+
+    void resize(int path_num)
+    {
+        rays.resize(path_num, ray_t{ point3_t{}, vec3_t{ 0, 0, 1 } });
+        isects.resize(path_num);
+        is_hits.resize(path_num);
+        betas.resize(path_num);
+        Los.resize(path_num);
+        pixels.resize(path_num);
+        is_prev_speculars.resize(path_num);
+        shadow_begins.resize(path_num);
+        shadow_ends.resize(path_num);
+    }
 };
 
 /*
@@ -3615,8 +8715,14 @@ public:
 
 public:
     // TODO: why can't const?
-    void render(/*const*/ scene_t* scene, sampler_t* original_sampler, film_t* film)
+    virtual void render(/*const*/ scene_t* scene, sampler_t* original_sampler, film_t* film)
     {
+        if (is_primary_hit_taken())
+        {
+            render_packet(scene, original_sampler, film);
+            return;
+        }
+
         auto camera = scene->get_camera();
         vec2_t resolution = film->get_resolution();
         int width = (int)resolution.x;
@@ -3628,11 +8734,11 @@ public:
         for (int y = 0; y < height; y += 1)
         {
             auto sampler = original_sampler->clone(); // multi thread
+            film_tile_t tile(0, y, width, 1); // the row, merged into `film` once done
             LOG("rendering... {} spp, {:.2f}%\r", sampler->ge_samples_per_pixel(), 100. * y / (height - 1));
 
             for (int x = 0; x < width; x += 1)
             {
-                color_t L{};
                 sampler->start_pixel();
                 //film_->set_color(x, y, color_t(0, 0, 0));
 
@@ -3641,17 +8747,90 @@ public:
                     auto camera_sample = sampler->get_camera_sample({ (float_t)x, (float_t)y });
                     ray_t ray = camera->generate_ray(camera_sample);
 
-                    color_t dL = Li(ray, scene, sampler.get()) * (1. / sampler->ge_samples_per_pixel());
-                    //LOG_DEBUG("dL: {}", dL.to_string());
-                    CHECK_DEBUG(dL.is_valid(), "{}", dL.to_string());
+                    color_t L = Li(ray, scene, sampler.get());
+                    //LOG_DEBUG("L: {}", L.to_string());
+                    CHECK_DEBUG(L.is_valid(), "{}", L.to_string());
 
-                    L = L + dL;
+                    tile.add_sample(x, y, L);
                 }
                 while (sampler->next_sample());
+            }
 
-                // TODO
-                film->add_color(x, y, clamp01(L));
+            film->add_tile(tile);
+        }
+    }
+
+    // camera rays of a pixel block are traced as a packet, their hits shaded by material,
+    // then each path goes on from its primary hit
+    void render_packet(/*const*/ scene_t* scene, sampler_t* original_sampler, film_t* film)
+    {
+        constexpr int k_block_width = accel_t::k_packet_width;
+
+        auto camera = scene->get_camera();
+        vec2_t resolution = film->get_resolution();
+        int width = (int)resolution.x;
+        int height = (int)resolution.y;
+
+    #ifdef KY_RELEASE
+        #pragma omp parallel for schedule(dynamic, 1) // OpenMP
+    #endif // !KY_RELEASE
+        for (int block_y = 0; block_y < height; block_y += k_block_width)
+        {
+            auto sampler = original_sampler->clone(); // multi thread
+            LOG("rendering... {} spp, {:.2f}%\r", sampler->ge_samples_per_pixel(), 100. * std::min(block_y + k_block_width, height) / height);
+
+            std::vector<ray_t> rays;
+            rays.reserve(accel_t::k_max_packet_size);
+            isect_t isects[accel_t::k_max_packet_size];
+            bool is_hits[accel_t::k_max_packet_size]{};
+            uint8_t hit_flags[accel_t::k_max_packet_size]{};
+            shading_queue_t shading_queue;
+            std::vector<int> paths;
+
+            // the row of blocks, merged into `film` once done
+            film_tile_t tile(0, block_y, width, std::min(k_block_width, height - block_y));
+
+            for (int block_x = 0; block_x < width; block_x += k_block_width)
+            {
+                int block_width = std::min(k_block_width, width - block_x);
+                int block_height = std::min(k_block_width, height - block_y);
+                int pixel_num = block_width * block_height;
+
+                sampler->start_pixel();
+
+                do
+                {
+                    rays.clear();
+                    for (int i = 0; i < pixel_num; ++i)
+                    {
+                        point2_t pixel{ (float_t)(block_x + i % block_width), (float_t)(block_y + i / block_width) };
+                        rays.push_back(camera->generate_ray(sampler->get_camera_sample(pixel)));
+                    }
+
+                    // hits of the packet shaded bin by bin of material, see `shading_queue_t`
+                    scene->intersect_packet_geometry(rays.data(), pixel_num, isects, is_hits);
+
+                    paths.resize(pixel_num);
+                    for (int i = 0; i < pixel_num; ++i)
+                    {
+                        paths[i] = i;
+                        hit_flags[i] = is_hits[i];
+                    }
+                    shading_queue.bin(scene->pool(), isects, hit_flags, &paths);
+                    shading_queue.scattering(scene->pool(), isects, paths, 0, pixel_num);
+
+                    for (int i = 0; i < pixel_num; ++i)
+                    {
+                        color_t L = Li(rays[i], is_hits[i], isects[i], scene, sampler.get());
+                        CHECK_DEBUG(L.is_valid(), "{}", L.to_string());
+
+                        tile.add_sample(block_x + i % block_width, block_y + i / block_width, L);
+                    }
+                }
+                while (sampler->next_sample());
             }
+
+            film->add_tile(tile);
         }
     }
 
@@ -3718,6 +8897,14 @@ public:
     // TODO: virtual color_t Li(ray_t ray, const scene_t& scene, sampler_t& sampler) = 0;
     virtual color_t Li(ray_t ray, scene_t* scene, sampler_t* sampler) = 0;
 
+    // `Li()` of a camera ray whose closest hit is already found, `isect` is only valid if `is_hit`,
+    // integrators taking it are rendered by `render_packet()`
+    virtual bool is_primary_hit_taken() const { return false; }
+    virtual color_t Li(ray_t ray, bool is_hit, isect_t& isect, scene_t* scene, sampler_t* sampler)
+    {
+        return Li(ray, scene, sampler);
+    }
+
 protected:
 
 #pragma region sampling_light
@@ -3731,7 +8918,7 @@ protected:
 
         // TODO: power based, spatial based
         int light_index = std::min((int)(sampler.get_float() * light_count), light_count - 1);
-        light_t* light = scene->light_list()[light_index].get();
+        light_t* light = scene->light_list()[light_index];
         float_t pdf_light = float_t(1) / light_count;
 
         return { light, pdf_light };
@@ -3749,17 +8936,30 @@ protected:
         int light_index = std::min((int)(sampler.get_float() * light_count), light_count - 1);
         float_t pdf_light = float_t(1) / light_count;
 
-        light_t* light = scene->light_list()[light_index].get();
+        light_t* light = scene->light_list()[light_index];
         point2_t uLight = sampler.get_float2();
         point2_t uScattering = sampler.get_float2();
 
         // default skip perfectly specular BSDF due to its delta distribution
         return estimate_direct_lighting_both_mis(isect, *light, uLight, uScattering,
-            scene, sampler, skip_specular) / pdf_light; // for all light
+            scene, sampler, skip_specular, nullptr) / pdf_light; // for all light
     }
 
     static color_t sample_all_light(
         const isect_t& isect, scene_t* scene, sampler_t& sampler, bool skip_specular, direct_sample_enum_t sample_enum)
+    {
+        // shadow rays of all lights are traced together after sampling them, rather than one at a time
+        thread_local shadow_batch_t shadow_batch;
+        shadow_batch.clear();
+
+        color_t Ld = sample_all_light(isect, scene, sampler, skip_specular, sample_enum, &shadow_batch);
+        return Ld + shadow_batch.resolve(scene);
+    }
+
+    // lighting needing no shadow ray, the shadow rays of the rest are left in `shadow_batch`
+    static color_t sample_all_light(
+        const isect_t& isect, scene_t* scene, sampler_t& sampler, bool skip_specular, direct_sample_enum_t sample_enum,
+        shadow_batch_t* shadow_batch)
     {
         color_t Ld;
 
@@ -3788,11 +8988,11 @@ protected:
             break;
         }
 
-        for (const light_sptr_t& light : scene->light_list())
+        for (const light_t* light : scene->light_list())
         {
             Ld += estimate_direct_lighting(
                 isect, *light, sampler.get_float2(), sampler.get_float2(),
-                scene, sampler, skip_specular);
+                scene, sampler, skip_specular, shadow_batch);
         }
 
         return Ld;
@@ -3804,10 +9004,24 @@ protected:
 
 #pragma region estimate_direct_lighting
 
+    // `Ld` if `light_position` is visible from `isect`, or defer the test to `shadow_batch` if it's given
+    static color_t test_shadow(
+        const isect_t& isect, point3_t light_position, color_t Ld,
+        scene_t* scene, shadow_batch_t* shadow_batch)
+    {
+        if (shadow_batch)
+        {
+            shadow_batch->add(scene_t::shadow_ray(isect, light_position), Ld);
+            return {};
+        }
+
+        return scene->occluded(isect, light_position) ? color_t{} : Ld;
+    }
+
     static color_t estimate_direct_lighting_idle(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
         return {};
     }
@@ -3816,7 +9030,7 @@ protected:
     static color_t estimate_direct_lighting_by_direction(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
         if (light.is_delta())
             return {};
@@ -3835,7 +9049,7 @@ protected:
         color_t Li{};
         if (is_hit_light)
         {
-            if (light_isect.surface()->area_light == &light)
+            if (scene->pool().area_light(*light_isect.surface()) == &light)
                 Li = light_isect.Le();
         }
         else
@@ -3860,7 +9074,7 @@ protected:
     static color_t estimate_direct_lighting_by_position(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
         if (skip_specular && isect.bsdf()->is_delta())
             return {};
@@ -3873,9 +9087,6 @@ protected:
         //if (dot(ls.wi, isect.normal) < 0)
         //    return {};
 
-        if (scene->occluded(isect, ls.position))
-            return {};
-
         color_t f = isect.bsdf()->eval(isect.wo, ls.wi);
         if (f.is_black())
             return {};
@@ -3886,7 +9097,7 @@ protected:
         //LOG_DEBUG("{}, {}\n", ls.wi.to_string(), isect.normal.to_string());
         LOG_DEBUG("{}, {}, {}, {}, {}\n", Ld.to_string(), f.to_string(), ls.Li.to_string(), cos_theta, ls.pdf);
 
-        return Ld;
+        return test_shadow(isect, ls.position, Ld, scene, shadow_batch);
     }
 
 #pragma endregion
@@ -3896,7 +9107,7 @@ protected:
     static color_t estimate_direct_lighting_by_direction_mis(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
         bool is_specular = isect.bsdf()->is_delta();
         if (skip_specular && is_specular)
@@ -3919,7 +9130,7 @@ protected:
         color_t Li{};
         if (is_hit_light)
         {
-            if (light_isect.surface()->area_light == &light)
+            if (scene->pool().area_light(*light_isect.surface()) == &light)
                 Li = light_isect.Le();
         }
         else
@@ -3952,7 +9163,7 @@ protected:
     static color_t estimate_direct_lighting_by_position_mis(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
         if (skip_specular && isect.bsdf()->is_delta())
             return {};
@@ -3961,9 +9172,6 @@ protected:
         if (ls.Li.is_black() || ls.pdf <= 0)
             return {};
 
-        if (scene->occluded(isect, ls.position))
-            return {};
-
         color_t f = isect.bsdf()->eval(isect.wo, ls.wi) * abs_dot(ls.wi, isect.normal);
         if (f.is_black())
             return {};
@@ -3980,18 +9188,23 @@ protected:
             Ld = (f * ls.Li * weight) / (0.5 * ls.pdf);
         }
 
-        return Ld;
+        return test_shadow(isect, ls.position, Ld, scene, shadow_batch);
     }
 
     static color_t estimate_direct_lighting_both_mis(
         const isect_t& isect, const light_t& light,
         float2_t random_light, float2_t random_bsdf,
-        scene_t* scene, sampler_t& sampler, bool skip_specular)
+        scene_t* scene, sampler_t& sampler, bool skip_specular, shadow_batch_t* shadow_batch)
     {
-        color_t Lb = estimate_direct_lighting_by_direction_mis(isect, light, random_light, random_bsdf, scene, sampler, skip_specular);
-        color_t Ll = estimate_direct_lighting_by_position_mis(isect, light, random_light, random_bsdf, scene, sampler, skip_specular);
+        int first_shadow = shadow_batch ? shadow_batch->size() : 0;
+
+        color_t Lb = estimate_direct_lighting_by_direction_mis(isect, light, random_light, random_bsdf, scene, sampler, skip_specular, shadow_batch);
+        color_t Ll = estimate_direct_lighting_by_position_mis(isect, light, random_light, random_bsdf, scene, sampler, skip_specular, shadow_batch);
         color_t Ld = 0.5 * Lb + 0.5 * Ll;
 
+        if (shadow_batch)
+            shadow_batch->scale(first_shadow, 0.5);
+
         //LOG_DEBUG("{}, {}, {}\n", Ld.to_string(), Lb.to_string(), Ll.to_string());
 
         return Ld;
@@ -4436,97 +9649,603 @@ class path_tracing_iteration_t : public path_integrator_t
 public:
     using path_integrator_t::path_integrator_t;
 
-    // sample bsdf/direction on front vertexs, and sample light/position on final vertex
     color_t Li(ray_t ray, scene_t* scene, sampler_t* sampler) override
     {
-        // Lo(out), Le(emit), Ld(direct), Li(indirect)
-        color_t Lo{};
+        isect_t isect;
+        bool is_hit = scene->intersect(ray, &isect);
+
+        return Li(ray, is_hit, isect, scene, sampler);
+    }
+
+    bool is_primary_hit_taken() const override { return true; }
+
+    // sample bsdf/direction on front vertexs, and sample light/position on final vertex
+    color_t Li(ray_t ray, bool is_primary_hit, isect_t& primary_isect, scene_t* scene, sampler_t* sampler) override
+    {
+        path_state_t path{ ray };
+
+        // cast `path.ray` to scene and store intersection in `isect`, the first one is given
+        if (extend(path, is_primary_hit, primary_isect, scene, sampler))
+        {
+            while (true)
+            {
+                isect_t isect;
+                bool hit = scene->intersect(path.ray, &isect);
+                if (!extend(path, hit, isect, scene, sampler))
+                    break;
+            }
+        }
+
+        return path.Lo;
+    }
 
+protected:
+    // what a path carries from one vertex to the next
+    struct path_state_t
+    {
+        ray_t ray; // to find the next vertex
+        color_t Lo{}; // Lo(out), Le(emit), Ld(direct), Li(indirect)
         color_t beta{ 1, 1, 1 }; // beta holds path throughput weight
-        bool is_prev_specular = false; // whether pervious vertex's material has perfect specular property
+        int bounces{};
+        bool is_prev_specular{}; // whether pervious vertex's material has perfect specular property
+    };
+
+    // accumulate the contribution of the vertex `isect` found by `path.ray`, then sample the next ray,
+    // return false if the path ends here
+    bool extend(path_state_t& path, bool hit, isect_t& isect, scene_t* scene, sampler_t* sampler)
+    {
+        color_t& Lo = path.Lo;
+        color_t& beta = path.beta;
+        int bounces = path.bounces;
+
+
+        // Le: emission
 
-        for (int bounces = 0; ; ++bounces)
+        // possibly add emitted light at intersection
+        if (bounces == 0 || path.is_prev_specular)
         {
-            // find next path vertex and accumulate contribution
-            // cast _ray_ to scene and store intersection in _isect_
-            isect_t isect;
-            bool hit = scene->intersect(ray, &isect);
+            // add emitted light at path vertex or from the environment
+            if (hit)
+            {
+                Lo += beta * isect.Le();
+            }
+            else
+            {
+                Lo += beta * scene->environment_lighting(path.ray);
+            }
+        }
+
+
+        // terminate path if ray escaped or _maxDepth_ was reached
+        if (!hit || bounces >= max_path_depth_)
+            return false;
+
+
+        // Ld: direct lighting / NEE(Next Event Estimation)
+
+        // sample illumination from lights to find path contribution.
+        // (but skip this for perfectly specular BSDFs.)
+        if (!isect.bsdf()->is_delta())
+            //&& bounces > 0 && bounces < 2) // for debug
+            //&& bounces == 1) // for debug
+        {
+            color_t Ld = beta * sample_all_light(isect, scene, *sampler, true, direct_sample_enum_);
+            Lo += Ld;
+
+            LOG_VAST("isect.position: {}, .normal: {}, .wo: {} -> Ld: {}\n",
+                isect.position.to_string(), isect.normal.to_string(), isect.wo.to_string(), Ld.to_string());
+        }
 
 
-            // Le: emission
+        // Li: indirect lighting (compute by next iteration)
 
-            // possibly add emitted light at intersection
-            if (bounces == 0 || is_prev_specular)
+        // sample BSDF to get new path direction
+        bsdf_sample_t bs = isect.bsdf()->sample(isect.wo, sampler->get_float2());
+
+        if (bs.f.is_black() || bs.pdf == 0.f)
+            return false;
+
+        // update path throughout
+        beta *= bs.f * abs_dot(bs.wi, isect.normal) / bs.pdf;
+        CHECK_DEBUG(beta.luminance() > 0.f, "{}", beta.to_string());
+        CHECK_DEBUG(!std::isinf(beta.luminance()));
+
+        // TODO
+        path.is_prev_specular = is_delta_bsdf(bs.bsdf_type);
+        path.ray = isect.spawn_ray(bs.wi);
+
+
+        // possibly terminate the path with Russian roulette.
+        if (bounces > 3)
+        {
+            float_t beta_max_comp = beta.max_component_value();
+            float_t q = std::max((float_t).05, 1 - beta_max_comp);
+
+            if (sampler->get_float() < q)
+                return false;
+            else
             {
-                // add emitted light at path vertex or from the environment
-                if (hit)
-                {
-                    Lo += beta * isect.Le();
-                }
-                else
-                {
-                    Lo += beta * scene->environment_lighting(ray);
-                }
+                beta *= 1 / (1 - q);
+                CHECK_DEBUG(!std::isinf(beta.luminance()));
             }
+        }
 
+        ++path.bounces;
+        return true;
+    }
+};
 
-            // terminate path if ray escaped or _maxDepth_ was reached
-            if (!hit || bounces >= max_path_depth_)
-                break;
 
+/*
+   `path_tracing_iteration_t` breadth-first over tiles: the paths of a tile(a batch of samples of each pixel)
+   advance one bounce at a time, the rays of each bounce are sorted by direction octant then the Morton code
+   of the origin before being traced, so rays traced one after another visit much the same nodes and surfaces
+   and their hits are shaded bin by bin of material, see `shading_queue_t`
 
-            // Ld: direct lighting / NEE(Next Event Estimation)
+   camera rays are coherent already, they're traced as packets of 8x8 pixel blocks like `render_packet()`;
+   incoherent bounces only pay off sorting when the accelerator doesn't fit in cache, see `render_sorting_benchmark()`
 
-            // sample illumination from lights to find path contribution.
-            // (but skip this for perfectly specular BSDFs.)
-            if (!isect.bsdf()->is_delta())
-                //&& bounces > 0 && bounces < 2) // for debug
-                //&& bounces == 1) // for debug
+   Ray Tracing Complex Scenes, Pharr et al. 1997
+   https://www.pbr-book.org/4ed/Wavefront_Rendering_on_GPUs
+*/
+class path_tracing_sorted_t : public path_tracing_iteration_t
+{
+public:
+    using path_tracing_iteration_t::path_tracing_iteration_t;
+
+    void render(/*const*/ scene_t* scene, sampler_t* original_sampler, film_t* film) override
+    {
+        constexpr int k_block_width = accel_t::k_packet_width;
+
+        auto camera = scene->get_camera();
+        vec2_t resolution = film->get_resolution();
+        int width = (int)resolution.x;
+        int height = (int)resolution.y;
+        bounds3_t world_bound = scene->world_bound();
+
+    #ifdef KY_RELEASE
+        #pragma omp parallel for schedule(dynamic, 1) // OpenMP
+    #endif // !KY_RELEASE
+        for (int tile_y = 0; tile_y < height; tile_y += k_tile_width)
+        {
+            auto sampler = original_sampler->clone(); // multi thread
+            int samples_per_pixel = sampler->ge_samples_per_pixel();
+            LOG("rendering... {} spp, {:.2f}%\r", samples_per_pixel, 100. * std::min(tile_y + k_tile_width, height) / height);
+
+            std::vector<ray_t> rays;
+            rays.reserve(accel_t::k_max_packet_size);
+            std::vector<path_state_t> paths;
+            std::vector<int> path_pixels; // pixel in tile of each path
+            std::vector<isect_t> isects(k_max_batch_paths);
+            std::vector<uint8_t> is_hits(k_max_batch_paths);
+            std::vector<int> active, next; // paths with a ray to trace, in tracing order
+            std::vector<std::pair<uint64_t, int>> sort_keys;
+            shading_queue_t shading_queue;
+            paths.reserve(k_max_batch_paths);
+
+            // the row of tiles, merged into `film` once done
+            film_tile_t film_tile(0, tile_y, width, std::min(k_tile_width, height - tile_y));
+
+            for (int tile_x = 0; tile_x < width; tile_x += k_tile_width)
             {
-                color_t Ld = beta * sample_all_light(isect, scene, *sampler, true, direct_sample_enum_);
-                Lo += Ld;
+                int tile_width = std::min(k_tile_width, width - tile_x);
+                int tile_height = std::min(k_tile_width, height - tile_y);
+                int pixel_num = tile_width * tile_height;
+                int batch_samples = std::max(k_max_batch_paths / pixel_num, 1);
 
-                LOG_VAST("isect.position: {}, .normal: {}, .wo: {} -> Ld: {}\n",
-                    isect.position.to_string(), isect.normal.to_string(), isect.wo.to_string(), Ld.to_string());
+                for (int first_sample = 0; first_sample < samples_per_pixel; first_sample += batch_samples)
+                {
+                    int sample_num = std::min(batch_samples, samples_per_pixel - first_sample);
+                    paths.clear();
+                    path_pixels.clear();
+                    active.clear();
+
+                    // camera rays, a sample of a block makes a packet
+                    for (int sample = 0; sample < sample_num; ++sample)
+                    {
+                        for (int block_y = 0; block_y < tile_height; block_y += k_block_width)
+                        {
+                            for (int block_x = 0; block_x < tile_width; block_x += k_block_width)
+                            {
+                                int block_width = std::min(k_block_width, tile_width - block_x);
+                                int block_height = std::min(k_block_width, tile_height - block_y);
+                                int block_pixel_num = block_width * block_height;
+
+                                isect_t block_isects[accel_t::k_max_packet_size];
+                                bool block_hits[accel_t::k_max_packet_size]{};
+
+                                rays.clear();
+                                for (int i = 0; i < block_pixel_num; ++i)
+                                {
+                                    int x = block_x + i % block_width, y = block_y + i / block_width;
+                                    point2_t pixel{ (float_t)(tile_x + x), (float_t)(tile_y + y) };
+                                    rays.push_back(camera->generate_ray(sampler->get_camera_sample(pixel)));
+                                }
+
+                                scene->intersect_packet_geometry(rays.data(), block_pixel_num, block_isects, block_hits);
+
+                                for (int i = 0; i < block_pixel_num; ++i)
+                                {
+                                    int index = (int)paths.size();
+                                    paths.push_back({ rays[i] });
+                                    path_pixels.push_back((block_y + i / block_width) * tile_width + block_x + i % block_width);
+                                    isects[index] = std::move(block_isects[i]);
+                                    is_hits[index] = block_hits[i];
+                                    active.push_back(index);
+                                }
+                            }
+                        }
+                    }
+
+                    // hits shaded by material, then bounces sorted and traced
+                    while (true)
+                    {
+                        shading_queue.bin(scene->pool(), isects.data(), is_hits.data(), &active);
+                        shading_queue.scattering(scene->pool(), isects.data(), active, 0, (int)active.size());
+
+                        next.clear();
+                        for (int index : active)
+                        {
+                            if (extend(paths[index], is_hits[index], isects[index], scene, sampler.get()))
+                                next.push_back(index);
+                        }
+                        std::swap(active, next);
+
+                        if (active.empty())
+                            break;
+
+                        sort_rays(paths, world_bound, &active, &sort_keys);
+
+                        for (int index : active)
+                        {
+                            isects[index] = isect_t{};
+                            is_hits[index] = scene->intersect_geometry(paths[index].ray, &isects[index]);
+                        }
+                    }
+
+                    for (int index = 0; index < (int)paths.size(); ++index)
+                    {
+                        const color_t& L = paths[index].Lo;
+                        CHECK_DEBUG(L.is_valid(), "{}", L.to_string());
+
+                        int pixel = path_pixels[index];
+                        film_tile.add_sample(tile_x + pixel % tile_width, tile_y + pixel / tile_width, L);
+                    }
+                }
             }
 
+            film->add_tile(film_tile);
+        }
+    }
 
-            // Li: indirect lighting (compute by next iteration)
+private:
+    // direction octant in the top bits, so rays heading the same way are traced together, then by origin
+    static uint64_t ray_sort_key(const ray_t& ray, const bounds3_t& world_bound)
+    {
+        vec3_t direction = ray.direction();
+        uint64_t octant = (direction.x < 0) | ((direction.y < 0) << 1) | ((direction.z < 0) << 2);
 
-            // sample BSDF to get new path direction
-            bsdf_sample_t bs = isect.bsdf()->sample(isect.wo, sampler->get_float2());
+        vec3_t offset = world_bound.offset(ray.origin());
+        auto quantize = [](float_t x) { return (uint32_t)std::clamp(x * 1024, (float_t)0, (float_t)1023); };
 
-            if (bs.f.is_black() || bs.pdf == 0.f)
-                break;
+        return (octant << 30) | morton_code3(quantize(offset.x), quantize(offset.y), quantize(offset.z));
+    }
 
-            // update path throughout
-            beta *= bs.f * abs_dot(bs.wi, isect.normal) / bs.pdf;
-            CHECK_DEBUG(beta.luminance() > 0.f, "{}", beta.to_string());
-            CHECK_DEBUG(!std::isinf(beta.luminance()));
+    static void sort_rays(const std::vector<path_state_t>& paths, const bounds3_t& world_bound,
+        std::vector<int>* active, std::vector<std::pair<uint64_t, int>>* sort_keys)
+    {
+        sort_keys->clear();
+        for (int index : *active)
+            sort_keys->emplace_back(ray_sort_key(paths[index].ray, world_bound), index);
+
+        std::sort(sort_keys->begin(), sort_keys->end());
+
+        for (int i = 0; i < (int)sort_keys->size(); ++i)
+            (*active)[i] = (*sort_keys)[i].second;
+    }
+
+private:
+    static constexpr int k_tile_width = 16;
+    static constexpr int k_max_batch_paths = 4096; // samples of a tile are split into batches of about this many paths
+};
+
+
+/*
+   wavefront path tracing: instead of one `Li()` carrying a path through all its bounces, a wave of paths
+   (up to one sample of every pixel) goes through each stage together, each stage a loop over a queue of paths
+   run on all threads:
+
+     generate    camera rays of the wave, a sample pass goes pixel block by block, and the camera rays
+                 of a block are traced as a packet
+     intersect   closest hits of the active paths, from the first bounce on
+     shade       emission, lights sampled with their shadow rays queued, next direction by the BSDF,
+                 hits binned by material first, so neighbouring paths run the same shading code, see `shading_queue_t`
+     shadow      the queued shadow rays, any hit
+     accumulate  lighting of unoccluded shadow rays into their paths
+
+   queues are split into fixed chunks, each chunk has a random stream of its own, so a render doesn't depend
+   on how many threads run it; `Li()` still traces a single path depth-first for `debug_area()`
+
+   Megakernels Considered Harmful: Wavefront Path Tracing on GPUs, Laine et al. 2013
+*/
+class path_tracing_wavefront_t : public path_tracing_iteration_t
+{
+public:
+    using path_tracing_iteration_t::path_tracing_iteration_t;
+
+    void render(/*const*/ scene_t* scene, sampler_t* original_sampler, film_t* film) override
+    {
+        auto camera = scene->get_camera();
+        vec2_t resolution = film->get_resolution();
+        int width = (int)resolution.x;
+        int height = (int)resolution.y;
+        int pixel_num = width * height;
+        int samples_per_pixel = original_sampler->ge_samples_per_pixel();
+
+        // a sample pass visits pixels block by block, so neighbouring paths of the generate stage
+        // make the camera ray packets of a pixel block, see `render_packet()`
+        constexpr int k_block_width = accel_t::k_packet_width;
+        std::vector<int> pixel_order;
+        std::vector<int> pixel_blocks(pixel_num);
+        pixel_order.reserve(pixel_num);
+        for (int block_y = 0; block_y < height; block_y += k_block_width)
+        {
+            for (int block_x = 0; block_x < width; block_x += k_block_width)
+            {
+                for (int y = block_y; y < std::min(block_y + k_block_width, height); ++y)
+                {
+                    for (int x = block_x; x < std::min(block_x + k_block_width, width); ++x)
+                    {
+                        pixel_order.push_back(y * width + x);
+                        pixel_blocks[y * width + x] = block_y * width + block_x;
+                    }
+                }
+            }
+        }
 
-            // TODO
-            is_prev_specular = is_delta_bsdf(bs.bsdf_type);
-            ray = isect.spawn_ray(bs.wi); 
+        // a wave holds at most one sample of a pixel, so paths of a wave never write the same pixel
+        film_tile_t tile(0, 0, width, height);
+        int wave_size = std::min(k_max_wave_paths, pixel_num);
+        int64_t total_path_num = (int64_t)pixel_num * samples_per_pixel;
 
+        int wave = 0;
+        int64_t logged_pass = -1;
+        for (int64_t wave_first = 0; wave_first < total_path_num; wave_first += wave_size, ++wave)
+        {
+            int path_num = (int)std::min((int64_t)wave_size, total_path_num - wave_first);
 
-            // possibly terminate the path with Russian roulette.
-            if (bounces > 3)
+            int64_t pass = wave_first / pixel_num;
+            if (pass != logged_pass)
             {
-                float_t beta_max_comp = beta.max_component_value();
-                float_t q = std::max((float_t).05, 1 - beta_max_comp);
+                LOG("rendering... {} spp, {:.2f}%\r", samples_per_pixel, 100. * pass / samples_per_pixel);
+                logged_pass = pass;
+            }
 
-                if (sampler->get_float() < q)
-                    break;
-                else
+            paths_.resize(path_num);
+            active_.resize(path_num);
+            std::iota(active_.begin(), active_.end(), 0);
+            chunks_.resize(std::max(chunks_.size(), (size_t)chunk_num(path_num))); // kept across waves, never shrunk
+
+            // generate, camera rays of a pixel block are traced here as a packet
+            for_each_chunk(path_num, [&](int chunk, int begin, int end)
+            {
+                sampler_t* sampler = chunk_sampler(original_sampler, wave, -1, chunk);
+                for (int path = begin; path < end; ++path)
                 {
-                    beta *= 1 / (1 - q);
-                    CHECK_DEBUG(!std::isinf(beta.luminance()));
+                    int pixel = pixel_order[(wave_first + path) % pixel_num];
+                    point2_t p_film{ (float_t)(pixel % width), (float_t)(pixel / width) };
+
+                    paths_.rays[path] = camera->generate_ray(sampler->get_camera_sample(p_film));
+                    paths_.betas[path] = color_t{ 1, 1, 1 };
+                    paths_.Los[path] = color_t{};
+                    paths_.pixels[path] = pixel;
+                    paths_.is_prev_speculars[path] = false;
                 }
+
+                bool is_hits[accel_t::k_max_packet_size];
+                for (int first = begin, last = begin; first < end; first = last)
+                {
+                    // a block is cut into smaller packets where a chunk or a wave ends inside it
+                    int block = pixel_blocks[paths_.pixels[first]];
+                    while (last < end && pixel_blocks[paths_.pixels[last]] == block)
+                        ++last;
+
+                    int packet_size = last - first;
+                    scene->intersect_packet_geometry(&paths_.rays[first], packet_size, &paths_.isects[first], is_hits);
+                    std::copy(is_hits, is_hits + packet_size, paths_.is_hits.begin() + first);
+                }
+            });
+
+            for (int bounces = 0; !active_.empty(); ++bounces)
+            {
+                int active_num = (int)active_.size();
+
+                // intersect, camera rays are done by generate
+                if (bounces > 0)
+                {
+                    for_each_chunk(active_num, [&](int chunk, int begin, int end)
+                    {
+                        for (int i = begin; i < end; ++i)
+                        {
+                            int path = active_[i];
+                            paths_.isects[path] = isect_t{};
+                            paths_.is_hits[path] = scene->intersect_geometry(paths_.rays[path], &paths_.isects[path]);
+                        }
+                    });
+                }
+
+                // shade, misses first, then hits by material
+                shading_queue_.bin(scene->pool(), paths_.isects.data(), paths_.is_hits.data(), &active_);
+
+                for_each_chunk(active_num, [&](int chunk, int begin, int end)
+                {
+                    sampler_t* sampler = chunk_sampler(original_sampler, wave, bounces, chunk);
+                    chunk_t& chunk_data = chunks_[chunk];
+                    chunk_data.shadow_batch.clear();
+                    chunk_data.next.clear();
+
+                    shading_queue_.scattering(scene->pool(), paths_.isects.data(), active_, begin, end);
+
+                    for (int i = begin; i < end; ++i)
+                    {
+                        int path = active_[i];
+                        if (shade(path, bounces, scene, sampler, &chunk_data.shadow_batch))
+                            chunk_data.next.push_back(path);
+                    }
+                });
+
+                // shadow
+                for_each_chunk(active_num, [&](int chunk, int begin, int end)
+                {
+                    chunk_t& chunk_data = chunks_[chunk];
+                    const std::vector<ray_t>& rays = chunk_data.shadow_batch.rays();
+                    int ray_num = (int)rays.size();
+                    chunk_data.is_occludeds.resize(ray_num);
+
+                    bool is_occludeds[accel_t::k_max_packet_size];
+                    for (int first = 0; first < ray_num; first += accel_t::k_max_packet_size)
+                    {
+                        int packet_size = std::min(ray_num - first, accel_t::k_max_packet_size);
+                        scene->occluded_packet(rays.data() + first, packet_size, is_occludeds);
+                        std::copy(is_occludeds, is_occludeds + packet_size, chunk_data.is_occludeds.begin() + first);
+                    }
+                });
+
+                // accumulate
+                for_each_chunk(active_num, [&](int chunk, int begin, int end)
+                {
+                    const chunk_t& chunk_data = chunks_[chunk];
+                    const std::vector<color_t>& unoccluded_Lds = chunk_data.shadow_batch.unoccluded_Lds();
+
+                    for (int i = begin; i < end; ++i)
+                    {
+                        int path = active_[i];
+                        for (int ray = paths_.shadow_begins[path]; ray < paths_.shadow_ends[path]; ++ray)
+                        {
+                            if (!chunk_data.is_occludeds[ray])
+                                paths_.Los[path] += unoccluded_Lds[ray];
+                        }
+                    }
+                });
+
+                // paths going on, in the order they were shaded
+                active_.clear();
+                for (int chunk = 0; chunk < chunk_num(active_num); ++chunk)
+                    active_.insert(active_.end(), chunks_[chunk].next.begin(), chunks_[chunk].next.end());
             }
+
+            for_each_chunk(path_num, [&](int chunk, int begin, int end)
+            {
+                for (int path = begin; path < end; ++path)
+                {
+                    const color_t& L = paths_.Los[path];
+                    CHECK_DEBUG(L.is_valid(), "{}", L.to_string());
+
+                    int pixel = paths_.pixels[path];
+                    tile.add_sample(pixel % width, pixel / width, L);
+                }
+            });
         }
+        LOG("rendering... {} spp, {:.2f}%\r", samples_per_pixel, 100.);
 
-        return Lo;
+        film->add_tile(tile);
+    }
+
+private:
+    // the vertex of `path` found by the intersect stage, the same steps as `extend()`,
+    // except that shadow rays are left in `shadow_batch`, return false if the path ends here
+    bool shade(int path, int bounces, scene_t* scene, sampler_t* sampler, shadow_batch_t* shadow_batch)
+    {
+        const ray_t& ray = paths_.rays[path];
+        const isect_t& isect = paths_.isects[path];
+        color_t& Lo = paths_.Los[path];
+        color_t& beta = paths_.betas[path];
+        bool hit = paths_.is_hits[path];
+
+        paths_.shadow_begins[path] = paths_.shadow_ends[path] = shadow_batch->size();
+
+        // Le: emission
+        if (bounces == 0 || paths_.is_prev_speculars[path])
+            Lo += beta * (hit ? isect.Le() : scene->environment_lighting(ray));
+
+        if (!hit || bounces >= max_path_depth_)
+            return false;
+
+        // Ld: direct lighting, lights sampled now, shadowed later
+        if (!isect.bsdf()->is_delta())
+        {
+            int first = shadow_batch->size();
+            Lo += beta * sample_all_light(isect, scene, *sampler, true, direct_sample_enum_, shadow_batch);
+            shadow_batch->scale(first, beta);
+            paths_.shadow_ends[path] = shadow_batch->size();
+        }
+
+        // Li: indirect lighting, by the next bounce
+        bsdf_sample_t bs = isect.bsdf()->sample(isect.wo, sampler->get_float2());
+        if (bs.f.is_black() || bs.pdf == 0.f)
+            return false;
+
+        beta *= bs.f * abs_dot(bs.wi, isect.normal) / bs.pdf;
+        CHECK_DEBUG(!std::isinf(beta.luminance()));
+
+        paths_.is_prev_speculars[path] = is_delta_bsdf(bs.bsdf_type);
+        paths_.rays[path] = isect.spawn_ray(bs.wi);
+
+        // possibly terminate the path with Russian roulette.
+        if (bounces > 3)
+        {
+            float_t q = std::max((float_t).05, 1 - beta.max_component_value());
+            if (sampler->get_float() < q)
+                return false;
+
+            beta *= 1 / (1 - q);
+        }
+
+        return true;
+    }
+
+    // run `function(chunk, begin, end)` over the chunks of `[0, num)` on all threads
+    template <typename function_t>
+    static void for_each_chunk(int num, const function_t& function)
+    {
+    #ifdef KY_RELEASE
+        #pragma omp parallel for schedule(dynamic, 1) // OpenMP
+    #endif // !KY_RELEASE
+        for (int chunk = 0; chunk < chunk_num(num); ++chunk)
+            function(chunk, chunk * k_chunk_paths, std::min(num, (chunk + 1) * k_chunk_paths));
+    }
+
+    static int chunk_num(int num) { return (num + k_chunk_paths - 1) / k_chunk_paths; }
+
+    // random stream of a chunk in a stage(`bounces` of -1 for generate), the sampler of the chunk reseeded
+    sampler_t* chunk_sampler(sampler_t* original_sampler, int wave, int bounces, int chunk)
+    {
+        std::unique_ptr<sampler_t>& sampler = chunks_[chunk].sampler;
+        if (!sampler)
+            sampler = original_sampler->clone();
+
+        int ids[3] = { wave, bounces, chunk };
+        sampler->set_seed((int)hash_bytes(ids, sizeof(ids)));
+        return sampler.get();
     }
+
+private:
+    static constexpr int k_max_wave_paths = 1 << 14;
+    static constexpr int k_chunk_paths = 1024;
+
+    // output of the shade stage of a chunk of `active_`
+    struct chunk_t
+    {
+        std::unique_ptr<sampler_t> sampler; // see `chunk_sampler()`
+        shadow_batch_t shadow_batch;
+        std::vector<uint8_t> is_occludeds; // of `shadow_batch`
+        std::vector<int> next; // paths going on
+    };
+
+    path_vertex_t paths_;
+    std::vector<int> active_; // paths with a ray to trace
+    shading_queue_t shading_queue_;
+    std::vector<chunk_t> chunks_;
 };
 
 
@@ -4545,6 +10264,10 @@ std::unique_ptr<integrator_t> create_integrator(integrator_enum_t integrator_enu
         return std::make_unique<path_tracing_recursion_defered_t>(depth, direct_sample_enum, lighting_enum_t::all);
     case integrator_enum_t::path_tracing_iteration:
         return std::make_unique<path_tracing_iteration_t>(depth, direct_sample_enum);
+    case integrator_enum_t::path_tracing_sorted:
+        return std::make_unique<path_tracing_sorted_t>(depth, direct_sample_enum);
+    case integrator_enum_t::path_tracing_wavefront:
+        return std::make_unique<path_tracing_wavefront_t>(depth, direct_sample_enum);
     }
 
     return nullptr;
@@ -4597,6 +10320,7 @@ void render_single_scene(int argc, char* argv[])
     film_t film(width, height); //film.clear(color_t(1., 0., 0.));
     scene_t scene = scene_t::create_mis_scene(film.get_resolution());
 #endif // !KY_MIS_SCENE
+    LOG("accel: {}\n", scene.accel().stats().to_string());
 
 #ifdef KY_RELEASE
     int samples_per_pixel = argc == 2 ? atoi(argv[1]) / 4 : 100; // # samples per pixel
@@ -4816,6 +10540,250 @@ void render_mis_scene(int argc, char* argv[])
     film.store_image("veach_mis");
 }
 
+// compare accelerators on the bundled scenes in a single thread: build time, rays per second,
+// and traversal steps per ray(only counted with `KY_ACCEL_STATS`, which slows down the rays a bit)
+void render_accel_benchmark(int argc, char* argv[])
+{
+    int samples_per_pixel = argc == 2 ? atoi(argv[1]) : 4;
+
+    auto accel_params = std::vector<std::pair<accel_enum_t, std::string>>
+    {
+        { accel_enum_t::trivial, "trivial" },
+        { accel_enum_t::bvh,     "bvh" },
+        { accel_enum_t::sbvh,    "sbvh" },
+        { accel_enum_t::bvh4,    "bvh4" },
+        { accel_enum_t::bvh8,    "bvh8" },
+        { accel_enum_t::bvh4_quantized, "bvh4_quantized" },
+        { accel_enum_t::bvh8_quantized, "bvh8_quantized" },
+        { accel_enum_t::grid,    "grid" },
+        { accel_enum_t::kd_tree, "kd_tree" },
+        { accel_enum_t::automatic, "automatic" },
+    };
+
+    // the particle scenes are the ones `automatic` takes a grid and a kd-tree for
+    auto scene_names = std::vector<std::string>{ "cornell box", "mis", "particles", "particles in a room" };
+    for (int scene_index = 0; scene_index < (int)scene_names.size(); ++scene_index)
+    {
+        vec2_t resolution = scene_index == 1 ? vec2_t(512, 308) : vec2_t(256, 256);
+        LOG("{} scene, {} spp\n", scene_names[scene_index], samples_per_pixel);
+
+        for (const auto& [accel_enum, name] : accel_params)
+        {
+            scene_t scene =
+                scene_index == 0 ? scene_t::create_cornell_box_scene(
+                    cornell_box_enum_t::both_small_spheres | cornell_box_enum_t::light_environment, resolution, accel_enum) :
+                scene_index == 1 ? scene_t::create_mis_scene(resolution, accel_enum) :
+                scene_t::create_particle_scene(resolution, 1000, scene_index == 3, accel_enum);
+            const accel_t& accel = scene.accel();
+            const camera_t* camera = scene.get_camera();
+
+            // primary rays are coherent, rays bounced from their hits to random directions are not,
+            // primary rays are ordered by pixel blocks, a sample of a block makes a packet, see `integrator_t::render_packet()`
+            constexpr int k_block_width = accel_t::k_packet_width;
+            std::vector<ray_t> primary_rays, bounce_rays;
+            std::vector<int> packet_sizes;
+            rng_t rng;
+            for (int block_y = 0; block_y < (int)resolution.y; block_y += k_block_width)
+            {
+                for (int block_x = 0; block_x < (int)resolution.x; block_x += k_block_width)
+                {
+                    int block_width = std::min(k_block_width, (int)resolution.x - block_x);
+                    int block_height = std::min(k_block_width, (int)resolution.y - block_y);
+
+                    for (int i = 0; i < samples_per_pixel; ++i)
+                    {
+                        packet_sizes.push_back(block_width * block_height);
+                        for (int p = 0; p < block_width * block_height; ++p)
+                        {
+                            point2_t pixel{ (float_t)(block_x + p % block_width), (float_t)(block_y + p / block_width) };
+                            ray_t ray = camera->generate_ray({ pixel + rng.uniform_float2() });
+                            primary_rays.push_back(ray);
+
+                            hit_t hit;
+                            if (accel.intersect(ray, &hit))
+                            {
+                                isect_t isect = hit.surface->get_isect(ray, hit);
+                                vec3_t direction = uniform_sphere_sample(rng.uniform_float2());
+                                bounce_rays.push_back(isect.spawn_ray(dot(direction, isect.normal) < 0 ? -direction : direction));
+                            }
+                        }
+                    }
+                }
+            }
+
+            // packets of `packet_sizes` if it's not null
+            auto measure = [&accel](const std::vector<ray_t>& rays, bool any_hit, const std::vector<int>* packet_sizes = nullptr)
+            {
+                traversal_counter = {};
+                float_t seconds = timing_seconds([&]()
+                {
+                    if (packet_sizes)
+                    {
+                        std::vector<ray_t> test_rays;
+                        hit_t hits[accel_t::k_max_packet_size];
+                        bool is_hits[accel_t::k_max_packet_size];
+
+                        int first = 0;
+                        for (int size : *packet_sizes)
+                        {
+                            test_rays.assign(rays.begin() + first, rays.begin() + first + size);
+                            accel.intersect_packet(test_rays.data(), size, hits, is_hits);
+                            first += size;
+                        }
+
+                        return;
+                    }
+
+                    for (const ray_t& ray : rays)
+                    {
+                        ray_t test_ray = ray; // `intersect()` shortens the ray
+                        hit_t hit;
+
+                        if (any_hit)
+                            accel.intersect_p(test_ray);
+                        else
+                            accel.intersect(test_ray, &hit);
+                    }
+                });
+
+                double ray_num = (double)std::max(rays.size(), (size_t)1);
+                std::string result = std::format("{:8.2f} Mrays/s", ray_num / std::max(seconds, k_epsilon) / 1e6);
+            #ifdef KY_ACCEL_STATS
+                result += std::format(", {:6.2f} nodes, {:6.2f} primitives per ray",
+                    traversal_counter.node_visits / ray_num, traversal_counter.primitive_tests / ray_num);
+            #endif // KY_ACCEL_STATS
+                return result;
+            };
+
+            std::string accel_name = name;
+            if (accel_enum == accel_enum_t::automatic)
+            {
+                accel_enum_t selected = scene.accel_enum();
+                auto param = std::find_if(accel_params.begin(), accel_params.end(), [selected](const auto& p) { return p.first == selected; });
+                accel_name += std::format("({})", param->second);
+            }
+
+            LOG("{:14} {}\n", accel_name, accel.stats().to_string());
+            LOG("    primary {}\n", measure(primary_rays, false));
+            LOG("    packet  {}\n", measure(primary_rays, false, &packet_sizes));
+            LOG("    bounce  {}\n", measure(bounce_rays, false));
+            LOG("    any hit {}\n", measure(bounce_rays, true));
+        }
+    }
+}
+
+void render_instance_scene(int argc, char* argv[])
+{
+    int samples_per_pixel = argc == 2 ? atoi(argv[1]) : 16;
+
+    film_t film(512, 308);
+    scene_t scene = scene_t::create_instance_scene(film.get_resolution(), 1024);
+    LOG("top-level accel: {}\n", scene.instance_accel()->stats().to_string());
+
+    std::unique_ptr<sampler_t> sampler = std::make_unique<random_sampler_t>(samples_per_pixel);
+    auto integrator = create_integrator(integrator_enum_t::path_tracing_iteration, 5, direct_sample_enum_t::both_mis);
+    float seconds = timing_seconds([&]()
+    {
+        integrator->render(&scene, sampler.get(), &film);
+    });
+    LOG("\n{} seconds\n", seconds);
+
+    film.store_image("instance");
+}
+
+// bounces traced depth-first vs sorted per tile vs in waves, on a field of instances whose top-level BVH is far larger than L2
+void render_sorting_benchmark(int argc, char* argv[])
+{
+    int samples_per_pixel = argc == 2 ? atoi(argv[1]) : 16;
+
+    film_t film(512, 308);
+    scene_t scene = scene_t::create_instance_scene(film.get_resolution(), 256 * 256);
+    LOG("top-level accel: {}\n", scene.instance_accel()->stats().to_string());
+
+    std::unique_ptr<sampler_t> sampler = std::make_unique<random_sampler_t>(samples_per_pixel);
+    auto integrator_params = std::vector<std::pair<integrator_enum_t, std::string>>
+    {
+        { integrator_enum_t::path_tracing_iteration, "iteration" },
+        { integrator_enum_t::path_tracing_sorted,    "sorted" },
+        { integrator_enum_t::path_tracing_wavefront, "wavefront" },
+    };
+
+    for (const auto& [integrator_enum, name] : integrator_params)
+    {
+        film.clear(color_t{});
+        auto integrator = create_integrator(integrator_enum, 5, direct_sample_enum_t::both_mis);
+        float seconds = timing_seconds([&]()
+        {
+            integrator->render(&scene, sampler.get(), &film);
+        });
+        LOG("\n{:10} {} seconds\n", name, seconds);
+
+        film.store_image("sorting_" + name);
+    }
+}
+
+// turntable of the two small balls in the cornell box, each frame refits the accelerator instead of rebuilding it
+void render_animation(int argc, char* argv[])
+{
+    int samples_per_pixel = argc >= 2 ? atoi(argv[1]) : 16;
+    int frame_num = argc >= 3 ? atoi(argv[2]) : 24;
+
+    film_t film(256, 256);
+    cornell_box_shapes_t shapes;
+    scene_t scene = scene_t::create_cornell_box_scene(
+        cornell_box_enum_t::both_small_spheres | cornell_box_enum_t::light_area, film.get_resolution(),
+        accel_enum_t::bvh, &shapes);
+
+    shape_t* balls[] = { scene.shape(shapes.left_ball), scene.shape(shapes.right_ball) };
+
+    // rotate around the vertical axis through the center of the floor
+    point3_t center = scene.world_bound().centroid();
+    transform_t step =
+        transform_t(mat4_t::translate(vec3_t(center.x, center.y, 0))) *
+        transform_t(mat4_t::rotate(360.f / frame_num, vec3_t(0, 0, 1))) *
+        transform_t(mat4_t::translate(vec3_t(-center.x, -center.y, 0)));
+
+    std::unique_ptr<sampler_t> sampler = std::make_unique<random_sampler_t>(samples_per_pixel);
+    auto integrator = create_integrator(integrator_enum_t::path_tracing_iteration, 5, direct_sample_enum_t::both_mis);
+
+    float total_update_seconds = 0;
+    float total_render_seconds = 0;
+    int rebuild_num = 0;
+
+    for (int frame = 0; frame < frame_num; ++frame)
+    {
+        bool is_rebuilt = false;
+        float update_seconds = 0;
+        if (frame > 0)
+        {
+            update_seconds = timing_seconds([&]()
+            {
+                for (shape_t* ball : balls)
+                    ball->transform(step);
+                is_rebuilt = scene.update();
+            });
+        }
+
+        film.clear(color_t{});
+        float render_seconds = timing_seconds([&]()
+        {
+            integrator->render(&scene, sampler.get(), &film);
+        });
+
+        LOG("\nframe {}: {} in {:.6f} seconds, SAH cost {:.2f}, render {:.3f} seconds\n", frame,
+            is_rebuilt ? "rebuilt" : "refitted", update_seconds, scene.accel().sah_cost(), render_seconds);
+
+        total_update_seconds += update_seconds;
+        total_render_seconds += render_seconds;
+        rebuild_num += is_rebuilt;
+
+        film.store_image(std::format("animation_{:03}", frame));
+    }
+
+    LOG("\n{} frames, {} rebuilt, {:.6f} seconds to update, {:.3f} seconds to render\n",
+        frame_num, rebuild_num, total_update_seconds, total_render_seconds);
+}
+
 /*
 void render_lighting_enum()
 {
@@ -4856,6 +10824,10 @@ int main(int argc, char* argv[])
     //render_direct_sample_enum(argc, argv);
     //render_multiple_scene(argc, argv);
     //render_mis_scene(argc, argv);
+    //render_accel_benchmark(argc, argv);
+    //render_instance_scene(argc, argv);
+    //render_sorting_benchmark(argc, argv);
+    //render_animation(argc, argv);
 
     return 0;
 }